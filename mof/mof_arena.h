@@ -0,0 +1,180 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.00
+ * @since 2012-02-23
+ * 
+ * This class is a memory arena for what only live for a frame.  Memory is
+ * taken from a single block by moving a pointer, nothing is freed on its
+ * own: the whole arena is reset at the end of the frame.  When a frame need
+ * more than the block, the extra memory is allocated on the heap until the
+ * reset, which then grow the block to what the frame used.  Once the block
+ * is big enough, frames do not touch the heap anymore.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#ifndef MOF_ARENA_H_
+#define MOF_ARENA_H_
+
+#define MOF_ARENA_TYPE (1<<16)		/* dynamic type checking */
+#define MOF_ARENA_ALIGN 16			/* alignment of every allocation (SSE) */
+
+/**
+ * mof_Arena class.
+ */
+typedef struct {
+  unsigned int type;
+  char *block;
+  size_t size;						/* size of the block */
+  size_t used;						/* bytes allocated since the reset (block and extra) */
+  void *extra;						/* heap allocations since the reset (linked) */
+  unsigned long allocations;		/* heap allocations since the creation */
+} mof_Arena;
+
+/**
+ * Constructor.
+ * 
+ * @param arena Pointer to a mof_Arena object.
+ * @param size  Initial size of the block (bytes).
+ */
+void mof_Arena__construct(mof_Arena *arena, size_t size)
+{
+  /* here OR the MOF_ARENA_TYPE constant into the type */
+  arena->type |= MOF_ARENA_TYPE;
+
+  arena->size = (size + MOF_ARENA_ALIGN - 1) & ~(size_t)(MOF_ARENA_ALIGN - 1);
+  arena->block = malloc(arena->size);
+  arena->used = 0;
+  arena->extra = NULL;
+  arena->allocations = 1;
+}
+
+/**
+ * New.
+ * 
+ * @param size Initial size of the block (bytes).
+ * @return     An object mof_Arena.
+ */
+mof_Arena *mof_Arena__new(size_t size)
+{
+  mof_Arena *arena = malloc(sizeof(mof_Arena));
+  arena->type = MOF_ARENA_TYPE;
+
+  /* call the constructor */
+  mof_Arena__construct(arena, size);
+
+  return arena;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param arena Pointer to a mof_Arena object.
+ */
+void mof_Arena__check(mof_Arena *arena)
+{
+  /* check if we have a valid mof_Arena object */
+  if (arena == NULL ||
+	  !(arena->type & MOF_ARENA_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Free the heap allocations done since the reset.
+ * 
+ * @param arena Pointer to a mof_Arena object.
+ */
+void mof_Arena__release(mof_Arena *arena)
+{
+  void *next;
+
+  while (arena->extra != NULL)
+  {
+	next = *(void **)arena->extra;
+	free(arena->extra);
+	arena->extra = next;
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param arena Pointer to a mof_Arena object.
+ */
+void mof_Arena__destroy(mof_Arena *arena)
+{
+  /* check if we have a valid mof_Arena object */
+  mof_Arena__check(arena);
+
+  /* set type to 0 indicate this is no longer a mof_Arena object */
+  arena->type = 0;
+
+  /* free the memory allocated for the object */
+  mof_Arena__release(arena);
+  free(arena->block);
+  free(arena);
+}
+
+/**
+ * Allocate memory until the next reset.
+ * 
+ * @param arena Pointer to a mof_Arena object.
+ * @param size  Number of bytes.
+ * @return      Pointer to the memory (aligned on MOF_ARENA_ALIGN).
+ */
+void *mof_Arena__alloc(mof_Arena *arena, size_t size)
+{
+  char *memory;
+
+  size = (size + MOF_ARENA_ALIGN - 1) & ~(size_t)(MOF_ARENA_ALIGN - 1);
+
+  if (arena->used + size <= arena->size)
+  {
+	memory = arena->block + arena->used;
+	arena->used += size;
+	return memory;
+  }
+
+  /* the block is full, a link to the previous extra allocation come first */
+  memory = malloc(MOF_ARENA_ALIGN + size);
+  *(void **)memory = arena->extra;
+  arena->extra = memory;
+  arena->used += size;
+  arena->allocations++;
+
+  return memory + MOF_ARENA_ALIGN;
+}
+
+/**
+ * Reset the arena (end of the frame).
+ * 
+ * Everything allocated since the previous reset become invalid.  If the
+ * frame did not fit in the block, the block is grown to hold it.
+ * 
+ * @param arena Pointer to a mof_Arena object.
+ */
+void mof_Arena__reset(mof_Arena *arena)
+{
+  /* check if we have a valid mof_Arena object */
+  mof_Arena__check(arena);
+
+  if (arena->extra != NULL)
+  {
+	mof_Arena__release(arena);
+
+	free(arena->block);
+	arena->size = arena->used + arena->used / 2;
+	arena->block = malloc(arena->size);
+	arena->allocations++;
+  }
+
+  arena->used = 0;
+}
+
+#endif
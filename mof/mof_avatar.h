@@ -1,6 +1,6 @@
 /**
  * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
- * @version 1.10
+ * @version 1.30
  * @since 2012-01-17
  */
 
@@ -8,6 +8,7 @@
 #include <math.h>
 
 #include "mof_collisionbox.h"
+#include "mof_map.h"
 
 #ifndef MOF_AVATAR_H_
 #define MOF_AVATAR_H_
@@ -157,6 +158,62 @@ void mof_Avatar__moveright(mof_Avatar *avatar)
   avatar->y -= (sin((avatar->angle - 90) * M_PI / 180) * 1);
 }
 
+/**
+ * Resolve the collisions of an avatar with the walls after a step.
+ * 
+ * For every wall hit, in the order of the map, the step is undone then
+ * the avatar slide along X by the step, or else along Y, or else stay.
+ * Only the cells around the box are read, with a cell more on every side
+ * since every resolution move the avatar a little.
+ * 
+ * @param avatar       Pointer to a mof_Avatar object (after the step).
+ * @param collisionbox Box of the avatar (centered on it).
+ * @param map          Pointer to a mof_Map object.
+ * @param undo         Move undoing the step.
+ * @param stepX        Step along X.
+ * @param stepY        Step along Y.
+ */
+void mof_Avatar__collide(mof_Avatar *avatar, mof_Collisionbox *collisionbox, mof_Map *map, void (*undo)(mof_Avatar *), 
+						 double stepX, double stepY)
+{
+  /* check if we have a valid mof_Avatar object */
+  mof_Avatar__check(avatar);
+  
+  int halfW = collisionbox->width / 2, halfH = collisionbox->height / 2;
+  int i, j, around[4], under[4];
+  
+  mof_Collisionbox__move(collisionbox, (int)avatar->x - halfW, (int)avatar->y - halfH);
+  mof_Map__range(map, collisionbox->x - map->unit, collisionbox->y - map->unit, 
+				 collisionbox->width + 2 * map->unit, collisionbox->height + 2 * map->unit, around);
+  for (i = around[2]; i <= around[3]; i++)
+  {
+	for (j = around[0]; j <= around[1]; j++)
+	{
+	  if (!map->map[(i * map->width) + j])
+		continue;
+	  mof_Map__range(map, collisionbox->x, collisionbox->y, collisionbox->width, collisionbox->height, under);
+	  if (j < under[0] || j > under[1] || i < under[2] || i > under[3])
+		continue;
+	  
+	  /* resolve collision */
+	  undo(avatar);
+	  avatar->x += stepX;
+	  mof_Collisionbox__move(collisionbox, (int)avatar->x - halfW, (int)avatar->y - halfH);
+	  if (mof_Map__intersect(map, collisionbox))
+	  {
+		avatar->x -= stepX;
+		avatar->y += stepY;
+		mof_Collisionbox__move(collisionbox, (int)avatar->x - halfW, (int)avatar->y - halfH);
+		if (mof_Map__intersect(map, collisionbox))
+		{
+		  avatar->y -= stepY;
+		  mof_Collisionbox__move(collisionbox, (int)avatar->x - halfW, (int)avatar->y - halfH);
+		}
+	  }
+	}
+  }
+}
+
 /**
  * Rotate direction of avatar.
  * 
@@ -0,0 +1,236 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.10
+ * @since 2012-02-12
+ * 
+ * This class hold everything about the projection that only depend on the
+ * resolution: the distance from the projection plane and the direction of
+ * every column relative to the viewer.  The tables are built once and only
+ * rebuilt when the resolution change, so the frame loop do no trigonometry.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#ifndef MOF_CAMERA_H_
+#define MOF_CAMERA_H_
+
+#define MOF_CAMERA_TYPE (1<<8)		/* dynamic type checking */
+
+/**
+ * mof_Camera class.
+ */
+typedef struct {
+  unsigned int type;
+  int width;						/* resolution the tables are built for */
+  int height;
+  double fov;						/* field of view (degree) */
+  double projection;				/* distance from projection plane */
+  double *columnAngle;				/* angle of the column (radian, positive to the left) */
+  double *columnCos;				/* cosine of the column angle (fisheye factor) */
+  double *columnSin;				/* sine of the column angle */
+  double angleCos[360];				/* cosine of every viewer angle (degree) */
+  double angleSin[360];				/* sine of every viewer angle (degree) */
+} mof_Camera;
+
+/**
+ * Build the tables for the current resolution.
+ * 
+ * Each column is given the exact angle of the ray going through its center
+ * on the projection plane, so the column count always match the width.
+ * 
+ * @param camera Pointer to a mof_Camera object.
+ */
+void mof_Camera__build(mof_Camera *camera)
+{
+  int i;
+  double angle;
+
+  camera->projection = (camera->width / 2.0) / tan((camera->fov / 2) * M_PI / 180);
+
+  camera->columnAngle = malloc(camera->width * sizeof(double));
+  camera->columnCos = malloc(camera->width * sizeof(double));
+  camera->columnSin = malloc(camera->width * sizeof(double));
+  for (i = 0; i < camera->width; i++)
+  {
+	/* positive angle is to the left of the viewer */
+	angle = atan(((camera->width / 2.0) - (i + 0.5)) / camera->projection);
+	camera->columnAngle[i] = angle;
+	camera->columnCos[i] = cos(angle);
+	camera->columnSin[i] = sin(angle);
+  }
+}
+
+/**
+ * Constructor.
+ * 
+ * @param camera Pointer to a mof_Camera object.
+ * @param width  Width of the projection (in column).
+ * @param height Height of the projection.
+ * @param fov    Field of view (degree).
+ */
+void mof_Camera__construct(mof_Camera *camera, int width, int height, double fov)
+{
+  /* here OR the MOF_CAMERA_TYPE constant into the type */
+  camera->type |= MOF_CAMERA_TYPE;
+
+  int i;
+  for (i = 0; i < 360; i++)
+  {
+	camera->angleCos[i] = cos(i * M_PI / 180);
+	camera->angleSin[i] = sin(i * M_PI / 180);
+  }
+
+  camera->width = width;
+  camera->height = height;
+  camera->fov = fov;
+
+  mof_Camera__build(camera);
+}
+
+/**
+ * New.
+ * 
+ * @param width  Width of the projection (in column).
+ * @param height Height of the projection.
+ * @param fov    Field of view (degree).
+ * @return       An object mof_Camera.
+ */
+mof_Camera *mof_Camera__new(int width, int height, double fov)
+{
+  mof_Camera *camera = malloc(sizeof(mof_Camera));
+  camera->type = MOF_CAMERA_TYPE;
+
+  /* call the constructor */
+  mof_Camera__construct(camera, width, height, fov);
+
+  return camera;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param camera Pointer to a mof_Camera object.
+ */
+void mof_Camera__check(mof_Camera *camera)
+{
+  /* check if we have a valid mof_Camera object */
+  if (camera == NULL ||
+	  !(camera->type & MOF_CAMERA_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param camera Pointer to a mof_Camera object.
+ */
+void mof_Camera__destroy(mof_Camera *camera)
+{
+  /* check if we have a valid mof_Camera object */
+  mof_Camera__check(camera);
+
+  /* set type to 0 indicate this is no longer a mof_Camera object */
+  camera->type = 0;
+
+  /* free the memory allocated for the object */
+  free(camera->columnAngle);
+  free(camera->columnCos);
+  free(camera->columnSin);
+  free(camera);
+}
+
+/**
+ * Resize the projection.
+ * 
+ * Should be called on SDL_VIDEORESIZE, the tables are only rebuilt if the
+ * resolution really changed.
+ * 
+ * @param camera Pointer to a mof_Camera object.
+ * @param width  New width of the projection (in column).
+ * @param height New height of the projection.
+ */
+void mof_Camera__resize(mof_Camera *camera, int width, int height)
+{
+  /* check if we have a valid mof_Camera object */
+  mof_Camera__check(camera);
+
+  camera->height = height;
+
+  if (camera->width == width)
+	return;
+
+  free(camera->columnAngle);
+  free(camera->columnCos);
+  free(camera->columnSin);
+  camera->width = width;
+  mof_Camera__build(camera);
+}
+
+/**
+ * Wrap an angle (degree) in the range of the tables.
+ * 
+ * @param angle Angle of the viewer.
+ * @return      Same angle in [0, 360).
+ */
+int mof_Camera__angle(int angle)
+{
+  angle %= 360;
+  return (angle < 0) ? angle + 360 : angle;
+}
+
+/**
+ * Direction of the ray going through a column.
+ * 
+ * @param camera Pointer to a mof_Camera object.
+ * @param angle  Angle of the viewer (degree).
+ * @param column Column of the projection.
+ * @param dirX   Direction of the ray (unit vector).
+ * @param dirY   Direction of the ray (unit vector, Y axis pointing down).
+ */
+void mof_Camera__ray(mof_Camera *camera, int angle, int column, double *dirX, double *dirY)
+{
+  angle = mof_Camera__angle(angle);
+
+  /* rotation of the column direction by the viewer angle */
+  *dirX = camera->angleCos[angle] * camera->columnCos[column] - camera->angleSin[angle] * camera->columnSin[column];
+  *dirY = -(camera->angleSin[angle] * camera->columnCos[column] + camera->angleCos[angle] * camera->columnSin[column]);
+}
+
+/**
+ * Project a point on the screen.
+ * 
+ * @param camera  Pointer to a mof_Camera object.
+ * @param angle   Angle of the viewer (degree).
+ * @param Px      Coordinate of the viewer.
+ * @param Py      Coordinate of the viewer.
+ * @param x       Coordinate of the point.
+ * @param y       Coordinate of the point.
+ * @param screenX Horizontal position on the screen (in column).
+ * @param depth   Distance from the viewer along its direction.
+ * @return        True (1) if the point is in front of the viewer, false (0) otherwise.
+ */
+int mof_Camera__project(mof_Camera *camera, int angle, double Px, double Py, double x, double y, double *screenX, double *depth)
+{
+  angle = mof_Camera__angle(angle);
+
+  double cosine = camera->angleCos[angle];
+  double sine = camera->angleSin[angle];
+
+  /* forward is (cos, -sin) and right is (sin, cos) */
+  *depth = (x - Px) * cosine - (y - Py) * sine;
+  if (*depth <= 0)
+	return 0;
+
+  *screenX = (camera->width / 2.0) + ((x - Px) * sine + (y - Py) * cosine) * camera->projection / *depth;
+
+  return 1;
+}
+
+#endif
@@ -0,0 +1,1038 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.40
+ * @since 2012-02-16
+ * 
+ * This class give a direct access to the pixels of a SDL surface.  The
+ * surface is locked once for the whole frame and spans are written straight
+ * into the pixel buffer (respecting the pitch and the number of bytes per
+ * pixel of the surface), which is a lot cheaper than a generic clipped box
+ * for every column.  Spans are opaque, except the blended horizontal ones.
+ * Horizontal spans are filled and blended by kernels written for every
+ * number of bytes per pixel, chosen when the surface is locked along with
+ * their SSE2 or AVX2 version when the processor support it.  Boxes can be
+ * drawn on a surface that is not locked (instead of SDL_gfx).
+ * A view of a rectangle of the locked surface can be taken, drawing in the
+ * view is clipped to the rectangle (tiles drawn by different threads).
+ * Horizontal textured spans step their texture coordinates four pixels at
+ * a time (SSE2) on 32 bits surfaces.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MOF_FRAMEBUFFER_SIMD
+#include <immintrin.h>
+#endif
+
+#include "SDL.h"
+
+#ifndef MOF_FRAMEBUFFER_H_
+#define MOF_FRAMEBUFFER_H_
+
+#define MOF_FRAMEBUFFER_TYPE (1<<11)		/* dynamic type checking */
+
+/**
+ * mof_Framebuffer class.
+ */
+typedef struct {
+  unsigned int type;
+  SDL_Surface *surface;		/* NULL when not locked */
+  Uint8 *pixels;
+  int pitch;				/* bytes per line */
+  int bpp;					/* bytes per pixel */
+  int width;
+  int height;
+  void (*fill)(Uint8 *pixel, int count, Uint32 color);	/* kernels of the pixel format */
+  void (*blend)(Uint8 *pixel, int count, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format);
+  const char *kernels;		/* name of the kernels */
+} mof_Framebuffer;
+
+/**
+ * Constructor.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ */
+void mof_Framebuffer__construct(mof_Framebuffer *framebuffer)
+{
+  /* here OR the MOF_FRAMEBUFFER_TYPE constant into the type */
+  framebuffer->type |= MOF_FRAMEBUFFER_TYPE;
+
+  framebuffer->surface = NULL;
+  framebuffer->pixels = NULL;
+  framebuffer->pitch = 0;
+  framebuffer->bpp = 0;
+  framebuffer->width = 0;
+  framebuffer->height = 0;
+  framebuffer->fill = NULL;
+  framebuffer->blend = NULL;
+  framebuffer->kernels = NULL;
+}
+
+/**
+ * New.
+ * 
+ * @return An object mof_Framebuffer.
+ */
+mof_Framebuffer *mof_Framebuffer__new()
+{
+  mof_Framebuffer *framebuffer = malloc(sizeof(mof_Framebuffer));
+  framebuffer->type = MOF_FRAMEBUFFER_TYPE;
+
+  /* call the constructor */
+  mof_Framebuffer__construct(framebuffer);
+
+  return framebuffer;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ */
+void mof_Framebuffer__check(mof_Framebuffer *framebuffer)
+{
+  /* check if we have a valid mof_Framebuffer object */
+  if (framebuffer == NULL ||
+	  !(framebuffer->type & MOF_FRAMEBUFFER_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ */
+void mof_Framebuffer__destroy(mof_Framebuffer *framebuffer)
+{
+  /* check if we have a valid mof_Framebuffer object */
+  mof_Framebuffer__check(framebuffer);
+
+  /* set type to 0 indicate this is no longer a mof_Framebuffer object */
+  framebuffer->type = 0;
+
+  /* free the memory allocated for the object */
+  free(framebuffer);
+}
+
+/**
+ * Blend a color over a pixel.
+ * 
+ * Every channel is moved toward the color by alpha / 256, on the bits of
+ * the channel in place (same as SDL_gfx).
+ * 
+ * @param format Pixel format of the surface (more than 8 bits per pixel).
+ * @param pixel  Pixel value.
+ * @param color  Pixel value of the color.
+ * @param alpha  Opacity of the color (0 to 255).
+ * @return       Pixel value.
+ */
+Uint32 mof_Framebuffer__mix(const SDL_PixelFormat *format, Uint32 pixel, Uint32 color, Uint8 alpha)
+{
+  Uint32 masks[4] = {format->Rmask, format->Gmask, format->Bmask, format->Amask};
+  Uint32 mixed = 0, from;
+  int i;
+  
+  for (i = 0; i < 4; i++)
+  {
+	from = pixel & masks[i];
+	mixed |= (Uint32)(from + ((((long long)(color & masks[i]) - from) * alpha) >> 8)) & masks[i];
+  }
+  
+  return mixed;
+}
+
+/* fill kernels: count pixels from pixel with the pixel value color */
+
+void mof_Framebuffer__fill8(Uint8 *pixel, int count, Uint32 color)
+{
+  memset(pixel, (Uint8)color, count);
+}
+
+void mof_Framebuffer__fill16(Uint8 *pixel, int count, Uint32 color)
+{
+  Uint16 *at = (Uint16 *)pixel;
+  
+  for (; count > 0; count--)
+	*at++ = (Uint16)color;
+}
+
+void mof_Framebuffer__fill24(Uint8 *pixel, int count, Uint32 color)
+{
+  Uint8 pattern[12];
+  int i;
+  
+  /* four pixels make three words */
+  for (i = 0; i < 12; i += 3)
+  {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+	pattern[i] = (color >> 16) & 0xff;
+	pattern[i + 1] = (color >> 8) & 0xff;
+	pattern[i + 2] = color & 0xff;
+#else
+	pattern[i] = color & 0xff;
+	pattern[i + 1] = (color >> 8) & 0xff;
+	pattern[i + 2] = (color >> 16) & 0xff;
+#endif
+  }
+  
+  for (; count >= 4; count -= 4, pixel += 12)
+	memcpy(pixel, pattern, 12);
+  memcpy(pixel, pattern, count * 3);
+}
+
+void mof_Framebuffer__fill32(Uint8 *pixel, int count, Uint32 color)
+{
+  Uint32 *at = (Uint32 *)pixel;
+  
+  for (; count > 0; count--)
+	*at++ = color;
+}
+
+/* blend kernels: count pixels from pixel blended with the pixel value color */
+
+void mof_Framebuffer__blend8(Uint8 *pixel, int count, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format)
+{
+  Uint8 red, green, blue, r, g, b;
+  
+  /* palette, blended on the colors themselves */
+  SDL_GetRGB(color, (SDL_PixelFormat *)format, &r, &g, &b);
+  for (; count > 0; count--, pixel++)
+  {
+	SDL_GetRGB(*pixel, (SDL_PixelFormat *)format, &red, &green, &blue);
+	*pixel = (Uint8)SDL_MapRGB((SDL_PixelFormat *)format, red + (((r - red) * alpha) >> 8), green + (((g - green) * alpha) >> 8), 
+							   blue + (((b - blue) * alpha) >> 8));
+  }
+}
+
+void mof_Framebuffer__blend16(Uint8 *pixel, int count, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format)
+{
+  Uint16 *at = (Uint16 *)pixel;
+  
+  for (; count > 0; count--, at++)
+	*at = (Uint16)mof_Framebuffer__mix(format, *at, color, alpha);
+}
+
+void mof_Framebuffer__blend24(Uint8 *pixel, int count, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format)
+{
+  Uint32 mixed;
+  
+  for (; count > 0; count--, pixel += 3)
+  {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+	mixed = mof_Framebuffer__mix(format, (pixel[0] << 16) | (pixel[1] << 8) | pixel[2], color, alpha);
+	pixel[0] = (mixed >> 16) & 0xff;
+	pixel[1] = (mixed >> 8) & 0xff;
+	pixel[2] = mixed & 0xff;
+#else
+	mixed = mof_Framebuffer__mix(format, pixel[0] | (pixel[1] << 8) | (pixel[2] << 16), color, alpha);
+	pixel[0] = mixed & 0xff;
+	pixel[1] = (mixed >> 8) & 0xff;
+	pixel[2] = (mixed >> 16) & 0xff;
+#endif
+  }
+}
+
+void mof_Framebuffer__blend32(Uint8 *pixel, int count, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format)
+{
+  Uint32 *at = (Uint32 *)pixel;
+  
+  for (; count > 0; count--, at++)
+	*at = mof_Framebuffer__mix(format, *at, color, alpha);
+}
+
+#ifdef MOF_FRAMEBUFFER_SIMD
+
+/*
+ * The blend kernels below compute every channel as
+ * (color * alpha + pixel * (256 - alpha)) >> 8, which is the same as
+ * mof_Framebuffer__mix and never overflow 16 bits.
+ */
+
+__attribute__((target("sse2")))
+void mof_Framebuffer__fill16sse2(Uint8 *pixel, int count, Uint32 color)
+{
+  __m128i value = _mm_set1_epi16((short)color);
+  
+  for (; count >= 8; count -= 8, pixel += 16)
+	_mm_storeu_si128((__m128i *)pixel, value);
+  mof_Framebuffer__fill16(pixel, count, color);
+}
+
+__attribute__((target("sse2")))
+void mof_Framebuffer__fill32sse2(Uint8 *pixel, int count, Uint32 color)
+{
+  __m128i value = _mm_set1_epi32(color);
+  
+  for (; count >= 4; count -= 4, pixel += 16)
+	_mm_storeu_si128((__m128i *)pixel, value);
+  mof_Framebuffer__fill32(pixel, count, color);
+}
+
+/* every channel of 8 pixels (16 bits) */
+__attribute__((target("sse2")))
+__m128i mof_Framebuffer__blend16channels(__m128i pixels, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format)
+{
+  Uint32 masks[4] = {format->Rmask, format->Gmask, format->Bmask, format->Amask};
+  Uint8 shifts[4] = {format->Rshift, format->Gshift, format->Bshift, format->Ashift};
+  __m128i mixed = _mm_setzero_si128(), channel, shift;
+  __m128i inverse = _mm_set1_epi16(256 - alpha);
+  int i;
+  
+  for (i = 0; i < 4; i++)
+  {
+	if (masks[i] == 0)
+	  continue;
+	
+	shift = _mm_cvtsi32_si128(shifts[i]);
+	channel = _mm_srl_epi16(_mm_and_si128(pixels, _mm_set1_epi16((short)masks[i])), shift);
+	channel = _mm_mullo_epi16(channel, inverse);
+	channel = _mm_add_epi16(channel, _mm_set1_epi16((short)(((color & masks[i]) >> shifts[i]) * alpha)));
+	channel = _mm_sll_epi16(_mm_srli_epi16(channel, 8), shift);
+	mixed = _mm_or_si128(mixed, _mm_and_si128(channel, _mm_set1_epi16((short)masks[i])));
+  }
+  
+  return mixed;
+}
+
+__attribute__((target("sse2")))
+void mof_Framebuffer__blend16sse2(Uint8 *pixel, int count, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format)
+{
+  for (; count >= 8; count -= 8, pixel += 16)
+	_mm_storeu_si128((__m128i *)pixel, mof_Framebuffer__blend16channels(_mm_loadu_si128((__m128i *)pixel), color, alpha, format));
+  mof_Framebuffer__blend16(pixel, count, color, alpha, format);
+}
+
+/* 32 bits pixels with a byte per channel only */
+__attribute__((target("sse2")))
+void mof_Framebuffer__blend32sse2(Uint8 *pixel, int count, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i source = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32(color), zero), _mm_set1_epi16(alpha));
+  __m128i inverse = _mm_set1_epi16(256 - alpha);
+  __m128i mask = _mm_set1_epi32(format->Rmask | format->Gmask | format->Bmask | format->Amask);
+  __m128i pixels, low, high;
+  
+  for (; count >= 4; count -= 4, pixel += 16)
+  {
+	pixels = _mm_loadu_si128((__m128i *)pixel);
+	low = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), inverse), source), 8);
+	high = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), inverse), source), 8);
+	_mm_storeu_si128((__m128i *)pixel, _mm_and_si128(_mm_packus_epi16(low, high), mask));
+  }
+  mof_Framebuffer__blend32(pixel, count, color, alpha, format);
+}
+
+__attribute__((target("avx2")))
+void mof_Framebuffer__fill16avx2(Uint8 *pixel, int count, Uint32 color)
+{
+  __m256i value = _mm256_set1_epi16((short)color);
+  
+  for (; count >= 16; count -= 16, pixel += 32)
+	_mm256_storeu_si256((__m256i *)pixel, value);
+  mof_Framebuffer__fill16(pixel, count, color);
+}
+
+__attribute__((target("avx2")))
+void mof_Framebuffer__fill32avx2(Uint8 *pixel, int count, Uint32 color)
+{
+  __m256i value = _mm256_set1_epi32(color);
+  
+  for (; count >= 8; count -= 8, pixel += 32)
+	_mm256_storeu_si256((__m256i *)pixel, value);
+  mof_Framebuffer__fill32(pixel, count, color);
+}
+
+__attribute__((target("avx2")))
+void mof_Framebuffer__blend16avx2(Uint8 *pixel, int count, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format)
+{
+  Uint32 masks[4] = {format->Rmask, format->Gmask, format->Bmask, format->Amask};
+  Uint8 shifts[4] = {format->Rshift, format->Gshift, format->Bshift, format->Ashift};
+  __m256i inverse = _mm256_set1_epi16(256 - alpha);
+  __m256i pixels, mixed, channel;
+  __m128i shift;
+  int i;
+  
+  for (; count >= 16; count -= 16, pixel += 32)
+  {
+	pixels = _mm256_loadu_si256((__m256i *)pixel);
+	mixed = _mm256_setzero_si256();
+	for (i = 0; i < 4; i++)
+	{
+	  if (masks[i] == 0)
+		continue;
+	  
+	  shift = _mm_cvtsi32_si128(shifts[i]);
+	  channel = _mm256_srl_epi16(_mm256_and_si256(pixels, _mm256_set1_epi16((short)masks[i])), shift);
+	  channel = _mm256_mullo_epi16(channel, inverse);
+	  channel = _mm256_add_epi16(channel, _mm256_set1_epi16((short)(((color & masks[i]) >> shifts[i]) * alpha)));
+	  channel = _mm256_sll_epi16(_mm256_srli_epi16(channel, 8), shift);
+	  mixed = _mm256_or_si256(mixed, _mm256_and_si256(channel, _mm256_set1_epi16((short)masks[i])));
+	}
+	_mm256_storeu_si256((__m256i *)pixel, mixed);
+  }
+  mof_Framebuffer__blend16(pixel, count, color, alpha, format);
+}
+
+/* 32 bits pixels with a byte per channel only */
+__attribute__((target("avx2")))
+void mof_Framebuffer__blend32avx2(Uint8 *pixel, int count, Uint32 color, Uint8 alpha, const SDL_PixelFormat *format)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i source = _mm256_mullo_epi16(_mm256_unpacklo_epi8(_mm256_set1_epi32(color), zero), _mm256_set1_epi16(alpha));
+  __m256i inverse = _mm256_set1_epi16(256 - alpha);
+  __m256i mask = _mm256_set1_epi32(format->Rmask | format->Gmask | format->Bmask | format->Amask);
+  __m256i pixels, low, high;
+  
+  for (; count >= 8; count -= 8, pixel += 32)
+  {
+	pixels = _mm256_loadu_si256((__m256i *)pixel);
+	low = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(pixels, zero), inverse), source), 8);
+	high = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(pixels, zero), inverse), source), 8);
+	_mm256_storeu_si256((__m256i *)pixel, _mm256_and_si256(_mm256_packus_epi16(low, high), mask));
+  }
+  mof_Framebuffer__blend32(pixel, count, color, alpha, format);
+}
+
+#endif
+
+/**
+ * Choose the kernels of a pixel format.
+ * 
+ * The fastest version the processor support is taken.  The 32 bits blend
+ * kernels in SIMD need a byte per channel.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param format      Pixel format of the surface.
+ */
+void mof_Framebuffer__kernels(mof_Framebuffer *framebuffer, const SDL_PixelFormat *format)
+{
+  int bytes = 1, i;
+  Uint32 masks[4] = {format->Rmask, format->Gmask, format->Bmask, format->Amask};
+  
+  for (i = 0; i < 4; i++)
+  {
+	if (masks[i] != 0 && masks[i] != 0xff && masks[i] != 0xff00 && masks[i] != 0xff0000 && masks[i] != 0xff000000)
+	  bytes = 0;
+  }
+  
+  switch (format->BytesPerPixel)
+  {
+	case 1:
+	  framebuffer->fill = mof_Framebuffer__fill8;
+	  framebuffer->blend = mof_Framebuffer__blend8;
+	  framebuffer->kernels = "scalar";
+	  break;
+	
+	case 2:
+	  framebuffer->fill = mof_Framebuffer__fill16;
+	  framebuffer->blend = mof_Framebuffer__blend16;
+	  framebuffer->kernels = "scalar";
+#ifdef MOF_FRAMEBUFFER_SIMD
+	  if (__builtin_cpu_supports("avx2"))
+	  {
+		framebuffer->fill = mof_Framebuffer__fill16avx2;
+		framebuffer->blend = mof_Framebuffer__blend16avx2;
+		framebuffer->kernels = "avx2";
+	  }
+	  else if (__builtin_cpu_supports("sse2"))
+	  {
+		framebuffer->fill = mof_Framebuffer__fill16sse2;
+		framebuffer->blend = mof_Framebuffer__blend16sse2;
+		framebuffer->kernels = "sse2";
+	  }
+#endif
+	  break;
+	
+	case 3:
+	  framebuffer->fill = mof_Framebuffer__fill24;
+	  framebuffer->blend = mof_Framebuffer__blend24;
+	  framebuffer->kernels = "scalar";
+	  break;
+	
+	case 4:
+	  framebuffer->fill = mof_Framebuffer__fill32;
+	  framebuffer->blend = mof_Framebuffer__blend32;
+	  framebuffer->kernels = "scalar";
+#ifdef MOF_FRAMEBUFFER_SIMD
+	  if (__builtin_cpu_supports("avx2"))
+	  {
+		framebuffer->fill = mof_Framebuffer__fill32avx2;
+		if (bytes)
+		  framebuffer->blend = mof_Framebuffer__blend32avx2;
+		framebuffer->kernels = "avx2";
+	  }
+	  else if (__builtin_cpu_supports("sse2"))
+	  {
+		framebuffer->fill = mof_Framebuffer__fill32sse2;
+		if (bytes)
+		  framebuffer->blend = mof_Framebuffer__blend32sse2;
+		framebuffer->kernels = "sse2";
+	  }
+#endif
+	  break;
+  }
+}
+
+/**
+ * Lock a surface for direct access.
+ * 
+ * Nothing else (SDL_gfx, blitting) should draw on the surface until it
+ * is unlocked.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param surface     Surface to write to.
+ */
+void mof_Framebuffer__lock(mof_Framebuffer *framebuffer, SDL_Surface *surface)
+{
+  /* check if we have a valid mof_Framebuffer object */
+  mof_Framebuffer__check(framebuffer);
+
+  if (SDL_MUSTLOCK(surface))
+	SDL_LockSurface(surface);
+
+  framebuffer->surface = surface;
+  framebuffer->pixels = surface->pixels;
+  framebuffer->pitch = surface->pitch;
+  framebuffer->bpp = surface->format->BytesPerPixel;
+  framebuffer->width = surface->w;
+  framebuffer->height = surface->h;
+  mof_Framebuffer__kernels(framebuffer, surface->format);
+}
+
+/**
+ * Unlock the surface.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ */
+void mof_Framebuffer__unlock(mof_Framebuffer *framebuffer)
+{
+  /* check if we have a valid mof_Framebuffer object */
+  mof_Framebuffer__check(framebuffer);
+
+  if (SDL_MUSTLOCK(framebuffer->surface))
+	SDL_UnlockSurface(framebuffer->surface);
+
+  framebuffer->surface = NULL;
+  framebuffer->pixels = NULL;
+}
+
+/**
+ * View of a rectangle of the locked surface.
+ * 
+ * The view share the pixels of the framebuffer, coordinates in the view
+ * start at the corner of the rectangle and everything drawn is clipped to
+ * it.  The view must not be used once the framebuffer is unlocked.
+ * 
+ * @param view        Pointer to the mof_Framebuffer to set (not locked).
+ * @param framebuffer Pointer to a mof_Framebuffer object (locked).
+ * @param x           Coordinate of the rectangle.
+ * @param y           Coordinate of the rectangle.
+ * @param width       Width of the rectangle.
+ * @param height      Height of the rectangle.
+ */
+void mof_Framebuffer__view(mof_Framebuffer *view, mof_Framebuffer *framebuffer, int x, int y, int width, int height)
+{
+  view->type = MOF_FRAMEBUFFER_TYPE;
+  
+  if (x + width > framebuffer->width)
+	width = framebuffer->width - x;
+  if (y + height > framebuffer->height)
+	height = framebuffer->height - y;
+  
+  view->surface = framebuffer->surface;
+  view->pixels = framebuffer->pixels + y * framebuffer->pitch + x * framebuffer->bpp;
+  view->pitch = framebuffer->pitch;
+  view->bpp = framebuffer->bpp;
+  view->width = width;
+  view->height = height;
+  view->fill = framebuffer->fill;
+  view->blend = framebuffer->blend;
+  view->kernels = framebuffer->kernels;
+}
+
+/**
+ * Color in the pixel format of the locked surface.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param red         Color.
+ * @param green       Color.
+ * @param blue        Color.
+ * @return            Pixel value.
+ */
+Uint32 mof_Framebuffer__color(mof_Framebuffer *framebuffer, Uint8 red, Uint8 green, Uint8 blue)
+{
+  return SDL_MapRGB(framebuffer->surface->format, red, green, blue);
+}
+
+/**
+ * Write a vertical span.
+ * 
+ * The span is clipped to the surface, both ends are included.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param x           Column of the span.
+ * @param top         First line of the span.
+ * @param bottom      Last line of the span.
+ * @param color       Pixel value (see mof_Framebuffer__color).
+ */
+void mof_Framebuffer__vspan(mof_Framebuffer *framebuffer, int x, int top, int bottom, Uint32 color)
+{
+  if (x < 0 || x >= framebuffer->width)
+	return;
+  if (top < 0)
+	top = 0;
+  if (bottom >= framebuffer->height)
+	bottom = framebuffer->height - 1;
+  if (top > bottom)
+	return;
+
+  int pitch = framebuffer->pitch;
+  int count = bottom - top + 1;
+  Uint8 *pixel = framebuffer->pixels + top * pitch + x * framebuffer->bpp;
+
+  switch (framebuffer->bpp)
+  {
+	case 1:
+	  for (; count > 0; count--, pixel += pitch)
+		*pixel = (Uint8)color;
+	  break;
+
+	case 2:
+	  for (; count > 0; count--, pixel += pitch)
+		*(Uint16 *)pixel = (Uint16)color;
+	  break;
+
+	case 3:
+	  for (; count > 0; count--, pixel += pitch)
+	  {
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+		pixel[0] = (color >> 16) & 0xff;
+		pixel[1] = (color >> 8) & 0xff;
+		pixel[2] = color & 0xff;
+#else
+		pixel[0] = color & 0xff;
+		pixel[1] = (color >> 8) & 0xff;
+		pixel[2] = (color >> 16) & 0xff;
+#endif
+	  }
+	  break;
+
+	case 4:
+	  for (; count > 0; count--, pixel += pitch)
+		*(Uint32 *)pixel = color;
+	  break;
+  }
+}
+
+/**
+ * Write a vertical span sampled from a column of texels.
+ * 
+ * The texture coordinate is in fixed-point (16.16) and advance by a
+ * constant step every line, the span is clipped to the surface.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param x           Column of the span.
+ * @param top         First line of the span.
+ * @param bottom      Last line of the span.
+ * @param texels      Column of texels (in the pixel format of the surface).
+ * @param size        Number of texels in the column (power of two).
+ * @param v           Texture coordinate of the first line (16.16).
+ * @param step        Texture coordinate step per line (16.16).
+ */
+void mof_Framebuffer__vtexture(mof_Framebuffer *framebuffer, int x, int top, int bottom, const Uint32 *texels, int size, Uint32 v, Uint32 step)
+{
+  if (x < 0 || x >= framebuffer->width)
+	return;
+  if (top < 0)
+  {
+	v += (Uint32)(-top) * step;
+	top = 0;
+  }
+  if (bottom >= framebuffer->height)
+	bottom = framebuffer->height - 1;
+  if (top > bottom)
+	return;
+
+  int pitch = framebuffer->pitch;
+  int count = bottom - top + 1;
+  Uint32 mask = size - 1;
+  Uint32 color;
+  Uint8 *pixel = framebuffer->pixels + top * pitch + x * framebuffer->bpp;
+
+  switch (framebuffer->bpp)
+  {
+	case 1:
+	  for (; count > 0; count--, pixel += pitch, v += step)
+		*pixel = (Uint8)texels[(v >> 16) & mask];
+	  break;
+
+	case 2:
+	  for (; count > 0; count--, pixel += pitch, v += step)
+		*(Uint16 *)pixel = (Uint16)texels[(v >> 16) & mask];
+	  break;
+
+	case 3:
+	  for (; count > 0; count--, pixel += pitch, v += step)
+	  {
+		color = texels[(v >> 16) & mask];
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+		pixel[0] = (color >> 16) & 0xff;
+		pixel[1] = (color >> 8) & 0xff;
+		pixel[2] = color & 0xff;
+#else
+		pixel[0] = color & 0xff;
+		pixel[1] = (color >> 8) & 0xff;
+		pixel[2] = (color >> 16) & 0xff;
+#endif
+	  }
+	  break;
+
+	case 4:
+	  for (; count > 0; count--, pixel += pitch, v += step)
+		*(Uint32 *)pixel = texels[(v >> 16) & mask];
+	  break;
+  }
+}
+
+/**
+ * Write a horizontal span.
+ * 
+ * The span is clipped to the surface, both ends are included.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param y           Line of the span.
+ * @param left        First column of the span.
+ * @param right       Last column of the span.
+ * @param color       Pixel value (see mof_Framebuffer__color).
+ */
+void mof_Framebuffer__hspan(mof_Framebuffer *framebuffer, int y, int left, int right, Uint32 color)
+{
+  if (y < 0 || y >= framebuffer->height)
+	return;
+  if (left < 0)
+	left = 0;
+  if (right >= framebuffer->width)
+	right = framebuffer->width - 1;
+  if (left > right)
+	return;
+
+  framebuffer->fill(framebuffer->pixels + y * framebuffer->pitch + left * framebuffer->bpp, right - left + 1, color);
+}
+
+/**
+ * Write a horizontal span blended over the surface.
+ * 
+ * The span is clipped to the surface, both ends are included.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param y           Line of the span.
+ * @param left        First column of the span.
+ * @param right       Last column of the span.
+ * @param color       Pixel value (see mof_Framebuffer__color).
+ * @param alpha       Opacity of the span (0 to 255).
+ */
+void mof_Framebuffer__hblend(mof_Framebuffer *framebuffer, int y, int left, int right, Uint32 color, Uint8 alpha)
+{
+  if (y < 0 || y >= framebuffer->height)
+	return;
+  if (left < 0)
+	left = 0;
+  if (right >= framebuffer->width)
+	right = framebuffer->width - 1;
+  if (left > right)
+	return;
+
+  framebuffer->blend(framebuffer->pixels + y * framebuffer->pitch + left * framebuffer->bpp, right - left + 1, color, alpha, 
+					 framebuffer->surface->format);
+}
+
+/**
+ * Write a rectangle, blended over the surface if not opaque.
+ * 
+ * The rectangle is clipped to the surface, both corners are included.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param left        First column of the rectangle.
+ * @param top         First line of the rectangle.
+ * @param right       Last column of the rectangle.
+ * @param bottom      Last line of the rectangle.
+ * @param color       Pixel value (see mof_Framebuffer__color).
+ * @param alpha       Opacity of the rectangle (0 to 255).
+ */
+void mof_Framebuffer__rect(mof_Framebuffer *framebuffer, int left, int top, int right, int bottom, Uint32 color, Uint8 alpha)
+{
+  if (left < 0)
+	left = 0;
+  if (top < 0)
+	top = 0;
+  if (right >= framebuffer->width)
+	right = framebuffer->width - 1;
+  if (bottom >= framebuffer->height)
+	bottom = framebuffer->height - 1;
+  if (left > right || alpha == 0)
+	return;
+
+  int count = right - left + 1;
+  Uint8 *pixel = framebuffer->pixels + top * framebuffer->pitch + left * framebuffer->bpp;
+
+  for (; top <= bottom; top++, pixel += framebuffer->pitch)
+  {
+	if (alpha == 255)
+	  framebuffer->fill(pixel, count, color);
+	else
+	  framebuffer->blend(pixel, count, color, alpha, framebuffer->surface->format);
+  }
+}
+
+/**
+ * Draw a box on a surface (same as boxRGBA of SDL_gfx).
+ * 
+ * The surface is locked for the box only, the box is clipped to the clip
+ * rectangle of the surface and can be given from any corner.
+ * 
+ * @param surface Surface to draw on (not locked).
+ * @param x1      Coordinate of a corner.
+ * @param y1      Coordinate of a corner.
+ * @param x2      Coordinate of the opposite corner.
+ * @param y2      Coordinate of the opposite corner.
+ * @param red     Color.
+ * @param green   Color.
+ * @param blue    Color.
+ * @param alpha   Opacity (0 to 255).
+ */
+void mof_Framebuffer__box(SDL_Surface *surface, int x1, int y1, int x2, int y2, Uint8 red, Uint8 green, Uint8 blue, Uint8 alpha)
+{
+  mof_Framebuffer framebuffer;
+  SDL_Rect *clip = &surface->clip_rect;
+  int left = (x1 < x2) ? x1 : x2, right = (x1 < x2) ? x2 : x1;
+  int top = (y1 < y2) ? y1 : y2, bottom = (y1 < y2) ? y2 : y1;
+
+  if (left < clip->x)
+	left = clip->x;
+  if (top < clip->y)
+	top = clip->y;
+  if (right >= clip->x + clip->w)
+	right = clip->x + clip->w - 1;
+  if (bottom >= clip->y + clip->h)
+	bottom = clip->y + clip->h - 1;
+  if (left > right || top > bottom)
+	return;
+
+  framebuffer.type = MOF_FRAMEBUFFER_TYPE;
+  mof_Framebuffer__lock(&framebuffer, surface);
+  mof_Framebuffer__rect(&framebuffer, left, top, right, bottom, SDL_MapRGBA(surface->format, red, green, blue, alpha), alpha);
+  mof_Framebuffer__unlock(&framebuffer);
+}
+
+/**
+ * Write a vertical span sampled from a column of texels, with holes.
+ * 
+ * Same as mof_Framebuffer__vtexture, except the texels of the transparent
+ * color are not written (sprites).
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param x           Column of the span.
+ * @param top         First line of the span.
+ * @param bottom      Last line of the span.
+ * @param texels      Column of texels (in the pixel format of the surface).
+ * @param size        Number of texels in the column (power of two).
+ * @param v           Texture coordinate of the first line (16.16).
+ * @param step        Texture coordinate step per line (16.16).
+ * @param key         Transparent color (pixel value).
+ */
+void mof_Framebuffer__vsprite(mof_Framebuffer *framebuffer, int x, int top, int bottom, const Uint32 *texels, int size, Uint32 v, Uint32 step, Uint32 key)
+{
+  if (x < 0 || x >= framebuffer->width)
+	return;
+  if (top < 0)
+  {
+	v += (Uint32)(-top) * step;
+	top = 0;
+  }
+  if (bottom >= framebuffer->height)
+	bottom = framebuffer->height - 1;
+  if (top > bottom)
+	return;
+
+  int pitch = framebuffer->pitch;
+  int count = bottom - top + 1;
+  Uint32 mask = size - 1;
+  Uint32 color;
+  Uint8 *pixel = framebuffer->pixels + top * pitch + x * framebuffer->bpp;
+
+  for (; count > 0; count--, pixel += pitch, v += step)
+  {
+	color = texels[(v >> 16) & mask];
+	if (color == key)
+	  continue;
+
+	switch (framebuffer->bpp)
+	{
+	  case 1:
+		*pixel = (Uint8)color;
+		break;
+
+	  case 2:
+		*(Uint16 *)pixel = (Uint16)color;
+		break;
+
+	  case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+		pixel[0] = (color >> 16) & 0xff;
+		pixel[1] = (color >> 8) & 0xff;
+		pixel[2] = color & 0xff;
+#else
+		pixel[0] = color & 0xff;
+		pixel[1] = (color >> 8) & 0xff;
+		pixel[2] = (color >> 16) & 0xff;
+#endif
+		break;
+
+	  case 4:
+		*(Uint32 *)pixel = color;
+		break;
+	}
+  }
+}
+
+#ifdef MOF_FRAMEBUFFER_SIMD
+
+/**
+ * Write a horizontal textured span on a 32 bits surface (SSE2).
+ * 
+ * Four texel indexes are computed at once from the fixed-point texture
+ * coordinates, the texels themselves are read one by one.
+ * 
+ * @param pixel  First pixel of the span.
+ * @param count  Number of pixels.
+ * @param texels Texels (column-major, in the pixel format of the surface).
+ * @param shift  Log2 of the dimension of the texture.
+ * @param u      Texture coordinates of the first pixel (16.16).
+ * @param v      Texture coordinates of the first pixel (16.16).
+ * @param stepU  Texture coordinates step per pixel (16.16).
+ * @param stepV  Texture coordinates step per pixel (16.16).
+ */
+__attribute__((target("sse2")))
+void mof_Framebuffer__htexture4(Uint32 *pixel, int count, const Uint32 *texels, int shift, Uint32 u, Uint32 v, Uint32 stepU, Uint32 stepV)
+{
+  Uint32 index[4];
+  int i;
+  __m128i mask = _mm_set1_epi32((1 << shift) - 1);
+  __m128i U, V;
+  __m128i stepU4 = _mm_set1_epi32(stepU * 4);
+  __m128i stepV4 = _mm_set1_epi32(stepV * 4);
+  
+  /* lanes start one step apart */
+  U = _mm_set_epi32(u + stepU * 3, u + stepU * 2, u + stepU, u);
+  V = _mm_set_epi32(v + stepV * 3, v + stepV * 2, v + stepV, v);
+  
+  for (; count >= 4; count -= 4, pixel += 4)
+  {
+	_mm_storeu_si128((__m128i *)index, _mm_or_si128(_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(U, 16), mask), shift),
+													_mm_and_si128(_mm_srli_epi32(V, 16), mask)));
+	_mm_storeu_si128((__m128i *)pixel, _mm_set_epi32(texels[index[3]], texels[index[2]], texels[index[1]], texels[index[0]]));
+	U = _mm_add_epi32(U, stepU4);
+	V = _mm_add_epi32(V, stepV4);
+  }
+  
+  _mm_storeu_si128((__m128i *)index, _mm_or_si128(_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(U, 16), mask), shift),
+												  _mm_and_si128(_mm_srli_epi32(V, 16), mask)));
+  for (i = 0; i < count; i++)
+  {
+	pixel[i] = texels[index[i]];
+  }
+}
+
+#endif
+
+/**
+ * Write a horizontal span sampled from a texture.
+ * 
+ * The texture coordinates are in fixed-point (16.16) and wrap around the
+ * texture, the span is clipped to the surface.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object.
+ * @param y           Line of the span.
+ * @param left        First column of the span.
+ * @param right       Last column of the span.
+ * @param texels      Texels (column-major, in the pixel format of the surface).
+ * @param size        Dimension of the texture (power of two).
+ * @param u           Texture coordinates of the first column (16.16).
+ * @param v           Texture coordinates of the first column (16.16).
+ * @param stepU       Texture coordinates step per column (16.16).
+ * @param stepV       Texture coordinates step per column (16.16).
+ */
+void mof_Framebuffer__htexture(mof_Framebuffer *framebuffer, int y, int left, int right, const Uint32 *texels, int size, 
+							  Uint32 u, Uint32 v, Uint32 stepU, Uint32 stepV)
+{
+  if (y < 0 || y >= framebuffer->height)
+	return;
+  if (left < 0)
+  {
+	u += (Uint32)(-left) * stepU;
+	v += (Uint32)(-left) * stepV;
+	left = 0;
+  }
+  if (right >= framebuffer->width)
+	right = framebuffer->width - 1;
+  if (left > right)
+	return;
+
+  int shift = 0;
+  while ((1 << shift) < size)
+	shift++;
+
+  int count = right - left + 1;
+  Uint32 mask = size - 1;
+  Uint32 color;
+  Uint8 *pixel = framebuffer->pixels + y * framebuffer->pitch + left * framebuffer->bpp;
+
+#ifdef MOF_FRAMEBUFFER_SIMD
+  if (framebuffer->bpp == 4 && __builtin_cpu_supports("sse2"))
+  {
+	mof_Framebuffer__htexture4((Uint32 *)pixel, count, texels, shift, u, v, stepU, stepV);
+	return;
+  }
+#endif
+
+  for (; count > 0; count--, pixel += framebuffer->bpp, u += stepU, v += stepV)
+  {
+	color = texels[(((u >> 16) & mask) << shift) | ((v >> 16) & mask)];
+	switch (framebuffer->bpp)
+	{
+	  case 1:
+		*pixel = (Uint8)color;
+		break;
+
+	  case 2:
+		*(Uint16 *)pixel = (Uint16)color;
+		break;
+
+	  case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+		pixel[0] = (color >> 16) & 0xff;
+		pixel[1] = (color >> 8) & 0xff;
+		pixel[2] = color & 0xff;
+#else
+		pixel[0] = color & 0xff;
+		pixel[1] = (color >> 8) & 0xff;
+		pixel[2] = (color >> 16) & 0xff;
+#endif
+		break;
+
+	  case 4:
+		*(Uint32 *)pixel = color;
+		break;
+	}
+  }
+}
+
+#endif
@@ -1,104 +1,172 @@
 /**
  * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
- * @version 1.10
- * @since 2012-02-08 
+ * @version 3.33
+ * @since 2012-02-08
  * 
- * This class work just like a graphic pipeline.  Graphic elements are added
- * to a double linked list which is use for the final rendering of the scene.
- * Each element added to the list get the "Z-buffering" treatment, which means
- * that the objects farther are drawn first while the objects nearer are drawn 
- * last thus giving us the correct perspective.
+ * This class work just like a graphic pipeline.  Graphic elements are
+ * appended to an array which is use for the final rendering of the scene.
+ * Elements are small typed commands (rectangle, solid span, textured column,
+ * sprite column and text run) with packed RGBA colors; when rendering, runs
+ * of commands of the same type are drawn by the same loop.
+ * Before rendering, the array get the "Z-buffering" treatment, which means
+ * that the objects farther are drawn first while the objects nearer are drawn
+ * last thus giving us the correct perspective.  The array is sorted once per
+ * frame: elements appended already in order (runs) are merged, otherwise a
+ * radix sort is done on the Z index.  Both sorts are stable, elements of the
+ * same Z index are drawn in the order they were added.  Everything is
+ * allocated in a mof_Arena reset after the render, frames only touch the heap
+ * while the arena grow.
+ * Given a mof_Threadpool, the elements are rendered in tiles instead: every
+ * element is binned into the tiles of the screen it cover (in order, so
+ * every tile keep the Z order), then the tiles are drawn in parallel, each
+ * one clipping the elements to itself.  Text is still drawn by SDL, between
+ * the batches of tiles.
+ * With the occlusion on, the elements between two runs of text (or of a
+ * tile) are taken front to back instead: every column keep the spans of
+ * lines already covered by opaque elements (rectangles, solid spans and
+ * textured columns) and only the pieces of the elements left uncovered are
+ * drawn.  Sprites and translucent rectangles are clipped the same way, but
+ * drawn back to front over the opaque pieces once the batch is done.  It
+ * only pays off on scenes with a lot of overdraw (layers of walls), so the
+ * batches with few textured columns are still drawn back to front, and it
+ * is off by default.  The pixels written by the last render are counted
+ * (overdraw).
  */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include "SDL.h"
-#include "SDL_gfxPrimitives.h"
+
+#include "mof_arena.h"
+#include "mof_font.h"
+#include "mof_framebuffer.h"
+#include "mof_threadpool.h"
 
 #ifndef MOF_GRAPHICELEMENT_H_
 #define MOF_GRAPHICELEMENT_H_
 
 #define MOF_GRAPHICELEMENT_TYPE (1<<7)		/* dynamic type checking */
+#define MOF_GRAPHICELEMENT_CAPACITY 256		/* elements before the first growth */
+#define MOF_GRAPHICELEMENT_RUNS 16			/* most runs merged instead of sorted */
+#define MOF_GRAPHICELEMENT_TILE 64			/* dimension of the tiles (pixels) */
+#define MOF_GRAPHICELEMENT_COVERAGE 8		/* most covered spans per column (occlusion) */
+#define MOF_GRAPHICELEMENT_PIECES 512		/* most pieces drawn after the opaque ones, per tile */
+#define MOF_GRAPHICELEMENT_LIMIT 16383		/* coordinates are clamped to +/- this (Sint16) */
+#define MOF_GRAPHICELEMENT_LAYERS 1.5		/* textured columns per pixel a batch need to be occluded */
+
+#define MOF_GRAPHICELEMENT_RECT 0			/* type of the commands */
+#define MOF_GRAPHICELEMENT_SPAN 1
+#define MOF_GRAPHICELEMENT_COLUMN 2
+#define MOF_GRAPHICELEMENT_SPRITE 3
+#define MOF_GRAPHICELEMENT_TEXT 4
+
+/* packed color (0xRRGGBBAA) */
+#define MOF_GRAPHICELEMENT_RGBA(red, green, blue, alpha) \
+  (((Uint32)(red) << 24) | ((Uint32)(green) << 16) | ((Uint32)(blue) << 8) | (Uint32)(alpha))
+
+/**
+ * Graphic element (one command of the scene, 32 bytes).
+ * 
+ * Rectangles are (x, y) to (x + width, y + height) included, spans (x, y) to
+ * (x + width, y).  Columns and sprite columns go from y to y + height in
+ * column x, texels sampled at v (16.16) advancing by step every line.  Both
+ * corners are kept within MOF_GRAPHICELEMENT_LIMIT, so the width and height
+ * always fit.
+ */
+typedef struct {
+  Uint8 kind;						/* MOF_GRAPHICELEMENT_* type */
+  Sint16 x;
+  Sint16 y;
+  Sint16 width;
+  Sint16 height;
+  Uint16 size;						/* number of texels in the column (power of two) */
+  Uint32 color;						/* packed RGBA, or transparent pixel value of a sprite */
+  Uint32 v;
+  Uint32 step;
+  const void *data;					/* texels, or mof_Graphicelementtext in the arena */
+} mof_Graphicelementitem;
+
+/**
+ * Piece of an element left uncovered by the nearer elements (occlusion).
+ */
+typedef struct {
+  mof_Graphicelementitem *element;
+  Uint32 pixel;						/* pixel value of the color of a rectangle or span */
+  int left;							/* columns and lines of the piece (included) */
+  int top;
+  int right;
+  int bottom;
+} mof_Graphicelementpiece;
+
+/**
+ * Text of a text run (allocated in the arena).
+ */
+typedef struct {
+  mof_Font *font;
+  char text[1];						/* as long as needed */
+} mof_Graphicelementtext;
 
 /**
  * mof_Graphicelement class.
- */ 
-typedef struct mof_GraphicelementList {
+ */
+typedef struct {
   unsigned int type;
-  double zIndex;
-  int x;
-  int y;
-  int width;
-  int height;
-  int red;
-  int green;
-  int blue;
-  int alpha;
-  struct mof_GraphicelementList *first;
-  struct mof_GraphicelementList *last;
-  struct mof_GraphicelementList *current;
-  struct mof_GraphicelementList *previous;
-  struct mof_GraphicelementList *next;
+  int count;						/* number of elements added */
+  int capacity;						/* elements the array have room for (kept between frames) */
+  mof_Graphicelementitem *elements;	/* in the order added, sorted by the render */
+  float *depths;					/* Z index of every element */
+  mof_Arena *arena;					/* memory of the frame */
+  mof_Framebuffer *framebuffer;		/* pixels of the surface while rendering */
+  mof_Threadpool *pool;				/* NULL to render without tiles */
+  int tilesX;						/* tiles of the surface rendered */
+  int tilesY;
+  int *bins;						/* first binned element of every tile, then the total */
+  int *binned;						/* elements of every tile, in order */
+  int occlusion;					/* draw front to back, skipping the pixels covered */
+  long written;						/* pixels written by the last render */
+  long *writes;						/* pixels written in every tile */
 } mof_Graphicelement;
 
 /**
  * Constructor.
- *  
+ * 
  * @param graphicelement Pointer to a mof_Graphicelement object.
- * @param z				 Z index for Z-buffering.
- * @param x              Coordinate of graphic element.
- * @param y              Coordinate of graphic element.
- * @param width          Width of graphic element.
- * @param height         Height of graphic element.
- * @param red			 Color of graphic element.
- * @param green			 Color of graphic element.
- * @param blue			 Color of graphic element.
- * @param alpha			 Color of graphic element.
- */
-void mof_Graphicelement__construct(mof_Graphicelement *graphicelement, double z, int x, int y, int width, int height, int red, int green, int blue, int alpha)
+ */
+void mof_Graphicelement__construct(mof_Graphicelement *graphicelement)
 {
   /* here OR the MOF_GRAPHICELEMENT_TYPE constant into the type */
   graphicelement->type |= MOF_GRAPHICELEMENT_TYPE;
-  
-  graphicelement->zIndex = z;
-  graphicelement->x = x;
-  graphicelement->y = y;
-  graphicelement->width = width;
-  graphicelement->height = height;
-  graphicelement->red = red;
-  graphicelement->green = green;
-  graphicelement->blue = blue;
-  graphicelement->alpha = alpha;
+
+  graphicelement->count = 0;
+  graphicelement->capacity = MOF_GRAPHICELEMENT_CAPACITY;
+  graphicelement->elements = NULL;
+  graphicelement->depths = NULL;
+  graphicelement->arena = mof_Arena__new(MOF_GRAPHICELEMENT_CAPACITY * (sizeof(mof_Graphicelementitem) * 2 + sizeof(float) + sizeof(Uint64) * 2));
+  graphicelement->framebuffer = mof_Framebuffer__new();
+  graphicelement->pool = NULL;
+  graphicelement->tilesX = 0;
+  graphicelement->tilesY = 0;
+  graphicelement->bins = NULL;
+  graphicelement->binned = NULL;
+  graphicelement->occlusion = 0;
+  graphicelement->written = 0;
+  graphicelement->writes = NULL;
 }
 
 /**
  * New.
  * 
- * @param z		 Z index for Z-buffering.
- * @param x      Coordinate of graphic element.
- * @param y      Coordinate of graphic element.
- * @param width  Width of graphic element.
- * @param height Height of graphic element.
- * @param red	 Color of graphic element.
- * @param green	 Color of graphic element.
- * @param blue	 Color of graphic element.
- * @param alpha	 Color of graphic element.
- * @return       An object mof_Graphicelement.
- */
-mof_Graphicelement *mof_Graphicelement__new(double z, int x, int y, int width, int height, int red, int green, int blue, int alpha) 
-{	
+ * @return An object mof_Graphicelement.
+ */
+mof_Graphicelement *mof_Graphicelement__new()
+{
   mof_Graphicelement *graphicelement = malloc(sizeof(mof_Graphicelement));
   graphicelement->type = MOF_GRAPHICELEMENT_TYPE;
-  
+
   /* call the constructor */
-  mof_Graphicelement__construct(graphicelement, z, x, y, width, height, red, green, blue, alpha);
-  
-  /* set pointer for previous and next element */
-  graphicelement->first = graphicelement;
-  graphicelement->last = graphicelement;
-  graphicelement->current = graphicelement;
-  graphicelement->previous = NULL;
-  graphicelement->next = NULL;
-  
+  mof_Graphicelement__construct(graphicelement);
+
   return graphicelement;
 }
 
@@ -113,7 +181,7 @@ mof_Graphicelement *mof_Graphicelement__new(double z, int x, int y, int width, i
 void mof_Graphicelement__check(mof_Graphicelement *graphicelement)
 {
   /* check if we have a valid mof_Graphicelement object */
-  if (graphicelement == NULL || 
+  if (graphicelement == NULL ||
 	  !(graphicelement->type & MOF_GRAPHICELEMENT_TYPE))
   {
 	assert(0);
@@ -124,7 +192,7 @@ void mof_Graphicelement__check(mof_Graphicelement *graphicelement)
  * Destructor.
  * 
  * @param graphicelement Pointer to a mof_Graphicelement object.
- */ 
+ */
 void mof_Graphicelement__destroy(mof_Graphicelement *graphicelement)
 {
   /* check if we have a valid mof_Graphicelement object */
@@ -134,137 +202,1162 @@ void mof_Graphicelement__destroy(mof_Graphicelement *graphicelement)
   graphicelement->type = 0;
 
   /* free the memory allocated for the object */
-  mof_Graphicelement *fst = graphicelement->first;
-  mof_Graphicelement *bkup = graphicelement->first;
-  mof_Graphicelement *cur = NULL;
-  for (cur = fst; cur != NULL; cur = bkup)
+  mof_Arena__destroy(graphicelement->arena);
+  mof_Framebuffer__destroy(graphicelement->framebuffer);
+  free(graphicelement);
+}
+
+/**
+ * Clamp a coordinate of an element.
+ * 
+ * @param value Coordinate (pixels).
+ * @return      Coordinate within +/- MOF_GRAPHICELEMENT_LIMIT.
+ */
+int mof_Graphicelement__clamp(long value)
+{
+  if (value < -MOF_GRAPHICELEMENT_LIMIT)
+	return -MOF_GRAPHICELEMENT_LIMIT;
+  if (value > MOF_GRAPHICELEMENT_LIMIT)
+	return MOF_GRAPHICELEMENT_LIMIT;
+  return (int)value;
+}
+
+/**
+ * Append a graphic element.
+ * 
+ * The element only get its place when the elements are sorted.
+ * 
+ * @param master Pointer to a mof_Graphicelement object.
+ * @param z      Z index for Z-buffering.
+ * @param kind   Type of the command (MOF_GRAPHICELEMENT_*).
+ * @return       Pointer to the element to fill.
+ */
+mof_Graphicelementitem *mof_Graphicelement__push(mof_Graphicelement *master, double z, int kind)
+{
+  /* check if we have a valid mof_Graphicelement object */
+  mof_Graphicelement__check(master);
+
+  mof_Graphicelementitem *grown;
+  float *depths;
+
+  /* first element of the frame, as many as the previous frame had room for */
+  if (master->elements == NULL)
+  {
+	master->elements = mof_Arena__alloc(master->arena, master->capacity * sizeof(mof_Graphicelementitem));
+	master->depths = mof_Arena__alloc(master->arena, master->capacity * sizeof(float));
+  }
+
+  if (master->count == master->capacity)
   {
-	bkup = cur->next;
-	free(cur);
+	/* the previous arrays stay in the arena until the reset */
+	master->capacity *= 2;
+	grown = mof_Arena__alloc(master->arena, master->capacity * sizeof(mof_Graphicelementitem));
+	memcpy(grown, master->elements, master->count * sizeof(mof_Graphicelementitem));
+	master->elements = grown;
+	depths = mof_Arena__alloc(master->arena, master->capacity * sizeof(float));
+	memcpy(depths, master->depths, master->count * sizeof(float));
+	master->depths = depths;
   }
+
+  master->depths[master->count] = (float)z;
+  master->elements[master->count].kind = kind;
+  return master->elements + master->count++;
 }
 
 /**
- * Add a graphic element.
+ * Add a rectangle.
  * 
- * Add a graphic element to the list already existing.  Only the master
- * (the first created graphic element) can access this list.
+ * @param master Pointer to a mof_Graphicelement object.
+ * @param z      Z index for Z-buffering.
+ * @param x      Coordinate of the rectangle.
+ * @param y      Coordinate of the rectangle.
+ * @param width  Width of the rectangle.
+ * @param height Height of the rectangle.
+ * @param color  Packed color (see MOF_GRAPHICELEMENT_RGBA), blended if not opaque.
+ */
+void mof_Graphicelement__rect(mof_Graphicelement *master, double z, int x, int y, int width, int height, Uint32 color)
+{
+  mof_Graphicelementitem *element = mof_Graphicelement__push(master, z, MOF_GRAPHICELEMENT_RECT);
+  int right = mof_Graphicelement__clamp((long)x + width), bottom = mof_Graphicelement__clamp((long)y + height);
+
+  element->x = mof_Graphicelement__clamp(x);
+  element->y = mof_Graphicelement__clamp(y);
+  element->width = right - element->x;
+  element->height = bottom - element->y;
+  element->color = color;
+}
+
+/**
+ * Add a solid horizontal span.
  * 
  * @param master Pointer to a mof_Graphicelement object.
- * @param z		 Z index for Z-buffering.
- * @param x      Coordinate of graphic element.
- * @param y      Coordinate of graphic element.
- * @param width  Width of graphic element.
- * @param height Height of graphic element.
- * @param red	 Color of graphic element.
- * @param green	 Color of graphic element.
- * @param blue	 Color of graphic element.
- * @param alpha	 Color of graphic element.
- */
-void mof_Graphicelement__add(mof_Graphicelement *master, double z, int x, int y, int width, int height, int red, int green, int blue, int alpha)
+ * @param z      Z index for Z-buffering.
+ * @param x      First column of the span.
+ * @param y      Line of the span.
+ * @param width  Length of the span (minus one).
+ * @param color  Packed color (see MOF_GRAPHICELEMENT_RGBA), alpha ignored.
+ */
+void mof_Graphicelement__span(mof_Graphicelement *master, double z, int x, int y, int width, Uint32 color)
+{
+  mof_Graphicelementitem *element = mof_Graphicelement__push(master, z, MOF_GRAPHICELEMENT_SPAN);
+  int right = mof_Graphicelement__clamp((long)x + width);
+
+  element->x = mof_Graphicelement__clamp(x);
+  element->y = mof_Graphicelement__clamp(y);
+  element->width = right - element->x;
+  element->height = 0;
+  element->color = color;
+}
+
+/**
+ * Add a textured column.
+ * 
+ * @param master Pointer to a mof_Graphicelement object.
+ * @param z      Z index for Z-buffering.
+ * @param x      Column.
+ * @param top    First line of the column.
+ * @param bottom Last line of the column.
+ * @param texels Column of texels (in the pixel format of the surface).
+ * @param size   Number of texels in the column (power of two).
+ * @param v      Texture coordinate of the first line (16.16).
+ * @param step   Texture coordinate step per line (16.16).
+ */
+void mof_Graphicelement__column(mof_Graphicelement *master, double z, int x, int top, int bottom, const Uint32 *texels, int size, Uint32 v, Uint32 step)
+{
+  mof_Graphicelementitem *element = mof_Graphicelement__push(master, z, MOF_GRAPHICELEMENT_COLUMN);
+
+  /* the lines cut above start further in the texture */
+  if (top < -MOF_GRAPHICELEMENT_LIMIT)
+	v += step * (Uint32)(-MOF_GRAPHICELEMENT_LIMIT - top);
+  top = mof_Graphicelement__clamp(top);
+  bottom = mof_Graphicelement__clamp(bottom);
+
+  element->x = mof_Graphicelement__clamp(x);
+  element->y = top;
+  element->width = 0;
+  element->height = bottom - top;
+  element->size = size;
+  element->v = v;
+  element->step = step;
+  element->data = texels;
+}
+
+/**
+ * Add a column of a scaled sprite.
+ * 
+ * Same as mof_Graphicelement__column, the texels of the transparent color
+ * are not drawn.
+ * 
+ * @param master Pointer to a mof_Graphicelement object.
+ * @param z      Z index for Z-buffering.
+ * @param x      Column.
+ * @param top    First line of the column.
+ * @param bottom Last line of the column.
+ * @param texels Column of texels (in the pixel format of the surface).
+ * @param size   Number of texels in the column (power of two).
+ * @param v      Texture coordinate of the first line (16.16).
+ * @param step   Texture coordinate step per line (16.16).
+ * @param key    Transparent color (pixel value).
+ */
+void mof_Graphicelement__sprite(mof_Graphicelement *master, double z, int x, int top, int bottom, const Uint32 *texels, int size, 
+								Uint32 v, Uint32 step, Uint32 key)
+{
+  mof_Graphicelementitem *element = mof_Graphicelement__push(master, z, MOF_GRAPHICELEMENT_SPRITE);
+
+  /* the lines cut above start further in the texture */
+  if (top < -MOF_GRAPHICELEMENT_LIMIT)
+	v += step * (Uint32)(-MOF_GRAPHICELEMENT_LIMIT - top);
+  top = mof_Graphicelement__clamp(top);
+  bottom = mof_Graphicelement__clamp(bottom);
+
+  element->x = mof_Graphicelement__clamp(x);
+  element->y = top;
+  element->width = 0;
+  element->height = bottom - top;
+  element->size = size;
+  element->color = key;
+  element->v = v;
+  element->step = step;
+  element->data = texels;
+}
+
+/**
+ * Add a text run.
+ * 
+ * The text is copied in the arena.
+ * 
+ * @param master Pointer to a mof_Graphicelement object.
+ * @param z      Z index for Z-buffering.
+ * @param font   Pointer to a mof_Font object.
+ * @param x      Coordinate of the text.
+ * @param y      Coordinate of the text.
+ * @param text   Text to render.
+ * @param color  Packed color (see MOF_GRAPHICELEMENT_RGBA), alpha ignored.
+ */
+void mof_Graphicelement__text(mof_Graphicelement *master, double z, mof_Font *font, int x, int y, const char *text, Uint32 color)
+{
+  mof_Graphicelementitem *element = mof_Graphicelement__push(master, z, MOF_GRAPHICELEMENT_TEXT);
+  mof_Graphicelementtext *run = mof_Arena__alloc(master->arena, sizeof(mof_Graphicelementtext) + strlen(text));
+
+  run->font = font;
+  strcpy(run->text, text);
+  element->x = mof_Graphicelement__clamp(x);
+  element->y = mof_Graphicelement__clamp(y);
+  element->color = color;
+  element->data = run;
+}
+
+/**
+ * Remove every graphic element.
+ * 
+ * The arena is reset, so is everything else allocated in it.
+ * 
+ * @param master Pointer to a mof_Graphicelement object.
+ */
+void mof_Graphicelement__clear(mof_Graphicelement *master)
 {
   /* check if we have a valid mof_Graphicelement object */
   mof_Graphicelement__check(master);
-	
-  mof_Graphicelement *graphicelement = malloc(sizeof(mof_Graphicelement));
-  graphicelement->type = MOF_GRAPHICELEMENT_TYPE;
-  
-  /* call the constructor */
-  mof_Graphicelement__construct(graphicelement, z, x, y, width, height, red, green, blue, alpha);
-  
-  /* do the Z-buffering stuff */
-  master->current = master->first;
-  while((master->current->next) != NULL)
+
+  master->count = 0;
+  master->elements = NULL;
+  master->depths = NULL;
+  mof_Arena__reset(master->arena);
+}
+
+/**
+ * Sort key of a Z index.
+ * 
+ * The bits of the float are flipped so the keys compare as unsigned
+ * integers, then inverted so the farther elements come first.
+ * 
+ * @param z Z index.
+ * @return  Key (ascending order is farther first).
+ */
+Uint32 mof_Graphicelement__key(float z)
+{
+  union { float f; Uint32 u; } bits;
+  bits.f = z;
+
+  bits.u = (bits.u & 0x80000000) ? ~bits.u : (bits.u | 0x80000000);
+  return ~bits.u;
+}
+
+/**
+ * Merge the runs of the keys.
+ * 
+ * Pairs of neighbouring runs are merged until only one is left.
+ * 
+ * @param keys    Keys (sort key then index).
+ * @param scratch Room for as many keys.
+ * @param count   Number of keys.
+ * @param starts  First key of every run, followed by count.
+ * @param runs    Number of runs.
+ * @return        Array holding the sorted keys (keys or scratch).
+ */
+Uint64 *mof_Graphicelement__merge(Uint64 *keys, Uint64 *scratch, int count, int *starts, int runs)
+{
+  int run, merged, i, j, k, middle, end;
+  Uint64 *swap;
+
+  while (runs > 1)
   {
-	if ((master->current->next->zIndex) < z)
+	for (run = 0, merged = 0; run < runs; run += 2, merged++)
 	{
-	  break;
+	  i = k = starts[run];
+	  if (run + 1 == runs)
+	  {
+		/* odd run out, copied as is */
+		memcpy(scratch + i, keys + i, (count - i) * sizeof(Uint64));
+		starts[merged] = i;
+		continue;
+	  }
+
+	  j = middle = starts[run + 1];
+	  end = starts[run + 2];
+	  while (i < middle && j < end)
+	  {
+		scratch[k++] = (keys[j] < keys[i]) ? keys[j++] : keys[i++];
+	  }
+	  while (i < middle)
+	  {
+		scratch[k++] = keys[i++];
+	  }
+	  while (j < end)
+	  {
+		scratch[k++] = keys[j++];
+	  }
+	  starts[merged] = starts[run];
 	}
-	master->current = master->current->next;
+
+	runs = merged;
+	starts[runs] = count;
+	swap = keys;
+	keys = scratch;
+	scratch = swap;
   }
-  
-  /* set pointer for current element */
-  graphicelement->first = NULL;
-  graphicelement->last = NULL;
-  graphicelement->current = NULL;
-  graphicelement->previous = master->current;
-  if (master->current->next != NULL)
+
+  return keys;
+}
+
+/**
+ * Radix sort of the keys.
+ * 
+ * Least significant byte first on the sort key, the passes where every key
+ * have the same byte are skipped.
+ * 
+ * @param keys    Keys (sort key then index).
+ * @param scratch Room for as many keys.
+ * @param count   Number of keys.
+ * @return        Array holding the sorted keys (keys or scratch).
+ */
+Uint64 *mof_Graphicelement__radix(Uint64 *keys, Uint64 *scratch, int count)
+{
+  int histogram[4][256], offset, total, shift, pass, i;
+  Uint64 *swap;
+
+  memset(histogram, 0, sizeof(histogram));
+  for (i = 0; i < count; i++)
   {
-	graphicelement->next = master->current->next;
+	for (pass = 0; pass < 4; pass++)
+	{
+	  histogram[pass][(keys[i] >> (32 + pass * 8)) & 0xff]++;
+	}
   }
-  else 
+
+  for (pass = 0; pass < 4; pass++)
   {
-	graphicelement->next = NULL;
-	master->last = graphicelement;
+	shift = 32 + pass * 8;
+	if (histogram[pass][(keys[0] >> shift) & 0xff] == count)
+	  continue;
+
+	for (total = 0, i = 0; i < 256; i++)
+	{
+	  offset = histogram[pass][i];
+	  histogram[pass][i] = total;
+	  total += offset;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+	  scratch[histogram[pass][(keys[i] >> shift) & 0xff]++] = keys[i];
+	}
+
+	swap = keys;
+	keys = scratch;
+	scratch = swap;
   }
-  
-  /* set pointer for previous element */
-  master->current->next = graphicelement;
-  
-  /* set current pointer to newly created element */
-  master->current = graphicelement;
+
+  return keys;
 }
 
 /**
- * Remove a graphic element.
+ * Sort the graphic elements.
  * 
- * Remove a graphic element to the list already existing (the current one).  
- * Only the master (the first created graphic element) can access this list.
+ * Farther elements first.  Called by the render, only needed to look at
+ * the elements in order before.
  * 
  * @param master Pointer to a mof_Graphicelement object.
  */
-void mof_Graphicelement__remove(mof_Graphicelement *master)
-{ 
+void mof_Graphicelement__sort(mof_Graphicelement *master)
+{
   /* check if we have a valid mof_Graphicelement object */
   mof_Graphicelement__check(master);
-  
-  /* never remove the first element (the master) */
-  if (master->current->previous == NULL) 
-    return;
-  
-  /* set pointer for previous element */
-  master->current->previous->next = master->current->next;
-  
-  /* set pointer for next element*/
-  if (master->current->next != NULL)
-  {
-    master->current->next->previous = master->current->previous;
-  }
-  
-  /* set type to 0 indicate this is no longer a mof_Graphicelement object */
-  master->current->type = 0;
-  
-  /* remove element */
-  mof_Graphicelement *tmp = master->current;
-  mof_Graphicelement *bkup = master->current->previous;
-  free(tmp);
-  master->current = bkup;
+
+  int starts[MOF_GRAPHICELEMENT_RUNS + 1];
+  int i, runs = 1;
+  Uint64 *keys, *scratch;
+  mof_Graphicelementitem *sorted;
+
+  if (master->count < 2)
+	return;
+
+  keys = mof_Arena__alloc(master->arena, master->count * sizeof(Uint64));
+
+  /* the index make every key unique, so both sorts are stable */
+  starts[0] = 0;
+  for (i = 0; i < master->count; i++)
+  {
+	keys[i] = ((Uint64)mof_Graphicelement__key(master->depths[i]) << 32) | (Uint32)i;
+	if (i > 0 && keys[i] < keys[i - 1])
+	{
+	  if (runs < MOF_GRAPHICELEMENT_RUNS)
+		starts[runs] = i;
+	  runs++;
+	}
+  }
+
+  /* already in order */
+  if (runs == 1)
+	return;
+
+  scratch = mof_Arena__alloc(master->arena, master->count * sizeof(Uint64));
+  if (runs <= MOF_GRAPHICELEMENT_RUNS)
+  {
+	starts[runs] = master->count;
+	keys = mof_Graphicelement__merge(keys, scratch, master->count, starts, runs);
+  }
+  else
+  {
+	keys = mof_Graphicelement__radix(keys, scratch, master->count);
+  }
+
+  sorted = mof_Arena__alloc(master->arena, master->capacity * sizeof(mof_Graphicelementitem));
+  for (i = 0; i < master->count; i++)
+  {
+	sorted[i] = master->elements[(Uint32)keys[i]];
+  }
+  master->elements = sorted;
 }
 
 /**
- * Render the graphic element.
+ * Pixel value of a packed color.
  * 
+ * @param framebuffer Pointer to a mof_Framebuffer object (locked).
+ * @param color       Packed color (see MOF_GRAPHICELEMENT_RGBA).
+ * @return            Pixel value.
+ */
+Uint32 mof_Graphicelement__pixel(mof_Framebuffer *framebuffer, Uint32 color)
+{
+  return mof_Framebuffer__color(framebuffer, color >> 24, (color >> 16) & 0xff, (color >> 8) & 0xff);
+}
+
+/**
+ * Pixels covered by an element.
+ * 
+ * @param element Pointer to a mof_Graphicelementitem (not a text run).
+ * @param box     Left, top, right and bottom pixels (included).
+ * @return        False (0) if the element cover nothing, true (1) otherwise.
+ */
+int mof_Graphicelement__bounds(mof_Graphicelementitem *element, int *box)
+{
+  box[0] = element->x;
+  box[1] = element->y;
+  box[2] = element->x + element->width;
+  box[3] = element->y + element->height;
+
+  /* rectangles are drawn from either corner */
+  if (element->kind == MOF_GRAPHICELEMENT_RECT)
+  {
+	if (box[2] < box[0])
+	{
+	  box[2] = box[0];
+	  box[0] = element->x + element->width;
+	}
+	if (box[3] < box[1])
+	{
+	  box[3] = box[1];
+	  box[1] = element->y + element->height;
+	}
+  }
+
+  return (box[0] <= box[2] && box[1] <= box[3]);
+}
+
+/**
+ * Draw a run of rectangles.
+ * 
+ * @param master   Pointer to a mof_Graphicelement object (rendering).
+ * @param elements First element of the run.
+ * @param count    Number of elements.
+ */
+void mof_Graphicelement__rects(mof_Graphicelement *master, mof_Graphicelementitem *elements, int count)
+{
+  mof_Framebuffer *framebuffer = master->framebuffer;
+  mof_Graphicelementitem *cur;
+  Uint32 color = elements->color, pixel = mof_Graphicelement__pixel(framebuffer, color);
+  int box[4];
+
+  for (cur = elements; cur < elements + count; cur++)
+  {
+	/* the color is only mapped when it change */
+	if (cur->color != color)
+	{
+	  color = cur->color;
+	  pixel = mof_Graphicelement__pixel(framebuffer, color);
+	}
+	if (mof_Graphicelement__bounds(cur, box))
+	  mof_Framebuffer__rect(framebuffer, box[0], box[1], box[2], box[3], pixel, color & 0xff);
+  }
+}
+
+/**
+ * Draw a run of solid spans.
+ * 
+ * @param master   Pointer to a mof_Graphicelement object (rendering).
+ * @param elements First element of the run.
+ * @param count    Number of elements.
+ */
+void mof_Graphicelement__spans(mof_Graphicelement *master, mof_Graphicelementitem *elements, int count)
+{
+  mof_Framebuffer *framebuffer = master->framebuffer;
+  mof_Graphicelementitem *cur;
+  Uint32 color = elements->color, pixel = mof_Graphicelement__pixel(framebuffer, color);
+
+  for (cur = elements; cur < elements + count; cur++)
+  {
+	/* the color is only mapped when it change */
+	if (cur->color != color)
+	{
+	  color = cur->color;
+	  pixel = mof_Graphicelement__pixel(framebuffer, color);
+	}
+	mof_Framebuffer__hspan(framebuffer, cur->y, cur->x, cur->x + cur->width, pixel);
+  }
+}
+
+/**
+ * Draw a run of textured columns.
+ * 
+ * @param master   Pointer to a mof_Graphicelement object (rendering).
+ * @param elements First element of the run.
+ * @param count    Number of elements.
+ */
+void mof_Graphicelement__columns(mof_Graphicelement *master, mof_Graphicelementitem *elements, int count)
+{
+  mof_Graphicelementitem *cur;
+
+  for (cur = elements; cur < elements + count; cur++)
+  {
+	mof_Framebuffer__vtexture(master->framebuffer, cur->x, cur->y, cur->y + cur->height, cur->data, cur->size, cur->v, cur->step);
+  }
+}
+
+/**
+ * Draw a run of sprite columns.
+ * 
+ * @param master   Pointer to a mof_Graphicelement object (rendering).
+ * @param elements First element of the run.
+ * @param count    Number of elements.
+ */
+void mof_Graphicelement__sprites(mof_Graphicelement *master, mof_Graphicelementitem *elements, int count)
+{
+  mof_Graphicelementitem *cur;
+
+  for (cur = elements; cur < elements + count; cur++)
+  {
+	mof_Framebuffer__vsprite(master->framebuffer, cur->x, cur->y, cur->y + cur->height, cur->data, cur->size, cur->v, cur->step, cur->color);
+  }
+}
+
+/**
+ * Draw a run of text.
+ * 
+ * @param screen   Pointer to a SDL_Surface (unlocked).
+ * @param elements First element of the run.
+ * @param count    Number of elements.
+ */
+void mof_Graphicelement__texts(SDL_Surface *screen, mof_Graphicelementitem *elements, int count)
+{
+  const mof_Graphicelementtext *run;
+  mof_Graphicelementitem *cur;
+  SDL_Surface *rendered;
+  SDL_Color color;
+  SDL_Rect position;
+
+  for (cur = elements; cur < elements + count; cur++)
+  {
+	run = cur->data;
+	color.r = cur->color >> 24;
+	color.g = (cur->color >> 16) & 0xff;
+	color.b = (cur->color >> 8) & 0xff;
+	position.x = cur->x;
+	position.y = cur->y;
+
+	rendered = TTF_RenderText_Solid(run->font->font, run->text, color);
+	if (rendered == NULL)
+	  continue;
+	SDL_BlitSurface(rendered, NULL, screen, &position);
+	SDL_FreeSurface(rendered);
+  }
+}
+
+/**
+ * Pixels of an element drawn in a part of the surface.
+ * 
+ * @param element Pointer to a mof_Graphicelementitem (not a text run).
+ * @param left    First column of the part.
+ * @param top     First line of the part.
+ * @param width   Width of the part.
+ * @param height  Height of the part.
+ * @return        Number of pixels.
+ */
+long mof_Graphicelement__area(mof_Graphicelementitem *element, int left, int top, int width, int height)
+{
+  int box[4];
+
+  if (!mof_Graphicelement__bounds(element, box))
+	return 0;
+
+  if (box[0] < left)
+	box[0] = left;
+  if (box[1] < top)
+	box[1] = top;
+  if (box[2] >= left + width)
+	box[2] = left + width - 1;
+  if (box[3] >= top + height)
+	box[3] = top + height - 1;
+  if (box[0] > box[2] || box[1] > box[3])
+	return 0;
+
+  return (long)(box[2] - box[0] + 1) * (box[3] - box[1] + 1);
+}
+
+/**
+ * Draw the elements of a batch, back to front.
+ * 
+ * @param master Pointer to a mof_Graphicelement object (rendering, locked).
+ * @param first  First element of the batch.
+ * @param last   Element after the batch (no text run in between).
+ */
+void mof_Graphicelement__draw(mof_Graphicelement *master, int first, int last)
+{
+  int i, j;
+  mof_Graphicelementitem *elements = master->elements;
+
+  for (i = first; i < last; i++)
+  {
+	master->written += mof_Graphicelement__area(elements + i, 0, 0, master->framebuffer->width, master->framebuffer->height);
+  }
+
+  /* a run of the same type at a time */
+  for (i = first; i < last; i = j)
+  {
+	for (j = i + 1; j < last && elements[j].kind == elements[i].kind; j++)
+	  ;
+
+	switch (elements[i].kind)
+	{
+	  case MOF_GRAPHICELEMENT_RECT:
+		mof_Graphicelement__rects(master, elements + i, j - i);
+		break;
+
+	  case MOF_GRAPHICELEMENT_SPAN:
+		mof_Graphicelement__spans(master, elements + i, j - i);
+		break;
+
+	  case MOF_GRAPHICELEMENT_COLUMN:
+		mof_Graphicelement__columns(master, elements + i, j - i);
+		break;
+
+	  case MOF_GRAPHICELEMENT_SPRITE:
+		mof_Graphicelement__sprites(master, elements + i, j - i);
+		break;
+	}
+  }
+}
+
+/**
+ * Add a span of lines to the spans covered in a column.
+ * 
+ * The spans are kept in order, the ones touching are merged.
+ * 
+ * @param covered Number of spans, then the first and last line of every span.
+ * @param top     First line covered.
+ * @param bottom  Last line covered.
+ * @return        False (0) if the column have no room left, true (1) otherwise.
+ */
+int mof_Graphicelement__cover(int *covered, int top, int bottom)
+{
+  int *spans = covered + 1;
+  int count = covered[0], i, j;
+
+  for (i = 0; i < count && spans[2 * i + 1] < top - 1; i++)
+	;
+  for (j = i; j < count && spans[2 * j] <= bottom + 1; j++)
+  {
+	if (spans[2 * j] < top)
+	  top = spans[2 * j];
+	if (spans[2 * j + 1] > bottom)
+	  bottom = spans[2 * j + 1];
+  }
+
+  /* the spans i to j - 1 become one */
+  if (count - (j - i) + 1 > MOF_GRAPHICELEMENT_COVERAGE)
+	return 0;
+  memmove(spans + 2 * (i + 1), spans + 2 * j, (count - j) * 2 * sizeof(int));
+  spans[2 * i] = top;
+  spans[2 * i + 1] = bottom;
+  covered[0] = count - (j - i) + 1;
+
+  return 1;
+}
+
+/**
+ * Lines of a span left uncovered in a column.
+ * 
+ * @param covered Spans covered in the column (see mof_Graphicelement__cover).
+ * @param top     First line of the span.
+ * @param bottom  Last line of the span.
+ * @param visible First and last line of every span left (room for
+ *                MOF_GRAPHICELEMENT_COVERAGE + 1 spans).
+ * @return        Number of spans left.
+ */
+int mof_Graphicelement__uncovered(const int *covered, int top, int bottom, int *visible)
+{
+  const int *spans = covered + 1;
+  int count = 0, i;
+
+  for (i = 0; i < covered[0] && top <= bottom; i++)
+  {
+	if (spans[2 * i + 1] < top)
+	  continue;
+	if (spans[2 * i] > bottom)
+	  break;
+
+	if (spans[2 * i] > top)
+	{
+	  visible[2 * count] = top;
+	  visible[2 * count + 1] = spans[2 * i] - 1;
+	  count++;
+	}
+	top = spans[2 * i + 1] + 1;
+  }
+  if (top <= bottom)
+  {
+	visible[2 * count] = top;
+	visible[2 * count + 1] = bottom;
+	count++;
+  }
+
+  return count;
+}
+
+/**
+ * Draw a piece of an element.
+ * 
+ * @param view  Pointer to a mof_Framebuffer object (view of the part drawn).
+ * @param left  First column of the view on the surface.
+ * @param top   First line of the view on the surface.
+ * @param piece Pointer to a mof_Graphicelementpiece (on the surface).
+ */
+void mof_Graphicelement__piece(mof_Framebuffer *view, int left, int top, mof_Graphicelementpiece *piece)
+{
+  mof_Graphicelementitem *element = piece->element;
+
+  switch (element->kind)
+  {
+	case MOF_GRAPHICELEMENT_RECT:
+	  if (piece->left == piece->right && (element->color & 0xff) == 0xff)
+		mof_Framebuffer__vspan(view, piece->left - left, piece->top - top, piece->bottom - top, piece->pixel);
+	  else
+		mof_Framebuffer__rect(view, piece->left - left, piece->top - top, piece->right - left, piece->bottom - top, piece->pixel, 
+							  element->color & 0xff);
+	  break;
+
+	case MOF_GRAPHICELEMENT_SPAN:
+	  mof_Framebuffer__hspan(view, piece->top - top, piece->left - left, piece->right - left, piece->pixel);
+	  break;
+
+	case MOF_GRAPHICELEMENT_COLUMN:
+	  mof_Framebuffer__vtexture(view, piece->left - left, piece->top - top, piece->bottom - top, element->data, element->size, 
+								element->v + (Uint32)(piece->top - element->y) * element->step, element->step);
+	  break;
+
+	case MOF_GRAPHICELEMENT_SPRITE:
+	  mof_Framebuffer__vsprite(view, piece->left - left, piece->top - top, piece->bottom - top, element->data, element->size, 
+							   element->v + (Uint32)(piece->top - element->y) * element->step, element->step, element->color);
+	  break;
+  }
+}
+
+/**
+ * Draw a batch of elements front to back (occlusion).
+ * 
+ * Every element is cut, column by column, into the spans of lines the
+ * opaque elements nearer did not cover; the columns cut the same way are
+ * put together in pieces.  Opaque pieces are drawn right away, the others
+ * once every opaque piece is drawn, back to front.  If a column or the
+ * pieces run out of room, nothing more is drawn: the caller draw the batch
+ * again, back to front (the pixels end up the same), and the pixels already
+ * drawn are not counted.  The coverage only pay off when there are layers of
+ * textured columns to skip: a batch with less than MOF_GRAPHICELEMENT_LAYERS
+ * pixels of textured columns per pixel of the view is left to the caller
+ * right away (the rectangles and spans alone are filled faster than they
+ * are covered).
+ * 
+ * @param view     Pointer to a mof_Framebuffer object (view of the part drawn).
+ * @param left     First column of the view on the surface.
+ * @param top      First line of the view on the surface.
+ * @param elements Elements of the batch, in the order of the render.
+ * @param order    Index of every element of the batch (NULL to take them all).
+ * @param count    Number of elements in the batch.
+ * @param covered  Room for the spans covered in every column of the view.
+ * @param pieces   Room for the pieces drawn after the opaque ones.
+ * @param capacity Number of pieces there is room for.
+ * @param written  Pixels written, incremented if the whole batch is drawn.
+ * @return         False (0) if the batch still have to be drawn, true (1) otherwise.
+ */
+int mof_Graphicelement__occlude(mof_Framebuffer *view, int left, int top, mof_Graphicelementitem *elements, const int *order, int count, 
+								int *covered, mof_Graphicelementpiece *pieces, int capacity, long *written)
+{
+  int stride = 1 + 2 * MOF_GRAPHICELEMENT_COVERAGE;
+  int spans[4 * (MOF_GRAPHICELEMENT_COVERAGE + 1)];
+  int *visible = spans, *previous = spans + 2 * (MOF_GRAPHICELEMENT_COVERAGE + 1), *swap;
+  int box[4], i, k, x, first, opaque, shown, drawn, deferred = 0, mapped = 0;
+  long pixels = 0;
+  Uint32 color = 0, pixel = 0;
+  mof_Graphicelementpiece piece;
+  mof_Graphicelementitem *cur;
+
+  /* not enough textured pixels hidden to pay for the coverage */
+  for (i = 0; i < count; i++)
+  {
+	cur = elements + ((order != NULL) ? order[i] : i);
+	if (cur->kind == MOF_GRAPHICELEMENT_COLUMN)
+	  pixels += mof_Graphicelement__area(cur, left, top, view->width, view->height);
+  }
+  if (pixels < MOF_GRAPHICELEMENT_LAYERS * view->width * view->height)
+	return 0;
+  pixels = 0;
+
+  for (x = 0; x < view->width; x++)
+  {
+	covered[x * stride] = 0;
+  }
+
+  for (i = count - 1; i >= 0; i--)
+  {
+	cur = elements + ((order != NULL) ? order[i] : i);
+	if (!mof_Graphicelement__bounds(cur, box))
+	  continue;
+
+	if (box[0] < left)
+	  box[0] = left;
+	if (box[1] < top)
+	  box[1] = top;
+	if (box[2] >= left + view->width)
+	  box[2] = left + view->width - 1;
+	if (box[3] >= top + view->height)
+	  box[3] = top + view->height - 1;
+	if (box[0] > box[2] || box[1] > box[3])
+	  continue;
+
+	/* the color is only mapped when it change */
+	if ((cur->kind == MOF_GRAPHICELEMENT_RECT || cur->kind == MOF_GRAPHICELEMENT_SPAN) && (!mapped || cur->color != color))
+	{
+	  color = cur->color;
+	  pixel = mof_Graphicelement__pixel(view, color);
+	  mapped = 1;
+	}
+	opaque = (cur->kind == MOF_GRAPHICELEMENT_SPAN || cur->kind == MOF_GRAPHICELEMENT_COLUMN || 
+			  (cur->kind == MOF_GRAPHICELEMENT_RECT && (cur->color & 0xff) == 0xff));
+	piece.element = cur;
+	piece.pixel = pixel;
+
+	/* one more column to close the last pieces */
+	for (x = first = box[0], drawn = 0; x <= box[2] + 1; x++)
+	{
+	  shown = (x <= box[2]) ? mof_Graphicelement__uncovered(covered + (x - left) * stride, box[1], box[3], visible) : 0;
+
+	  /* same spans as the column before, the pieces grow */
+	  if (x > box[0] && x <= box[2] && shown == drawn && memcmp(visible, previous, 2 * shown * sizeof(int)) == 0)
+		continue;
+
+	  for (k = 0; k < drawn; k++)
+	  {
+		piece.left = first;
+		piece.right = x - 1;
+		piece.top = previous[2 * k];
+		piece.bottom = previous[2 * k + 1];
+		pixels += (long)(piece.right - piece.left + 1) * (piece.bottom - piece.top + 1);
+
+		if (opaque)
+		  mof_Graphicelement__piece(view, left, top, &piece);
+		else if (deferred < capacity)
+		  pieces[deferred++] = piece;
+		else
+		  return 0;
+	  }
+
+	  swap = previous;
+	  previous = visible;
+	  visible = swap;
+	  drawn = shown;
+	  first = x;
+	}
+
+	if (opaque)
+	{
+	  for (x = box[0]; x <= box[2]; x++)
+	  {
+		if (!mof_Graphicelement__cover(covered + (x - left) * stride, box[1], box[3]))
+		  return 0;
+	  }
+	}
+  }
+
+  while (deferred > 0)
+  {
+	mof_Graphicelement__piece(view, left, top, pieces + --deferred);
+  }
+
+  *written += pixels;
+  return 1;
+}
+
+/**
+ * Bin a batch of elements into the tiles they cover.
+ * 
+ * The elements are taken in order, so are they in every tile.
+ * 
+ * @param master Pointer to a mof_Graphicelement object (rendering).
+ * @param first  First element of the batch.
+ * @param last   Element after the batch.
+ */
+void mof_Graphicelement__bin(mof_Graphicelement *master, int first, int last)
+{
+  int tiles = master->tilesX * master->tilesY;
+  int *bins = mof_Arena__alloc(master->arena, (tiles + 1) * sizeof(int));
+  int box[4], i, x, y, total;
+
+  /* count the elements of every tile */
+  memset(bins, 0, (tiles + 1) * sizeof(int));
+  for (i = first; i < last; i++)
+  {
+	if (!mof_Graphicelement__bounds(master->elements + i, box))
+	  continue;
+
+	box[0] = (box[0] < 0) ? 0 : box[0] / MOF_GRAPHICELEMENT_TILE;
+	box[1] = (box[1] < 0) ? 0 : box[1] / MOF_GRAPHICELEMENT_TILE;
+	box[2] = (box[2] < 0) ? -1 : box[2] / MOF_GRAPHICELEMENT_TILE;
+	box[3] = (box[3] < 0) ? -1 : box[3] / MOF_GRAPHICELEMENT_TILE;
+	for (y = box[1]; y <= box[3] && y < master->tilesY; y++)
+	{
+	  for (x = box[0]; x <= box[2] && x < master->tilesX; x++)
+	  {
+		bins[x + y * master->tilesX]++;
+	  }
+	}
+  }
+
+  /* end of every tile, then filled backward down to its start */
+  for (total = 0, i = 0; i < tiles; i++)
+  {
+	total += bins[i];
+	bins[i] = total;
+  }
+  bins[tiles] = total;
+  master->binned = mof_Arena__alloc(master->arena, total * sizeof(int));
+
+  for (i = last - 1; i >= first; i--)
+  {
+	if (!mof_Graphicelement__bounds(master->elements + i, box))
+	  continue;
+
+	box[0] = (box[0] < 0) ? 0 : box[0] / MOF_GRAPHICELEMENT_TILE;
+	box[1] = (box[1] < 0) ? 0 : box[1] / MOF_GRAPHICELEMENT_TILE;
+	box[2] = (box[2] < 0) ? -1 : box[2] / MOF_GRAPHICELEMENT_TILE;
+	box[3] = (box[3] < 0) ? -1 : box[3] / MOF_GRAPHICELEMENT_TILE;
+	for (y = box[1]; y <= box[3] && y < master->tilesY; y++)
+	{
+	  for (x = box[0]; x <= box[2] && x < master->tilesX; x++)
+	  {
+		master->binned[--bins[x + y * master->tilesX]] = i;
+	  }
+	}
+  }
+
+  master->bins = bins;
+}
+
+/**
+ * Draw the elements of a tile (job of the mof_Threadpool).
+ * 
+ * The elements are drawn in a view of the tile, which clip them (front to
+ * back with the occlusion on).
+ * 
+ * @param data  Pointer to a mof_Graphicelement object (rendering, binned).
+ * @param task  Index of the tile.
+ * @param tasks Number of tiles.
+ */
+void mof_Graphicelement__tile(void *data, int task, int tasks)
+{
+  mof_Graphicelement *master = data;
+  mof_Framebuffer view;
+  mof_Graphicelementitem *cur;
+  int left = (task % master->tilesX) * MOF_GRAPHICELEMENT_TILE;
+  int top = (task / master->tilesX) * MOF_GRAPHICELEMENT_TILE;
+  int i, box[4], mapped = 0;
+  Uint32 color = 0, pixel = 0;
+  int covered[MOF_GRAPHICELEMENT_TILE * (1 + 2 * MOF_GRAPHICELEMENT_COVERAGE)];
+  mof_Graphicelementpiece pieces[MOF_GRAPHICELEMENT_PIECES];
+
+  mof_Framebuffer__view(&view, master->framebuffer, left, top, MOF_GRAPHICELEMENT_TILE, MOF_GRAPHICELEMENT_TILE);
+
+  if (master->occlusion && mof_Graphicelement__occlude(&view, left, top, master->elements, master->binned + master->bins[task], 
+													   master->bins[task + 1] - master->bins[task], covered, pieces, 
+													   MOF_GRAPHICELEMENT_PIECES, master->writes + task))
+	return;
+
+  for (i = master->bins[task]; i < master->bins[task + 1]; i++)
+  {
+	cur = master->elements + master->binned[i];
+	master->writes[task] += mof_Graphicelement__area(cur, left, top, view.width, view.height);
+
+	/* the color is only mapped when it change */
+	if ((cur->kind == MOF_GRAPHICELEMENT_RECT || cur->kind == MOF_GRAPHICELEMENT_SPAN) && (!mapped || cur->color != color))
+	{
+	  color = cur->color;
+	  pixel = mof_Graphicelement__pixel(&view, color);
+	  mapped = 1;
+	}
+
+	switch (cur->kind)
+	{
+	  case MOF_GRAPHICELEMENT_RECT:
+		mof_Graphicelement__bounds(cur, box);
+		mof_Framebuffer__rect(&view, box[0] - left, box[1] - top, box[2] - left, box[3] - top, pixel, color & 0xff);
+		break;
+
+	  case MOF_GRAPHICELEMENT_SPAN:
+		mof_Framebuffer__hspan(&view, cur->y - top, cur->x - left, cur->x + cur->width - left, pixel);
+		break;
+
+	  case MOF_GRAPHICELEMENT_COLUMN:
+		mof_Framebuffer__vtexture(&view, cur->x - left, cur->y - top, cur->y + cur->height - top, cur->data, cur->size, cur->v, cur->step);
+		break;
+
+	  case MOF_GRAPHICELEMENT_SPRITE:
+		mof_Framebuffer__vsprite(&view, cur->x - left, cur->y - top, cur->y + cur->height - top, cur->data, cur->size, cur->v, cur->step, cur->color);
+		break;
+	}
+  }
+}
+
+/**
+ * Render the graphic elements in tiles.
+ * 
+ * The elements between two runs of text are binned then their tiles are
+ * drawn by the mof_Threadpool, the surface stay locked meanwhile.
+ * 
+ * @param screen Pointer to a SDL_Surface.
+ * @param master Pointer to a mof_Graphicelement object (sorted).
+ */
+void mof_Graphicelement__tiles(SDL_Surface *screen, mof_Graphicelement *master)
+{
+  int i, j, task, tiles;
+  mof_Graphicelementitem *elements = master->elements;
+
+  master->tilesX = (screen->w + MOF_GRAPHICELEMENT_TILE - 1) / MOF_GRAPHICELEMENT_TILE;
+  master->tilesY = (screen->h + MOF_GRAPHICELEMENT_TILE - 1) / MOF_GRAPHICELEMENT_TILE;
+  tiles = master->tilesX * master->tilesY;
+  master->writes = mof_Arena__alloc(master->arena, tiles * sizeof(long));
+  memset(master->writes, 0, tiles * sizeof(long));
+
+  for (i = 0; i < master->count; i = j)
+  {
+	if (elements[i].kind == MOF_GRAPHICELEMENT_TEXT)
+	{
+	  for (j = i + 1; j < master->count && elements[j].kind == MOF_GRAPHICELEMENT_TEXT; j++)
+		;
+
+	  if (master->framebuffer->surface != NULL)
+		mof_Framebuffer__unlock(master->framebuffer);
+	  mof_Graphicelement__texts(screen, elements + i, j - i);
+	  continue;
+	}
+
+	for (j = i + 1; j < master->count && elements[j].kind != MOF_GRAPHICELEMENT_TEXT; j++)
+	  ;
+
+	if (master->framebuffer->surface == NULL)
+	  mof_Framebuffer__lock(master->framebuffer, screen);
+
+	mof_Graphicelement__bin(master, i, j);
+	if (master->pool->count == 1)
+	{
+	  for (task = 0; task < tiles; task++)
+	  {
+		mof_Graphicelement__tile(master, task, tiles);
+	  }
+	}
+	else
+	{
+	  mof_Threadpool__run(master->pool, mof_Graphicelement__tile, master, tiles);
+	}
+  }
+  if (master->framebuffer->surface != NULL)
+	mof_Framebuffer__unlock(master->framebuffer);
+
+  for (task = 0; task < tiles; task++)
+  {
+	master->written += master->writes[task];
+  }
+
+  master->bins = NULL;
+  master->binned = NULL;
+  master->writes = NULL;
+}
+
+/**
+ * Render the graphic elements.
+ * 
+ * The elements are sorted then drawn, the array is empty afterward.  The
+ * surface stay locked as long as the elements are drawn directly in its
+ * pixels, text is drawn by SDL on the surface unlocked.
+ * With a mof_Threadpool, the elements are drawn in tiles.  The pixels
+ * written are counted in written (divided by the pixels of the surface, the
+ * overdraw).
+ * 
+ * @param screen Pointer to a SDL_Surface.
  * @param master Pointer to a mof_Graphicelement object.
  */
 void mof_Graphicelement__render(SDL_Surface *screen, mof_Graphicelement *master)
 {
   /* check if we have a valid mof_Graphicelement object */
   mof_Graphicelement__check(master);
-  
-  /* draw graphic element to the screen */
-  mof_Graphicelement *fst = master->next;
-  mof_Graphicelement *bkup = master->next;
-  mof_Graphicelement *cur = NULL;
-  for (cur = fst; cur != NULL; cur = bkup)
+
+  mof_Graphicelement__sort(master);
+  master->written = 0;
+
+  if (master->pool != NULL)
   {
-	bkup = cur->next;
-	master->current = cur;
-	
-	/* draw element */
-	boxRGBA(screen, cur->x, cur->y, (cur->x + cur->width), (cur->y + cur->height), cur->red, cur->green, cur->blue, cur->alpha);
-	
-	mof_Graphicelement__remove(master);
+	mof_Graphicelement__tiles(screen, master);
+	mof_Graphicelement__clear(master);
+	return;
   }
+
+  /* draw the batches of elements between the runs of text */
+  int i, j, *covered = NULL, capacity = master->count + MOF_GRAPHICELEMENT_PIECES;
+  mof_Graphicelementitem *elements = master->elements;
+  mof_Graphicelementpiece *pieces = NULL;
+
+  for (i = 0; i < master->count; i = j)
+  {
+	if (elements[i].kind == MOF_GRAPHICELEMENT_TEXT)
+	{
+	  for (j = i + 1; j < master->count && elements[j].kind == MOF_GRAPHICELEMENT_TEXT; j++)
+		;
+
+	  if (master->framebuffer->surface != NULL)
+		mof_Framebuffer__unlock(master->framebuffer);
+	  mof_Graphicelement__texts(screen, elements + i, j - i);
+	  continue;
+	}
+
+	for (j = i + 1; j < master->count && elements[j].kind != MOF_GRAPHICELEMENT_TEXT; j++)
+	  ;
+
+	if (master->framebuffer->surface == NULL)
+	  mof_Framebuffer__lock(master->framebuffer, screen);
+
+	if (master->occlusion)
+	{
+	  if (covered == NULL)
+	  {
+		covered = mof_Arena__alloc(master->arena, screen->w * (1 + 2 * MOF_GRAPHICELEMENT_COVERAGE) * sizeof(int));
+		pieces = mof_Arena__alloc(master->arena, capacity * sizeof(mof_Graphicelementpiece));
+	  }
+	  if (mof_Graphicelement__occlude(master->framebuffer, 0, 0, elements + i, NULL, j - i, covered, pieces, capacity, &master->written))
+		continue;
+	}
+	mof_Graphicelement__draw(master, i, j);
+  }
+  if (master->framebuffer->surface != NULL)
+	mof_Framebuffer__unlock(master->framebuffer);
+
+  mof_Graphicelement__clear(master);
 }
 
-#endif
\ No newline at end of file
+#endif
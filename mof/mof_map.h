@@ -1,19 +1,31 @@
 /**
  * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
- * @version 1.30
+ * @version 2.11
  * @since 2012-01-17
+ * 
+ * Beside the cells, the map keep the distance from every cell to the
+ * nearest wall (Chebyshev distance, in cells) so the rays can skip the
+ * empty space in big jumps.  It is rebuilt every time a map is loaded.
+ * 
+ * The walls collide straight from the cells (see mof_Map__intersect), no
+ * collision box is kept for them.
  */
 
 #include <assert.h>
 #include "SDL.h"
-#include "SDL_gfxPrimitives.h"
 
 #include "mof_collisionbox.h"
+#include "mof_framebuffer.h"
+#include "mof_texture.h"
 
 #ifndef MOF_MAP_H_
 #define MOF_MAP_H_
 
 #define MOF_MAP_TYPE (1<<3)		/* dynamic type checking */
+#define MOF_MAP_MATERIALS 3		/* number of wall textures */
+#ifndef MOF_MAP_UNIT
+#define MOF_MAP_UNIT 64			/* size of a square (pixel) */
+#endif
 
 /**
  * mof_Map class.
@@ -21,56 +33,122 @@
 typedef struct {
   unsigned int type;
   int *map;
+  unsigned char *distances;		/* distance to the nearest wall or border (0 for a wall) */
   int width;						/* dimension in square(s) */
   int height;
   int unit;
-  mof_Collisionbox *collision;
+  mof_Texture *materials[MOF_MAP_MATERIALS];	/* texture of the walls (value in the map - 1) */
+  mof_Texture *ground;				/* texture of the floor */
+  mof_Texture *ceiling;
   SDL_Surface *screen;				/* copy of the current SDL surface */
 } mof_Map;
 
 /**
  * Load map.
  * 
+ * Every non-zero value is a wall, the value select its material.
+ * 
  * @return A pointer to the map array.
  */
 int *mof_Map__loadmap(void)
 {
   static int map[120] = {
-						 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-						 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
-						 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1,
-						 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 1,
-						 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1,
-						 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1,
-						 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 1,
-						 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1,
-						 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
-						 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+						 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+						 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2,
+						 2, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 2,
+						 2, 0, 0, 1, 0, 0, 1, 0, 0, 3, 0, 2,
+						 2, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 2,
+						 2, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 2,
+						 2, 0, 0, 1, 0, 0, 1, 0, 0, 3, 0, 2,
+						 2, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 2,
+						 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2,
+						 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2
 					   };
 					
   return map;
 }
 
 /**
- * Create list of collision box.
+ * Build the distance field of the map.
+ * 
+ * Two passes (forward and backward) over the map, every cell taking the
+ * smallest distance of its 8 neighbours plus one, which give the exact
+ * Chebyshev distance.  The outside of the map count as walls, so a square
+ * of empty cells never cross the border.
  * 
  * @param map Pointer to a mof_Map object.
  */
-void mof_Map__createCollisionbox(mof_Map *map)
+void mof_Map__builddistances(mof_Map *map)
 {
-  int i, j;
+  int i, j, d, best;
+  
+  /* one byte per cell (the farther cells saturate), padded for 32 bits reads */
+  free(map->distances);
+  map->distances = malloc(map->width * map->height + 3);
+  
   for (i = 0; i < map->height; i++)
   {
 	for (j = 0; j < map->width; j++)
 	{
 	  if (map->map[(i * map->width) + j])
 	  {
-		mof_Collisionbox__add(map->collision, j * map->unit, i * map->unit, map->unit, map->unit);
+		map->distances[(i * map->width) + j] = 0;
+		continue;
 	  }
+	  
+	  /* top-left neighbours, the border being at distance 0 */
+	  best = 1 + ((i > 0 && j > 0) ? map->distances[((i - 1) * map->width) + j - 1] : 0);
+	  d = 1 + ((i > 0) ? map->distances[((i - 1) * map->width) + j] : 0);
+	  if (d < best) best = d;
+	  d = 1 + ((i > 0 && j < map->width - 1) ? map->distances[((i - 1) * map->width) + j + 1] : 0);
+	  if (d < best) best = d;
+	  d = 1 + ((j > 0) ? map->distances[(i * map->width) + j - 1] : 0);
+	  if (d < best) best = d;
+	  
+	  map->distances[(i * map->width) + j] = (best < 255) ? best : 255;
+	}
+  }
+  
+  for (i = map->height - 1; i >= 0; i--)
+  {
+	for (j = map->width - 1; j >= 0; j--)
+	{
+	  best = map->distances[(i * map->width) + j];
+	  
+	  /* bottom-right neighbours */
+	  d = 1 + ((i < map->height - 1 && j < map->width - 1) ? map->distances[((i + 1) * map->width) + j + 1] : 0);
+	  if (d < best) best = d;
+	  d = 1 + ((i < map->height - 1) ? map->distances[((i + 1) * map->width) + j] : 0);
+	  if (d < best) best = d;
+	  d = 1 + ((i < map->height - 1 && j > 0) ? map->distances[((i + 1) * map->width) + j - 1] : 0);
+	  if (d < best) best = d;
+	  d = 1 + ((j < map->width - 1) ? map->distances[(i * map->width) + j + 1] : 0);
+	  if (d < best) best = d;
+	  
+	  map->distances[(i * map->width) + j] = best;
 	}
   }
 }
 
+/**
+ * Load the cells of a map.
+ * 
+ * The distance field is rebuilt for the new cells.
+ * 
+ * @param map    Pointer to a mof_Map object.
+ * @param cells  Map array (not copied).
+ * @param width  Dimension in square(s).
+ * @param height Dimension in square(s).
+ */
+void mof_Map__load(mof_Map *map, int *cells, int width, int height)
+{
+  map->map = cells;
+  map->width = width;
+  map->height = height;
+  
+  mof_Map__builddistances(map);
+}
+
 /**
  * Constructor.
  *  
@@ -81,14 +159,14 @@ void mof_Map__construct(mof_Map *map)
   /* here OR the MOF_MAP_TYPE constant into the type */
   map->type |= MOF_MAP_TYPE;
    
-  map->map = mof_Map__loadmap();
-  map->width = 12;
-  map->height = 10;
-  map->unit = 64;
-  map->collision = mof_Collisionbox__new(0, 0, map->unit, map->unit);
-  
-  /* create collision box for map */
-  mof_Map__createCollisionbox(map);
+  map->unit = MOF_MAP_UNIT;
+  map->distances = NULL;
+  mof_Map__load(map, mof_Map__loadmap(), 12, 10);
+  map->materials[0] = mof_Texture__new(MOF_TEXTURE_BRICK);
+  map->materials[1] = mof_Texture__new(MOF_TEXTURE_STONE);
+  map->materials[2] = mof_Texture__new(MOF_TEXTURE_WOOD);
+  map->ground = mof_Texture__new(MOF_TEXTURE_TILE);
+  map->ceiling = mof_Texture__new(MOF_TEXTURE_PLASTER);
 }
 
 /**
@@ -141,33 +219,157 @@ void mof_Map__destroy(mof_Map *map)
   map->type = 0;
 
   /* free the memory allocated for the object */
-  mof_Collisionbox__destroy(map->collision);
+  free(map->distances);
+  
+  int i;
+  for (i = 0; i < MOF_MAP_MATERIALS; i++)
+  {
+	mof_Texture__destroy(map->materials[i]);
+  }
+  mof_Texture__destroy(map->ground);
+  mof_Texture__destroy(map->ceiling);
   free(map);
 }
 
 /**
- * Drawing map.
+ * Index of the material of a wall.
+ * 
+ * Any non-zero value is a wall, negative ones included: the value minus
+ * one is taken unsigned so the index always fall in the materials.
+ * 
+ * @param map  Pointer to a mof_Map object.
+ * @param cell Index of the wall in the map array.
+ * @return     Index in the materials of the map.
+ */
+int mof_Map__materialindex(mof_Map *map, int cell)
+{
+  return (int)(((unsigned int)map->map[cell] - 1) % MOF_MAP_MATERIALS);
+}
+
+/**
+ * Material of a wall.
+ * 
+ * @param map  Pointer to a mof_Map object.
+ * @param cell Index of the wall in the map array.
+ * @return     Texture of the wall.
+ */
+mof_Texture *mof_Map__material(mof_Map *map, int cell)
+{
+  return map->materials[mof_Map__materialindex(map, cell)];
+}
+
+/**
+ * Cells overlapped by a rectangle.
+ * 
+ * The range is clipped to the map, it is empty (first after last) when the
+ * rectangle is outside.
+ * 
+ * @param map    Pointer to a mof_Map object.
+ * @param x      Coordinate of the rectangle (pixel).
+ * @param y      Coordinate of the rectangle (pixel).
+ * @param width  Width of the rectangle.
+ * @param height Height of the rectangle.
+ * @param range  First and last column, first and last line.
+ */
+void mof_Map__range(mof_Map *map, int x, int y, int width, int height, int *range)
+{
+  int i, pixel;
+  
+  range[0] = x;
+  range[1] = x + width - 1;
+  range[2] = y;
+  range[3] = y + height - 1;
+  for (i = 0; i < 4; i++)
+  {
+	/* rounded down, the pixels left or above the map fall in cell -1 or less */
+	pixel = range[i];
+	range[i] = (pixel >= 0) ? pixel / map->unit : -1 - (-1 - pixel) / map->unit;
+  }
+  if (range[0] < 0)
+	range[0] = 0;
+  if (range[1] >= map->width)
+	range[1] = map->width - 1;
+  if (range[2] < 0)
+	range[2] = 0;
+  if (range[3] >= map->height)
+	range[3] = map->height - 1;
+}
+
+/**
+ * Check a box for collision with the walls.
+ * 
+ * Every wall is a square of the map (unit by unit pixels), only the cells
+ * under the box are read.
+ * 
+ * @param map          Pointer to a mof_Map object.
+ * @param collisionbox Pointer to a mof_Collisionbox object.
+ * @return             True (1) for a collision, false (0) otherwise.
+ */
+int mof_Map__intersect(mof_Map *map, mof_Collisionbox *collisionbox)
+{
+  int i, j, range[4];
+  
+  mof_Map__range(map, collisionbox->x, collisionbox->y, collisionbox->width, collisionbox->height, range);
+  for (i = range[2]; i <= range[3]; i++)
+  {
+	for (j = range[0]; j <= range[1]; j++)
+	{
+	  if (map->map[(i * map->width) + j])
+		return 1;
+	}
+  }
+  
+  return 0;
+}
+
+/**
+ * Drawing map on a surface.
+ * 
+ * Only the walls on the surface are drawn.
  * 
  * @param map     Pointer to a mof_Map object.
+ * @param surface Pointer to a SDL_Surface.
  * @param offsetX Offset for the X coordinate.
  * @param offsetY Offset for the Y coordinate.
  */
-void mof_Map__draw(mof_Map *map, int offsetX, int offsetY)
+void mof_Map__drawlayer(mof_Map *map, SDL_Surface *surface, int offsetX, int offsetY)
 {
   /* check if we have a valid mof_Map object */
   mof_Map__check(map);
   
   int i, j;
-  for (i = 0; i < map->height; i++)
+  int left = (offsetX < 0) ? 0 : offsetX / map->unit;
+  int top = (offsetY < 0) ? 0 : offsetY / map->unit;
+  int right = (offsetX + surface->w) / map->unit;
+  int bottom = (offsetY + surface->h) / map->unit;
+  
+  if (right >= map->width)
+	right = map->width - 1;
+  if (bottom >= map->height)
+	bottom = map->height - 1;
+  
+  for (i = top; i <= bottom; i++)
   {
-	for (j = 0; j < map->width; j++)
+	for (j = left; j <= right; j++)
 	{
 	  if (map->map[(i * map->width) + j])
 	  {
-		boxRGBA(map->screen, j * map->unit - offsetX, i * map->unit - offsetY, (j * map->unit) + map->unit - offsetX, (i * map->unit) + map->unit - offsetY, 0, 0, 255, 255);
+		mof_Framebuffer__box(surface, j * map->unit - offsetX, i * map->unit - offsetY, (j * map->unit) + map->unit - offsetX, (i * map->unit) + map->unit - offsetY, 0, 0, 255, 255);
 	  }
 	}
   }
 }
 
-#endif
\ No newline at end of file
+/**
+ * Drawing map.
+ * 
+ * @param map     Pointer to a mof_Map object.
+ * @param offsetX Offset for the X coordinate.
+ * @param offsetY Offset for the Y coordinate.
+ */
+void mof_Map__draw(mof_Map *map, int offsetX, int offsetY)
+{
+  mof_Map__drawlayer(map, map->screen, offsetX, offsetY);
+}
+
+#endif
@@ -0,0 +1,459 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.00
+ * @since 2012-02-26
+ * 
+ * This class draw the 2D map view by dirty rectangles.  The walls are drawn
+ * once in a layer (a window of the map around the view, the whole map when
+ * it is small enough) which is copied back on the screen where needed.  The
+ * moving things (items: avatars, rays) give their box and their state every
+ * frame; only the boxes of the items that changed, before and after, are
+ * restored from the layer, the items touching them are drawn again clipped
+ * to them and only these rectangles are sent to the display.  Everything is
+ * drawn again when the view scroll, when the layer is built again and on a
+ * double buffered display (the buffers are flipped, not updated).
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SDL.h"
+
+#include "mof_map.h"
+
+#ifndef MOF_MAPVIEW_H_
+#define MOF_MAPVIEW_H_
+
+#define MOF_MAPVIEW_TYPE (1<<18)		/* dynamic type checking */
+#define MOF_MAPVIEW_ITEMS 16				/* most items drawn over the map */
+#define MOF_MAPVIEW_RECTS 32				/* most dirty rectangles before drawing everything */
+#define MOF_MAPVIEW_LAYER 2048			/* largest layer (pixels), unless the screen is larger */
+
+/**
+ * mof_Mapview class.
+ */
+typedef struct {
+  unsigned int type;
+  SDL_Surface *screen;				/* screen of the previous frame */
+  SDL_Surface *layer;				/* walls of a window of the map */
+  int layerX;						/* window of the map in the layer */
+  int layerY;
+  mof_Map *map;						/* map of the layer */
+  int *cells;
+  int offsetX;						/* offset of the view */
+  int offsetY;
+  SDL_Rect boxes[MOF_MAPVIEW_ITEMS];	/* box of every item drawn */
+  Uint32 states[MOF_MAPVIEW_ITEMS];
+  int drawn;						/* items drawn the previous frame */
+  SDL_Rect items[MOF_MAPVIEW_ITEMS];	/* box of every item of the frame (w of 0 if none) */
+  Uint32 changes[MOF_MAPVIEW_ITEMS];	/* state of every item of the frame */
+  int count;						/* items of the frame */
+  SDL_Rect rects[MOF_MAPVIEW_RECTS];	/* dirty rectangles */
+  int dirty;						/* number of dirty rectangles */
+  int full;							/* true (1) if everything is drawn again */
+} mof_Mapview;
+
+/**
+ * Constructor.
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ */
+void mof_Mapview__construct(mof_Mapview *mapview)
+{
+  /* here OR the MOF_MAPVIEW_TYPE constant into the type */
+  mapview->type |= MOF_MAPVIEW_TYPE;
+
+  mapview->screen = NULL;
+  mapview->layer = NULL;
+  mapview->layerX = 0;
+  mapview->layerY = 0;
+  mapview->map = NULL;
+  mapview->cells = NULL;
+  mapview->offsetX = 0;
+  mapview->offsetY = 0;
+  mapview->drawn = 0;
+  mapview->count = 0;
+  mapview->dirty = 0;
+  mapview->full = 1;
+}
+
+/**
+ * New.
+ * 
+ * @return An object mof_Mapview.
+ */
+mof_Mapview *mof_Mapview__new()
+{
+  mof_Mapview *mapview = malloc(sizeof(mof_Mapview));
+  mapview->type = MOF_MAPVIEW_TYPE;
+
+  /* call the constructor */
+  mof_Mapview__construct(mapview);
+
+  return mapview;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ */
+void mof_Mapview__check(mof_Mapview *mapview)
+{
+  /* check if we have a valid mof_Mapview object */
+  if (mapview == NULL ||
+	  !(mapview->type & MOF_MAPVIEW_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ */
+void mof_Mapview__destroy(mof_Mapview *mapview)
+{
+  /* check if we have a valid mof_Mapview object */
+  mof_Mapview__check(mapview);
+
+  /* set type to 0 indicate this is no longer a mof_Mapview object */
+  mapview->type = 0;
+
+  /* free the memory allocated for the object */
+  if (mapview->layer != NULL)
+	SDL_FreeSurface(mapview->layer);
+  free(mapview);
+}
+
+/**
+ * Forget what is on the screen.
+ * 
+ * Must be called when something else is drawn on the screen (3D view),
+ * everything is drawn again next frame.
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ */
+void mof_Mapview__invalidate(mof_Mapview *mapview)
+{
+  /* check if we have a valid mof_Mapview object */
+  mof_Mapview__check(mapview);
+
+  mapview->full = 1;
+}
+
+/**
+ * State of an item.
+ * 
+ * An item is drawn again when its state change, this one is made of the
+ * position and the angle (hash of the bytes).
+ * 
+ * @param x     Coordinate of the item.
+ * @param y     Coordinate of the item.
+ * @param angle Angle of the item.
+ * @return      State of the item.
+ */
+Uint32 mof_Mapview__state(double x, double y, int angle)
+{
+  unsigned char bytes[sizeof(double) * 2 + sizeof(int)];
+  Uint32 hash = 2166136261u;
+  int i;
+
+  memcpy(bytes, &x, sizeof(double));
+  memcpy(bytes + sizeof(double), &y, sizeof(double));
+  memcpy(bytes + sizeof(double) * 2, &angle, sizeof(int));
+  for (i = 0; i < sizeof(bytes); i++)
+  {
+	hash = (hash ^ bytes[i]) * 16777619u;
+  }
+
+  return hash;
+}
+
+/**
+ * Clip a rectangle to the screen.
+ * 
+ * @param rect   Rectangle (left, top, right, bottom, included).
+ * @param screen Pointer to a SDL_Surface.
+ * @param clip   Rectangle clipped (w of 0 if outside of the screen).
+ */
+void mof_Mapview__clip(const int *rect, SDL_Surface *screen, SDL_Rect *clip)
+{
+  int left = (rect[0] < 0) ? 0 : rect[0];
+  int top = (rect[1] < 0) ? 0 : rect[1];
+  int right = (rect[2] >= screen->w) ? screen->w - 1 : rect[2];
+  int bottom = (rect[3] >= screen->h) ? screen->h - 1 : rect[3];
+
+  clip->x = left;
+  clip->y = top;
+  clip->w = (left > right || top > bottom) ? 0 : right - left + 1;
+  clip->h = (left > right || top > bottom) ? 0 : bottom - top + 1;
+}
+
+/**
+ * Build the layer again.
+ * 
+ * The window of the map is centered on the view, as large as the map up
+ * to MOF_MAPVIEW_LAYER (never smaller than the screen).
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ * @param screen  Pointer to a SDL_Surface.
+ * @param map     Pointer to a mof_Map object.
+ */
+void mof_Mapview__build(mof_Mapview *mapview, SDL_Surface *screen, mof_Map *map)
+{
+  SDL_PixelFormat *format = screen->format;
+  int width = map->width * map->unit, height = map->height * map->unit;
+  int windowW = (width < MOF_MAPVIEW_LAYER) ? width : MOF_MAPVIEW_LAYER;
+  int windowH = (height < MOF_MAPVIEW_LAYER) ? height : MOF_MAPVIEW_LAYER;
+
+  if (windowW < screen->w)
+	windowW = screen->w;
+  if (windowH < screen->h)
+	windowH = screen->h;
+
+  if (mapview->layer == NULL || mapview->layer->w != windowW || mapview->layer->h != windowH ||
+	  mapview->layer->format->BitsPerPixel != format->BitsPerPixel)
+  {
+	if (mapview->layer != NULL)
+	  SDL_FreeSurface(mapview->layer);
+	mapview->layer = SDL_CreateRGBSurface(SDL_SWSURFACE, windowW, windowH, format->BitsPerPixel,
+										  format->Rmask, format->Gmask, format->Bmask, format->Amask);
+  }
+
+  mapview->layerX = mapview->offsetX - (windowW - screen->w) / 2;
+  if (mapview->layerX > width - windowW)
+	mapview->layerX = width - windowW;
+  if (mapview->layerX < 0)
+	mapview->layerX = 0;
+  mapview->layerY = mapview->offsetY - (windowH - screen->h) / 2;
+  if (mapview->layerY > height - windowH)
+	mapview->layerY = height - windowH;
+  if (mapview->layerY < 0)
+	mapview->layerY = 0;
+
+  SDL_FillRect(mapview->layer, NULL, SDL_MapRGB(mapview->layer->format, 0, 0, 0));
+  mof_Map__drawlayer(map, mapview->layer, mapview->layerX, mapview->layerY);
+
+  mapview->map = map;
+  mapview->cells = map->map;
+}
+
+/**
+ * Start a frame.
+ * 
+ * The items of the frame must be given next (see mof_Mapview__item).
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ * @param screen  Pointer to a SDL_Surface.
+ * @param map     Pointer to a mof_Map object.
+ * @param offsetX Offset for the X coordinate.
+ * @param offsetY Offset for the Y coordinate.
+ */
+void mof_Mapview__begin(mof_Mapview *mapview, SDL_Surface *screen, mof_Map *map, int offsetX, int offsetY)
+{
+  /* check if we have a valid mof_Mapview object */
+  mof_Mapview__check(mapview);
+
+  /* scrolling move every pixel */
+  if (offsetX != mapview->offsetX || offsetY != mapview->offsetY ||
+	  screen != mapview->screen || (screen->flags & SDL_DOUBLEBUF) == SDL_DOUBLEBUF)
+	mapview->full = 1;
+
+  mapview->screen = screen;
+  mapview->offsetX = offsetX;
+  mapview->offsetY = offsetY;
+
+  /* the view left the window of the layer, or the map changed */
+  if (mapview->layer == NULL || map != mapview->map || map->map != mapview->cells ||
+	  mapview->layer->format->BitsPerPixel != screen->format->BitsPerPixel ||
+	  offsetX < mapview->layerX || offsetX + screen->w > mapview->layerX + mapview->layer->w ||
+	  offsetY < mapview->layerY || offsetY + screen->h > mapview->layerY + mapview->layer->h)
+  {
+	mof_Mapview__build(mapview, screen, map);
+	mapview->full = 1;
+  }
+
+  mapview->count = 0;
+  mapview->dirty = 0;
+}
+
+/**
+ * Add a dirty rectangle.
+ * 
+ * Rectangles overlapping are merged, too many and everything is dirty.
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ * @param rect    Rectangle (clipped to the screen).
+ */
+void mof_Mapview__mark(mof_Mapview *mapview, SDL_Rect *rect)
+{
+  SDL_Rect merged = *rect;
+  int i, left, top, right, bottom;
+
+  if (mapview->full || rect->w == 0 || rect->h == 0)
+	return;
+
+  /* every rectangle overlapping is taken out and merged into this one */
+  for (i = 0; i < mapview->dirty; )
+  {
+	if (mapview->rects[i].x < merged.x + merged.w && merged.x < mapview->rects[i].x + mapview->rects[i].w &&
+		mapview->rects[i].y < merged.y + merged.h && merged.y < mapview->rects[i].y + mapview->rects[i].h)
+	{
+	  left = (merged.x < mapview->rects[i].x) ? merged.x : mapview->rects[i].x;
+	  top = (merged.y < mapview->rects[i].y) ? merged.y : mapview->rects[i].y;
+	  right = (merged.x + merged.w > mapview->rects[i].x + mapview->rects[i].w) ? merged.x + merged.w : mapview->rects[i].x + mapview->rects[i].w;
+	  bottom = (merged.y + merged.h > mapview->rects[i].y + mapview->rects[i].h) ? merged.y + merged.h : mapview->rects[i].y + mapview->rects[i].h;
+	  merged.x = left;
+	  merged.y = top;
+	  merged.w = right - left;
+	  merged.h = bottom - top;
+
+	  /* start over, the bigger rectangle may overlap the previous ones */
+	  mapview->rects[i] = mapview->rects[--mapview->dirty];
+	  i = 0;
+	  continue;
+	}
+	i++;
+  }
+
+  if (mapview->dirty == MOF_MAPVIEW_RECTS)
+  {
+	mapview->full = 1;
+	return;
+  }
+  mapview->rects[mapview->dirty++] = merged;
+}
+
+/**
+ * Give an item of the frame.
+ * 
+ * The items are drawn in the order of their index.
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ * @param item    Index of the item (less than MOF_MAPVIEW_ITEMS).
+ * @param box     Pixels the item is drawn on (left, top, right, bottom, included).
+ * @param state   Anything changing with the look of the item (see mof_Mapview__state).
+ */
+void mof_Mapview__item(mof_Mapview *mapview, int item, const int *box, Uint32 state)
+{
+  assert(item < MOF_MAPVIEW_ITEMS);
+
+  while (mapview->count <= item)
+  {
+	mapview->items[mapview->count++].w = 0;
+  }
+
+  mof_Mapview__clip(box, mapview->screen, &mapview->items[item]);
+  mapview->changes[item] = state;
+}
+
+/**
+ * Mark a region as dirty.
+ * 
+ * For what is drawn every frame on top of the view (text).
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ * @param box     Region (left, top, right, bottom, included).
+ */
+void mof_Mapview__touch(mof_Mapview *mapview, const int *box)
+{
+  SDL_Rect rect;
+
+  mof_Mapview__clip(box, mapview->screen, &rect);
+  mof_Mapview__mark(mapview, &rect);
+}
+
+/**
+ * Draw the dirty rectangles.
+ * 
+ * The rectangles are restored from the layer, then the items over them
+ * are drawn clipped to them.
+ * 
+ * @param mapview Pointer to a mof_Mapview object.
+ * @param draw    Function drawing an item (on the screen, with the offsets).
+ * @param data    Given to the function drawing the items.
+ */
+void mof_Mapview__draw(mof_Mapview *mapview, void (*draw)(void *data, int item, int offsetX, int offsetY), void *data)
+{
+  SDL_Surface *screen = mapview->screen;
+  SDL_Rect *rect, source, destination;
+  int i, items = (mapview->count > mapview->drawn) ? mapview->count : mapview->drawn;
+
+  /* check if we have a valid mof_Mapview object */
+  mof_Mapview__check(mapview);
+
+  /* items moved, changed, gone or new: before and after */
+  for (i = 0; i < items; i++)
+  {
+	if (i >= mapview->count)
+	{
+	  mof_Mapview__mark(mapview, &mapview->boxes[i]);
+	}
+	else if (i >= mapview->drawn || mapview->changes[i] != mapview->states[i] ||
+			 mapview->items[i].x != mapview->boxes[i].x || mapview->items[i].y != mapview->boxes[i].y ||
+			 mapview->items[i].w != mapview->boxes[i].w || mapview->items[i].h != mapview->boxes[i].h)
+	{
+	  if (i < mapview->drawn)
+		mof_Mapview__mark(mapview, &mapview->boxes[i]);
+	  mof_Mapview__mark(mapview, &mapview->items[i]);
+	}
+  }
+
+  if (mapview->full)
+  {
+	mapview->rects[0].x = 0;
+	mapview->rects[0].y = 0;
+	mapview->rects[0].w = screen->w;
+	mapview->rects[0].h = screen->h;
+	mapview->dirty = 1;
+  }
+
+  for (rect = mapview->rects; rect < mapview->rects + mapview->dirty; rect++)
+  {
+	SDL_SetClipRect(screen, rect);
+
+	source = *rect;
+	source.x += mapview->offsetX - mapview->layerX;
+	source.y += mapview->offsetY - mapview->layerY;
+	destination = *rect;
+	SDL_BlitSurface(mapview->layer, &source, screen, &destination);
+
+	for (i = 0; i < mapview->count; i++)
+	{
+	  if (mapview->items[i].w != 0 &&
+		  mapview->items[i].x < rect->x + rect->w && rect->x < mapview->items[i].x + mapview->items[i].w &&
+		  mapview->items[i].y < rect->y + rect->h && rect->y < mapview->items[i].y + mapview->items[i].h)
+		draw(data, i, mapview->offsetX, mapview->offsetY);
+	}
+  }
+  SDL_SetClipRect(screen, NULL);
+
+  memcpy(mapview->boxes, mapview->items, mapview->count * sizeof(SDL_Rect));
+  memcpy(mapview->states, mapview->changes, mapview->count * sizeof(Uint32));
+  mapview->drawn = mapview->count;
+}
+
+/**
+ * Send the dirty rectangles to the display.
+ * 
+ * @param mapview Pointer to a mof_Mapview object (drawn).
+ */
+void mof_Mapview__present(mof_Mapview *mapview)
+{
+  /* check if we have a valid mof_Mapview object */
+  mof_Mapview__check(mapview);
+
+  if (mapview->full)
+	SDL_Flip(mapview->screen);
+  else if (mapview->dirty > 0)
+	SDL_UpdateRects(mapview->screen, mapview->dirty, mapview->rects);
+
+  mapview->full = 0;
+}
+
+#endif
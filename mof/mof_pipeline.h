@@ -0,0 +1,284 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.00
+ * @since 2012-02-24
+ * 
+ * This class run the frames through three stages at the same time: while
+ * a frame is updated (the calling thread), the previous one is built (a
+ * thread) and the one before is rasterized (another thread), then presented
+ * by the calling thread (SDL want the events and the video on the thread
+ * that initialized it).  Every frame in flight use its own slot, so stages
+ * never share a frame: a slot is updated again once presented.  The depth
+ * is the number of frames in flight, 1 run every stage in sequence on the
+ * calling thread; the deeper, the more the stages overlap but the older
+ * the frame presented is (latency).
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include "SDL.h"
+#include "SDL_thread.h"
+
+#ifndef MOF_PIPELINE_H_
+#define MOF_PIPELINE_H_
+
+#define MOF_PIPELINE_TYPE (1<<17)		/* dynamic type checking */
+#define MOF_PIPELINE_DEPTH 3			/* most frames in flight (one per stage) */
+
+/**
+ * mof_Pipeline class.
+ */
+typedef struct {
+  unsigned int type;
+  int depth;						/* frames in flight (slots) */
+  void *data;						/* given to every stage */
+  void (*update)(void *data, int slot);		/* calling thread */
+  void (*build)(void *data, int slot);		/* builder thread */
+  void (*rasterize)(void *data, int slot);	/* rasterizer thread */
+  void (*present)(void *data, int slot);	/* calling thread */
+  SDL_Thread *builder;
+  SDL_Thread *rasterizer;
+  SDL_sem *updated;					/* posted when a frame is updated */
+  SDL_sem *built;					/* posted when a frame is built */
+  SDL_sem *rasterized;				/* posted when a frame is rasterized */
+  int frames;						/* frames updated */
+  int presented;					/* frames presented */
+  int running;
+} mof_Pipeline;
+
+/**
+ * Main loop of the builder thread.
+ * 
+ * @param data Pointer to a mof_Pipeline object.
+ * @return     0 (meaning we're done)
+ */
+int mof_Pipeline__builder(void *data)
+{
+  mof_Pipeline *pipeline = data;
+  int frame;
+
+  for (frame = 0; ; frame++)
+  {
+	SDL_SemWait(pipeline->updated);
+	if (!pipeline->running)
+	  break;
+
+	pipeline->build(pipeline->data, frame % pipeline->depth);
+	SDL_SemPost(pipeline->built);
+  }
+
+  return 0;
+}
+
+/**
+ * Main loop of the rasterizer thread.
+ * 
+ * @param data Pointer to a mof_Pipeline object.
+ * @return     0 (meaning we're done)
+ */
+int mof_Pipeline__rasterizer(void *data)
+{
+  mof_Pipeline *pipeline = data;
+  int frame;
+
+  for (frame = 0; ; frame++)
+  {
+	SDL_SemWait(pipeline->built);
+	if (!pipeline->running)
+	  break;
+
+	pipeline->rasterize(pipeline->data, frame % pipeline->depth);
+	SDL_SemPost(pipeline->rasterized);
+  }
+
+  return 0;
+}
+
+/**
+ * Constructor.
+ * 
+ * @param pipeline  Pointer to a mof_Pipeline object.
+ * @param depth     Frames in flight (1 to MOF_PIPELINE_DEPTH).
+ * @param data      Data given to every stage.
+ * @param update    Stage updating a slot (simulation, calling thread).
+ * @param build     Stage building a slot (render commands).
+ * @param rasterize Stage rasterizing a slot.
+ * @param present   Stage presenting a slot (calling thread).
+ */
+void mof_Pipeline__construct(mof_Pipeline *pipeline, int depth, void *data, void (*update)(void *, int), void (*build)(void *, int),
+							 void (*rasterize)(void *, int), void (*present)(void *, int))
+{
+  /* here OR the MOF_PIPELINE_TYPE constant into the type */
+  pipeline->type |= MOF_PIPELINE_TYPE;
+
+  if (depth < 1)
+	depth = 1;
+  if (depth > MOF_PIPELINE_DEPTH)
+	depth = MOF_PIPELINE_DEPTH;
+
+  pipeline->depth = depth;
+  pipeline->data = data;
+  pipeline->update = update;
+  pipeline->build = build;
+  pipeline->rasterize = rasterize;
+  pipeline->present = present;
+  pipeline->frames = 0;
+  pipeline->presented = 0;
+  pipeline->running = 1;
+  pipeline->updated = NULL;
+  pipeline->built = NULL;
+  pipeline->rasterized = NULL;
+  pipeline->builder = NULL;
+  pipeline->rasterizer = NULL;
+
+  /* everything on the calling thread */
+  if (depth == 1)
+	return;
+
+  pipeline->updated = SDL_CreateSemaphore(0);
+  pipeline->built = SDL_CreateSemaphore(0);
+  pipeline->rasterized = SDL_CreateSemaphore(0);
+  pipeline->builder = SDL_CreateThread(mof_Pipeline__builder, pipeline);
+  pipeline->rasterizer = SDL_CreateThread(mof_Pipeline__rasterizer, pipeline);
+}
+
+/**
+ * New.
+ * 
+ * @param depth     Frames in flight (1 to MOF_PIPELINE_DEPTH).
+ * @param data      Data given to every stage.
+ * @param update    Stage updating a slot (simulation, calling thread).
+ * @param build     Stage building a slot (render commands).
+ * @param rasterize Stage rasterizing a slot.
+ * @param present   Stage presenting a slot (calling thread).
+ * @return          An object mof_Pipeline.
+ */
+mof_Pipeline *mof_Pipeline__new(int depth, void *data, void (*update)(void *, int), void (*build)(void *, int),
+								void (*rasterize)(void *, int), void (*present)(void *, int))
+{
+  mof_Pipeline *pipeline = malloc(sizeof(mof_Pipeline));
+  pipeline->type = MOF_PIPELINE_TYPE;
+
+  /* call the constructor */
+  mof_Pipeline__construct(pipeline, depth, data, update, build, rasterize, present);
+
+  return pipeline;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param pipeline Pointer to a mof_Pipeline object.
+ */
+void mof_Pipeline__check(mof_Pipeline *pipeline)
+{
+  /* check if we have a valid mof_Pipeline object */
+  if (pipeline == NULL ||
+	  !(pipeline->type & MOF_PIPELINE_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Present the oldest frame in flight.
+ * 
+ * Wait for the frame to be rasterized.
+ * 
+ * @param pipeline Pointer to a mof_Pipeline object.
+ */
+void mof_Pipeline__presentoldest(mof_Pipeline *pipeline)
+{
+  SDL_SemWait(pipeline->rasterized);
+  pipeline->present(pipeline->data, pipeline->presented % pipeline->depth);
+  pipeline->presented++;
+}
+
+/**
+ * Present every frame in flight.
+ * 
+ * @param pipeline Pointer to a mof_Pipeline object.
+ */
+void mof_Pipeline__flush(mof_Pipeline *pipeline)
+{
+  /* check if we have a valid mof_Pipeline object */
+  mof_Pipeline__check(pipeline);
+
+  while (pipeline->presented < pipeline->frames)
+  {
+	mof_Pipeline__presentoldest(pipeline);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * The frames in flight are presented first.
+ * 
+ * @param pipeline Pointer to a mof_Pipeline object.
+ */
+void mof_Pipeline__destroy(mof_Pipeline *pipeline)
+{
+  /* check if we have a valid mof_Pipeline object */
+  mof_Pipeline__check(pipeline);
+
+  mof_Pipeline__flush(pipeline);
+
+  /* set type to 0 indicate this is no longer a mof_Pipeline object */
+  pipeline->type = 0;
+
+  if (pipeline->depth > 1)
+  {
+	/* wake up the threads so they can quit */
+	pipeline->running = 0;
+	SDL_SemPost(pipeline->updated);
+	SDL_WaitThread(pipeline->builder, NULL);
+	SDL_SemPost(pipeline->built);
+	SDL_WaitThread(pipeline->rasterizer, NULL);
+
+	SDL_DestroySemaphore(pipeline->updated);
+	SDL_DestroySemaphore(pipeline->built);
+	SDL_DestroySemaphore(pipeline->rasterized);
+  }
+
+  /* free the memory allocated for the object */
+  free(pipeline);
+}
+
+/**
+ * Run a frame.
+ * 
+ * The next slot is updated and handed to the builder, then, if as many
+ * frames as the depth are in flight, the oldest one is presented.
+ * 
+ * @param pipeline Pointer to a mof_Pipeline object.
+ */
+void mof_Pipeline__frame(mof_Pipeline *pipeline)
+{
+  int slot;
+
+  /* check if we have a valid mof_Pipeline object */
+  mof_Pipeline__check(pipeline);
+
+  slot = pipeline->frames % pipeline->depth;
+  pipeline->update(pipeline->data, slot);
+  pipeline->frames++;
+
+  if (pipeline->depth == 1)
+  {
+	pipeline->build(pipeline->data, slot);
+	pipeline->rasterize(pipeline->data, slot);
+	pipeline->present(pipeline->data, slot);
+	pipeline->presented++;
+	return;
+  }
+
+  SDL_SemPost(pipeline->updated);
+  if (pipeline->frames - pipeline->presented == pipeline->depth)
+	mof_Pipeline__presentoldest(pipeline);
+}
+
+#endif
@@ -1,6 +1,6 @@
 /**
  * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
- * @version 1.20
+ * @version 1.50
  * @since 2012-01-21
  */
  
@@ -111,61 +111,14 @@ void mof_Player__destroy(mof_Player *player)
 void mof_Player__moveforward(mof_Player *player, mof_Map *level)
 {
   /* check if we have a valid mof_Player object */
-  mof_Player__check(player);	
-	
-  mof_Avatar__moveforward(((mof_Avatar *)player));
+  mof_Player__check(player);
   
-  mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
+  mof_Avatar *avatar = (mof_Avatar *)player;
+  mof_Avatar__moveforward(avatar);
   
   /* handling collision */
-  int flag = 0;
-  mof_Collisionbox *bkup = NULL;
-  for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-  {
-	if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-	{
-		  
-	  /* resolve collision */
-	  mof_Avatar__movebackward(((mof_Avatar *)player));
-	  ((mof_Avatar *)player)->x += (cos(((mof_Avatar *)player)->angle * M_PI / 180) * 1);
-	  mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
-	  bkup = level->collision->current;
-	  for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-	  {
-		if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-		{
-		  flag = 1;
-		}
-	  }
-		
-	  if (flag)
-	  {
-		flag = 0;
-		((mof_Avatar *)player)->x -= (cos(((mof_Avatar *)player)->angle * M_PI / 180) * 1);
-		((mof_Avatar *)player)->y -= (sin(((mof_Avatar *)player)->angle * M_PI / 180) * 1);
-		mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
-		for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-		{	  
-		  if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-		  {
-			flag = 1;  
-		  }
-		}
-	  }
-		
-	  if (flag)
-	  {
-		flag = 0;
-		((mof_Avatar *)player)->y += (sin(((mof_Avatar *)player)->angle * M_PI / 180) * 1);
-		mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);	
-	  }
-		
-	  level->collision->current = bkup;
-	  /* resolve collision */
-		
-    }
-  }
-  /* handling collision */
+  mof_Avatar__collide(avatar, player->collision, level, mof_Avatar__movebackward, 
+					  cos(avatar->angle * M_PI / 180) * 1, -(sin(avatar->angle * M_PI / 180) * 1));
 }
 
 /**
@@ -177,61 +130,14 @@ void mof_Player__moveforward(mof_Player *player, mof_Map *level)
 void mof_Player__movebackward(mof_Player *player, mof_Map *level)
 {
   /* check if we have a valid mof_Player object */
-  mof_Player__check(player);	
-	
-  mof_Avatar__movebackward(((mof_Avatar *)player));
+  mof_Player__check(player);
   
-  mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
+  mof_Avatar *avatar = (mof_Avatar *)player;
+  mof_Avatar__movebackward(avatar);
   
   /* handling collision */
-  int flag = 0;
-  mof_Collisionbox *bkup = NULL;
-  for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-  {
-	if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-	{
-		  
-	  /* resolve collision */
-	  mof_Avatar__moveforward(((mof_Avatar *)player));
-	  ((mof_Avatar *)player)->x -= (cos(((mof_Avatar *)player)->angle * M_PI / 180) * 1);
-	  mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
-	  bkup = level->collision->current;
-	  for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-	  {
-		if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-		{
-		  flag = 1;
-		}
-	  }
-		
-	  if (flag)
-	  {
-		flag = 0;
-		((mof_Avatar *)player)->x += (cos(((mof_Avatar *)player)->angle * M_PI / 180) * 1);
-		((mof_Avatar *)player)->y += (sin(((mof_Avatar *)player)->angle * M_PI / 180) * 1);
-		mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
-		for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-		{	  
-		  if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-		  {
-			flag = 1;  
-		  }
-		}
-	  }
-		
-	  if (flag)
-	  {
-		flag = 0;
-		((mof_Avatar *)player)->y -= (sin(((mof_Avatar *)player)->angle * M_PI / 180) * 1);
-		mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);	
-	  }
-		
-	  level->collision->current = bkup;
-	  /* resolve collision */
-		
-    }
-  }
-  /* handling collision */
+  mof_Avatar__collide(avatar, player->collision, level, mof_Avatar__moveforward, 
+					  -(cos(avatar->angle * M_PI / 180) * 1), sin(avatar->angle * M_PI / 180) * 1);
 }
 
 /**
@@ -243,61 +149,14 @@ void mof_Player__movebackward(mof_Player *player, mof_Map *level)
 void mof_Player__moveleft(mof_Player *player, mof_Map *level)
 {
   /* check if we have a valid mof_Player object */
-  mof_Player__check(player);	
-	
-  mof_Avatar__moveleft(((mof_Avatar *)player));
+  mof_Player__check(player);
   
-  mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
+  mof_Avatar *avatar = (mof_Avatar *)player;
+  mof_Avatar__moveleft(avatar);
   
   /* handling collision */
-  int flag = 0;
-  mof_Collisionbox *bkup = NULL;
-  for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-  {
-	if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-	{
-		  
-	  /* resolve collision */
-	  mof_Avatar__moveright(((mof_Avatar *)player));
-	  ((mof_Avatar *)player)->x += (cos((((mof_Avatar *)player)->angle + 90) * M_PI / 180) * 1);
-	  mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
-	  bkup = level->collision->current;
-	  for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-	  {
-		if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-		{
-		  flag = 1;
-		}
-	  }
-		
-	  if (flag)
-	  {
-		flag = 0;
-		((mof_Avatar *)player)->x -= (cos((((mof_Avatar *)player)->angle + 90) * M_PI / 180) * 1);
-		((mof_Avatar *)player)->y -= (sin((((mof_Avatar *)player)->angle + 90) * M_PI / 180) * 1);
-		mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
-		for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-		{	  
-		  if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-		  {
-			flag = 1;  
-		  }
-		}
-	  }
-		
-	  if (flag)
-	  {
-		flag = 0;
-		((mof_Avatar *)player)->y += (sin((((mof_Avatar *)player)->angle + 90) * M_PI / 180) * 1);
-		mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);	
-	  }
-		
-	  level->collision->current = bkup;
-	  /* resolve collision */
-		
-    }
-  }
-  /* handling collision */
+  mof_Avatar__collide(avatar, player->collision, level, mof_Avatar__moveright, 
+					  cos((avatar->angle + 90) * M_PI / 180) * 1, -(sin((avatar->angle + 90) * M_PI / 180) * 1));
 }
 
 /**
@@ -309,61 +168,14 @@ void mof_Player__moveleft(mof_Player *player, mof_Map *level)
 void mof_Player__moveright(mof_Player *player, mof_Map *level)
 {
   /* check if we have a valid mof_Player object */
-  mof_Player__check(player);	
-	
-  mof_Avatar__moveright(((mof_Avatar *)player));
+  mof_Player__check(player);
   
-  mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
+  mof_Avatar *avatar = (mof_Avatar *)player;
+  mof_Avatar__moveright(avatar);
   
   /* handling collision */
-  int flag = 0;
-  mof_Collisionbox *bkup = NULL;
-  for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-  {
-	if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-	{
-		  
-	  /* resolve collision */
-	  mof_Avatar__moveleft(((mof_Avatar *)player));
-	  ((mof_Avatar *)player)->x += (cos((((mof_Avatar *)player)->angle - 90) * M_PI / 180) * 1);
-	  mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
-	  bkup = level->collision->current;
-	  for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-	  {
-		if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-		{
-		  flag = 1;
-		}
-	  }
-		
-	  if (flag)
-	  {
-		flag = 0;
-		((mof_Avatar *)player)->x -= (cos((((mof_Avatar *)player)->angle - 90) * M_PI / 180) * 1);
-		((mof_Avatar *)player)->y -= (sin((((mof_Avatar *)player)->angle - 90) * M_PI / 180) * 1);
-		mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);
-		for (level->collision->current = level->collision->first->next; level->collision->current != NULL; level->collision->current = level->collision->current->next)
-		{	  
-		  if (mof_Collisionbox__intersect(player->collision, level->collision->current))
-		  {
-			flag = 1;  
-		  }
-		}
-	  }
-		
-	  if (flag)
-	  {
-		flag = 0;
-		((mof_Avatar *)player)->y += (sin((((mof_Avatar *)player)->angle - 90) * M_PI / 180) * 1);
-		mof_Collisionbox__move(player->collision, (int)((mof_Avatar *)player)->x - 10, (int)((mof_Avatar *)player)->y - 10);	
-	  }
-		
-	  level->collision->current = bkup;
-	  /* resolve collision */
-		
-    }
-  }
-  /* handling collision */
+  mof_Avatar__collide(avatar, player->collision, level, mof_Avatar__moveleft, 
+					  cos((avatar->angle - 90) * M_PI / 180) * 1, -(sin((avatar->angle - 90) * M_PI / 180) * 1));
 }
 
 /**
@@ -438,4 +250,21 @@ void mof_Player__draw(mof_Player *player, int offsetX, int offsetY)
   lineRGBA(player->screen, arrow2X, arrow2Y, lineX, lineY, 0, 255, 0, 255);
 }
 
+/**
+ * Pixels the player is drawn on (see mof_Player__draw).
+ * 
+ * @param player  Pointer to a mof_Player object.
+ * @param offsetX Offset for the X coordinate.
+ * @param offsetY Offset for the Y coordinate.
+ * @param box     Left, top, right and bottom pixels (included).
+ */
+void mof_Player__box(mof_Player *player, int offsetX, int offsetY, int *box)
+{
+  /* the arrow is 20 pixels long, one more pixel around for the rounding */
+  box[0] = (int)floor(((mof_Avatar *)player)->x) - 21 - offsetX;
+  box[1] = (int)floor(((mof_Avatar *)player)->y) - 21 - offsetY;
+  box[2] = (int)floor(((mof_Avatar *)player)->x) + 21 - offsetX;
+  box[3] = (int)floor(((mof_Avatar *)player)->y) + 21 - offsetY;
+}
+
 #endif
\ No newline at end of file
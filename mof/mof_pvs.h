@@ -0,0 +1,735 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.10
+ * @since 2012-02-20
+ * 
+ * Potentially visible set of every cell of a mof_Map: the cells reached by
+ * a line of sight leaving any point of the cell (and the walls stopping
+ * them).  The set is found with a precise permissive field of view, one
+ * quadrant at a time: the lines of sight still open are kept as views
+ * (between a shallow and a steep line) narrowed by the corners of the walls
+ * met, so no cell is missed between two rays.  A line passing where two
+ * walls touch is kept too, the set can only be larger than what is seen.
+ * The set of every cell is a bitset compressed with a run length of the
+ * zero bytes.  It is computed in parallel by a mof_Threadpool and can be
+ * cached in a file, next to the map.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mof_map.h"
+#include "mof_threadpool.h"
+
+#ifndef MOF_PVS_H_
+#define MOF_PVS_H_
+
+#define MOF_PVS_TYPE (1<<13)		/* dynamic type checking */
+#define MOF_PVS_MAGIC 0x5356504D	/* "MPVS" */
+#define MOF_PVS_VERSION 2
+
+/**
+ * mof_Pvs class.
+ */
+typedef struct {
+  unsigned int type;
+  int width;						/* dimension of the map in square(s) */
+  int height;
+  int unit;
+  int bytes;						/* size of a bitset (uncompressed) */
+  int *offsets;						/* compressed bitset of every cell (one more for the end) */
+  unsigned char *data;
+  unsigned int checksum;			/* of the map the sets were computed for */
+  mof_Map *map;						/* only while computing */
+  unsigned char **rows;
+  int *lengths;
+} mof_Pvs;
+
+/**
+ * Line of a view, through two corners of cells (in the quadrant).
+ */
+typedef struct {
+  int xi;
+  int yi;
+  int xf;
+  int yf;
+} mof_Pvsline;
+
+/**
+ * Corner of a wall narrowing a view (the bumps of a view are a list).
+ */
+typedef struct {
+  int x;
+  int y;
+  int parent;						/* previous bump of the view (-1 for none) */
+} mof_Pvsbump;
+
+/**
+ * Lines of sight still open in a quadrant, above the shallow line and
+ * below the steep line.
+ */
+typedef struct {
+  mof_Pvsline shallow;
+  mof_Pvsline steep;
+  int shallowbump;					/* last bump of every line (-1 for none) */
+  int steepbump;
+} mof_Pvsview;
+
+/**
+ * Views of a quadrant being scanned.
+ */
+typedef struct {
+  mof_Pvsview *views;
+  int count;
+  int capacity;
+  mof_Pvsbump *bumps;
+  int bumpcount;
+  int bumpcapacity;
+} mof_Pvsquadrant;
+
+/**
+ * Checksum of a map.
+ * 
+ * @param map Pointer to a mof_Map object.
+ * @return    FNV-1a hash of the dimension and the cells.
+ */
+unsigned int mof_Pvs__checksum(mof_Map *map)
+{
+  unsigned int hash = 2166136261u;
+  int i;
+
+  hash = (hash ^ map->width) * 16777619u;
+  hash = (hash ^ map->height) * 16777619u;
+  hash = (hash ^ map->unit) * 16777619u;
+  for (i = 0; i < map->width * map->height; i++)
+  {
+	hash = (hash ^ (map->map[i] != 0)) * 16777619u;
+  }
+
+  return hash;
+}
+
+/**
+ * Compress a bitset.
+ * 
+ * Non zero bytes are copied, a zero byte is followed by the number of zero
+ * bytes in the run (255 at most).
+ * 
+ * @param bits        Bitset.
+ * @param bytes       Size of the bitset.
+ * @param compressed  Compressed bitset (2 * bytes at most).
+ * @return            Size of the compressed bitset.
+ */
+int mof_Pvs__compress(const unsigned char *bits, int bytes, unsigned char *compressed)
+{
+  int i = 0, length = 0, run;
+
+  while (i < bytes)
+  {
+	if (bits[i])
+	{
+	  compressed[length++] = bits[i++];
+	  continue;
+	}
+
+	for (run = 0; i < bytes && !bits[i] && run < 255; i++, run++);
+	compressed[length++] = 0;
+	compressed[length++] = run;
+  }
+
+  return length;
+}
+
+/**
+ * Side of a point relative to a line.
+ * 
+ * @param line Pointer to a mof_Pvsline.
+ * @param x    Coordinate of the point (in the quadrant).
+ * @param y    Coordinate of the point (in the quadrant).
+ * @return     Positive above the line, negative below, 0 on it.
+ */
+int mof_Pvs__side(const mof_Pvsline *line, int x, int y)
+{
+  return (line->yf - line->yi) * (line->xf - x) - (line->xf - line->xi) * (line->yf - y);
+}
+
+/**
+ * Add a bump to a quadrant.
+ * 
+ * @param quadrant Pointer to a mof_Pvsquadrant.
+ * @param x        Coordinate of the corner (in the quadrant).
+ * @param y        Coordinate of the corner (in the quadrant).
+ * @param parent   Previous bump of the line (-1 for none).
+ * @return         Index of the bump.
+ */
+int mof_Pvs__bump(mof_Pvsquadrant *quadrant, int x, int y, int parent)
+{
+  if (quadrant->bumpcount == quadrant->bumpcapacity)
+  {
+	quadrant->bumpcapacity *= 2;
+	quadrant->bumps = realloc(quadrant->bumps, quadrant->bumpcapacity * sizeof(mof_Pvsbump));
+  }
+
+  quadrant->bumps[quadrant->bumpcount].x = x;
+  quadrant->bumps[quadrant->bumpcount].y = y;
+  quadrant->bumps[quadrant->bumpcount].parent = parent;
+
+  return quadrant->bumpcount++;
+}
+
+/**
+ * Narrow the shallow side of a view by the top left corner of a wall.
+ * 
+ * The shallow line then pivot on the steep bumps left below it.
+ * 
+ * @param quadrant Pointer to a mof_Pvsquadrant.
+ * @param index    Index of the view.
+ * @param x        Coordinate of the corner (in the quadrant).
+ * @param y        Coordinate of the corner (in the quadrant).
+ */
+void mof_Pvs__shallowbump(mof_Pvsquadrant *quadrant, int index, int x, int y)
+{
+  int bump = mof_Pvs__bump(quadrant, x, y, quadrant->views[index].shallowbump);
+  mof_Pvsview *view = &quadrant->views[index];
+
+  view->shallow.xf = x;
+  view->shallow.yf = y;
+  view->shallowbump = bump;
+  for (bump = view->steepbump; bump >= 0; bump = quadrant->bumps[bump].parent)
+  {
+	if (mof_Pvs__side(&view->shallow, quadrant->bumps[bump].x, quadrant->bumps[bump].y) < 0)
+	{
+	  view->shallow.xi = quadrant->bumps[bump].x;
+	  view->shallow.yi = quadrant->bumps[bump].y;
+	}
+  }
+}
+
+/**
+ * Narrow the steep side of a view by the bottom right corner of a wall.
+ * 
+ * The steep line then pivot on the shallow bumps left above it.
+ * 
+ * @param quadrant Pointer to a mof_Pvsquadrant.
+ * @param index    Index of the view.
+ * @param x        Coordinate of the corner (in the quadrant).
+ * @param y        Coordinate of the corner (in the quadrant).
+ */
+void mof_Pvs__steepbump(mof_Pvsquadrant *quadrant, int index, int x, int y)
+{
+  int bump = mof_Pvs__bump(quadrant, x, y, quadrant->views[index].steepbump);
+  mof_Pvsview *view = &quadrant->views[index];
+
+  view->steep.xf = x;
+  view->steep.yf = y;
+  view->steepbump = bump;
+  for (bump = view->shallowbump; bump >= 0; bump = quadrant->bumps[bump].parent)
+  {
+	if (mof_Pvs__side(&view->steep, quadrant->bumps[bump].x, quadrant->bumps[bump].y) > 0)
+	{
+	  view->steep.xi = quadrant->bumps[bump].x;
+	  view->steep.yi = quadrant->bumps[bump].y;
+	}
+  }
+}
+
+/**
+ * Remove a view that closed.
+ * 
+ * A view is closed when its two lines are the same line through a corner
+ * of the cell of the viewer (no line of sight left in it).
+ * 
+ * @param quadrant Pointer to a mof_Pvsquadrant.
+ * @param index    Index of the view.
+ * @return         True (1) if the view is still open, false (0) if removed.
+ */
+int mof_Pvs__checkview(mof_Pvsquadrant *quadrant, int index)
+{
+  mof_Pvsview *view = &quadrant->views[index];
+
+  if (mof_Pvs__side(&view->shallow, view->steep.xi, view->steep.yi) == 0 &&
+	  mof_Pvs__side(&view->shallow, view->steep.xf, view->steep.yf) == 0 &&
+	  (mof_Pvs__side(&view->shallow, 0, 1) == 0 || mof_Pvs__side(&view->shallow, 1, 0) == 0))
+  {
+	quadrant->count--;
+	memmove(view, view + 1, (quadrant->count - index) * sizeof(mof_Pvsview));
+	return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Visit a cell of a quadrant.
+ * 
+ * The cell is visible if it is in a view, then a wall narrow (or split or
+ * close) the view it is in.
+ * 
+ * @param quadrant Pointer to a mof_Pvsquadrant.
+ * @param map      Pointer to a mof_Map object.
+ * @param x        Coordinate of the cell (in the quadrant).
+ * @param y        Coordinate of the cell (in the quadrant).
+ * @param cell     Index of the cell in the map array.
+ * @param bits     Bitset of the visible cells.
+ */
+void mof_Pvs__visit(mof_Pvsquadrant *quadrant, mof_Map *map, int x, int y, int cell, unsigned char *bits)
+{
+  int index = 0, below, above;
+
+  /* the views are sorted from the shallow one, skip those under the cell */
+  while (index < quadrant->count && mof_Pvs__side(&quadrant->views[index].steep, x + 1, y) >= 0)
+	index++;
+  if (index == quadrant->count || mof_Pvs__side(&quadrant->views[index].shallow, x, y + 1) <= 0)
+	return;
+
+  bits[cell >> 3] |= 1 << (cell & 7);
+  if (!map->map[cell])
+	return;
+
+  below = (mof_Pvs__side(&quadrant->views[index].shallow, x + 1, y) < 0);
+  above = (mof_Pvs__side(&quadrant->views[index].steep, x, y + 1) > 0);
+  if (below && above)
+  {
+	/* the wall cover the whole view */
+	quadrant->count--;
+	memmove(quadrant->views + index, quadrant->views + index + 1, (quadrant->count - index) * sizeof(mof_Pvsview));
+  }
+  else if (below)
+  {
+	mof_Pvs__shallowbump(quadrant, index, x, y + 1);
+	mof_Pvs__checkview(quadrant, index);
+  }
+  else if (above)
+  {
+	mof_Pvs__steepbump(quadrant, index, x + 1, y);
+	mof_Pvs__checkview(quadrant, index);
+  }
+  else
+  {
+	/* the wall is in the middle, the view is split in two */
+	if (quadrant->count == quadrant->capacity)
+	{
+	  quadrant->capacity *= 2;
+	  quadrant->views = realloc(quadrant->views, quadrant->capacity * sizeof(mof_Pvsview));
+	}
+	memmove(quadrant->views + index + 1, quadrant->views + index, (quadrant->count - index) * sizeof(mof_Pvsview));
+	quadrant->count++;
+
+	mof_Pvs__steepbump(quadrant, index, x + 1, y);
+	if (mof_Pvs__checkview(quadrant, index))
+	  index++;
+	mof_Pvs__shallowbump(quadrant, index, x, y + 1);
+	mof_Pvs__checkview(quadrant, index);
+  }
+}
+
+/**
+ * Compute the visible cells of a quadrant.
+ * 
+ * In the quadrant the cell of the viewer is (0, 0) to (1, 1) and the cells
+ * are visited one diagonal at a time, going away from it.
+ * 
+ * @param quadrant Pointer to a mof_Pvsquadrant (views allocated).
+ * @param map      Pointer to a mof_Map object.
+ * @param cell     Index of the cell of the viewer in the map array.
+ * @param dx       Direction of the quadrant on the map (1 or -1).
+ * @param dy       Direction of the quadrant on the map (1 or -1).
+ * @param bits     Bitset of the visible cells.
+ */
+void mof_Pvs__quadrant(mof_Pvsquadrant *quadrant, mof_Map *map, int cell, int dx, int dy, unsigned char *bits)
+{
+  int cellX = cell % map->width, cellY = cell / map->width;
+  int extentX = (dx > 0) ? map->width - 1 - cellX : cellX;
+  int extentY = (dy > 0) ? map->height - 1 - cellY : cellY;
+  int i, j, first, last;
+
+  /* every line of sight of the quadrant, from a corner of the cell */
+  quadrant->count = 1;
+  quadrant->bumpcount = 0;
+  quadrant->views[0].shallow.xi = 0;
+  quadrant->views[0].shallow.yi = 1;
+  quadrant->views[0].shallow.xf = extentX + 1;
+  quadrant->views[0].shallow.yf = 0;
+  quadrant->views[0].steep.xi = 1;
+  quadrant->views[0].steep.yi = 0;
+  quadrant->views[0].steep.xf = 0;
+  quadrant->views[0].steep.yf = extentY + 1;
+  quadrant->views[0].shallowbump = -1;
+  quadrant->views[0].steepbump = -1;
+
+  for (i = 1; i <= extentX + extentY && quadrant->count > 0; i++)
+  {
+	first = (i - extentX > 0) ? i - extentX : 0;
+	last = (i < extentY) ? i : extentY;
+	for (j = first; j <= last && quadrant->count > 0; j++)
+	{
+	  mof_Pvs__visit(quadrant, map, i - j, j, (cellX + (i - j) * dx) + (cellY + j * dy) * map->width, bits);
+	}
+  }
+}
+
+/**
+ * Compute the visible cells from a cell.
+ * 
+ * @param map  Pointer to a mof_Map object.
+ * @param cell Index of the cell in the map array.
+ * @param bits Bitset of the visible cells (cleared first).
+ */
+void mof_Pvs__visibility(mof_Map *map, int cell, unsigned char *bits)
+{
+  mof_Pvsquadrant quadrant;
+
+  memset(bits, 0, (map->width * map->height + 7) / 8);
+
+  /* nothing is seen from inside a wall */
+  if (map->map[cell])
+	return;
+
+  bits[cell >> 3] |= 1 << (cell & 7);
+
+  quadrant.capacity = 16;
+  quadrant.views = malloc(quadrant.capacity * sizeof(mof_Pvsview));
+  quadrant.bumpcapacity = 64;
+  quadrant.bumps = malloc(quadrant.bumpcapacity * sizeof(mof_Pvsbump));
+
+  mof_Pvs__quadrant(&quadrant, map, cell, 1, 1, bits);
+  mof_Pvs__quadrant(&quadrant, map, cell, 1, -1, bits);
+  mof_Pvs__quadrant(&quadrant, map, cell, -1, -1, bits);
+  mof_Pvs__quadrant(&quadrant, map, cell, -1, 1, bits);
+
+  free(quadrant.views);
+  free(quadrant.bumps);
+}
+
+/**
+ * Compute the sets of a range of cells (job of the mof_Threadpool).
+ * 
+ * @param data  Pointer to a mof_Pvs object.
+ * @param task  Index of the range.
+ * @param tasks Number of ranges.
+ */
+void mof_Pvs__job(void *data, int task, int tasks)
+{
+  mof_Pvs *pvs = data;
+  int cells = pvs->width * pvs->height;
+  int first = (int)((long long)cells * task / tasks);
+  int last = (int)((long long)cells * (task + 1) / tasks);
+  unsigned char *bits = malloc(pvs->bytes);
+  unsigned char *compressed = malloc(2 * pvs->bytes);
+  int cell;
+
+  for (cell = first; cell < last; cell++)
+  {
+	mof_Pvs__visibility(pvs->map, cell, bits);
+	pvs->lengths[cell] = mof_Pvs__compress(bits, pvs->bytes, compressed);
+	pvs->rows[cell] = malloc(pvs->lengths[cell]);
+	memcpy(pvs->rows[cell], compressed, pvs->lengths[cell]);
+  }
+
+  free(bits);
+  free(compressed);
+}
+
+/**
+ * Compute the sets of every cell.
+ * 
+ * @param pvs  Pointer to a mof_Pvs object.
+ * @param map  Pointer to a mof_Map object.
+ * @param pool Pointer to a mof_Threadpool object (or NULL).
+ */
+void mof_Pvs__build(mof_Pvs *pvs, mof_Map *map, mof_Threadpool *pool)
+{
+  int cells = pvs->width * pvs->height;
+  int cell;
+
+  pvs->map = map;
+  pvs->rows = malloc(cells * sizeof(unsigned char *));
+  pvs->lengths = malloc(cells * sizeof(int));
+
+  if (pool == NULL)
+	mof_Pvs__job(pvs, 0, 1);
+  else
+	mof_Threadpool__run(pool, mof_Pvs__job, pvs, pvs->height);
+
+  /* put the compressed sets together */
+  pvs->offsets = malloc((cells + 1) * sizeof(int));
+  pvs->offsets[0] = 0;
+  for (cell = 0; cell < cells; cell++)
+  {
+	pvs->offsets[cell + 1] = pvs->offsets[cell] + pvs->lengths[cell];
+  }
+
+  pvs->data = malloc(pvs->offsets[cells] + 1);
+  for (cell = 0; cell < cells; cell++)
+  {
+	memcpy(pvs->data + pvs->offsets[cell], pvs->rows[cell], pvs->lengths[cell]);
+	free(pvs->rows[cell]);
+  }
+
+  free(pvs->rows);
+  free(pvs->lengths);
+  pvs->rows = NULL;
+  pvs->lengths = NULL;
+  pvs->map = NULL;
+}
+
+/**
+ * Save the sets to a file.
+ * 
+ * @param pvs  Pointer to a mof_Pvs object.
+ * @param path Path of the file.
+ * @return     True (1) if the file was written, false (0) otherwise.
+ */
+int mof_Pvs__save(mof_Pvs *pvs, const char *path)
+{
+  int cells = pvs->width * pvs->height;
+  int header[6] = {MOF_PVS_MAGIC, MOF_PVS_VERSION, pvs->width, pvs->height, (int)pvs->checksum, pvs->offsets[cells]};
+  int written = 1;
+
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+	return 0;
+
+  written &= (fwrite(header, sizeof(int), 6, file) == 6);
+  written &= (fwrite(pvs->offsets, sizeof(int), cells + 1, file) == (size_t)(cells + 1));
+  written &= (fwrite(pvs->data, 1, pvs->offsets[cells], file) == (size_t)pvs->offsets[cells]);
+  fclose(file);
+
+  return written;
+}
+
+/**
+ * Load the sets from a file.
+ * 
+ * The file is only used if it was computed for the same map.
+ * 
+ * @param pvs  Pointer to a mof_Pvs object.
+ * @param path Path of the file.
+ * @return     True (1) if the sets were loaded, false (0) otherwise.
+ */
+int mof_Pvs__load(mof_Pvs *pvs, const char *path)
+{
+  int cells = pvs->width * pvs->height;
+  int header[6];
+  int loaded = 0;
+
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+	return 0;
+
+  if (fread(header, sizeof(int), 6, file) == 6 && header[0] == MOF_PVS_MAGIC && header[1] == MOF_PVS_VERSION &&
+	  header[2] == pvs->width && header[3] == pvs->height && (unsigned int)header[4] == pvs->checksum && header[5] >= 0)
+  {
+	pvs->offsets = malloc((cells + 1) * sizeof(int));
+	pvs->data = malloc(header[5] + 1);
+	loaded = (fread(pvs->offsets, sizeof(int), cells + 1, file) == (size_t)(cells + 1) && pvs->offsets[cells] == header[5] &&
+			  fread(pvs->data, 1, header[5], file) == (size_t)header[5]);
+
+	if (!loaded)
+	{
+	  free(pvs->offsets);
+	  free(pvs->data);
+	}
+  }
+  fclose(file);
+
+  return loaded;
+}
+
+/**
+ * Constructor.
+ * 
+ * The sets are loaded from the file if it match the map, otherwise they
+ * are computed and saved to the file.
+ * 
+ * @param pvs  Pointer to a mof_Pvs object.
+ * @param map  Pointer to a mof_Map object.
+ * @param pool Pointer to a mof_Threadpool object (or NULL).
+ * @param path Path of the cache file (or NULL).
+ */
+void mof_Pvs__construct(mof_Pvs *pvs, mof_Map *map, mof_Threadpool *pool, const char *path)
+{
+  /* here OR the MOF_PVS_TYPE constant into the type */
+  pvs->type |= MOF_PVS_TYPE;
+
+  pvs->width = map->width;
+  pvs->height = map->height;
+  pvs->unit = map->unit;
+  pvs->bytes = (map->width * map->height + 7) / 8;
+  pvs->checksum = mof_Pvs__checksum(map);
+  pvs->map = NULL;
+  pvs->rows = NULL;
+  pvs->lengths = NULL;
+
+  if (path != NULL && mof_Pvs__load(pvs, path))
+	return;
+
+  mof_Pvs__build(pvs, map, pool);
+  if (path != NULL)
+	mof_Pvs__save(pvs, path);
+}
+
+/**
+ * New.
+ * 
+ * @param map  Pointer to a mof_Map object.
+ * @param pool Pointer to a mof_Threadpool object (or NULL).
+ * @param path Path of the cache file (or NULL).
+ * @return     An object mof_Pvs.
+ */
+mof_Pvs *mof_Pvs__new(mof_Map *map, mof_Threadpool *pool, const char *path)
+{
+  mof_Pvs *pvs = malloc(sizeof(mof_Pvs));
+  pvs->type = MOF_PVS_TYPE;
+
+  /* call the constructor */
+  mof_Pvs__construct(pvs, map, pool, path);
+
+  return pvs;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param pvs Pointer to a mof_Pvs object.
+ */
+void mof_Pvs__check(mof_Pvs *pvs)
+{
+  /* check if we have a valid mof_Pvs object */
+  if (pvs == NULL ||
+	  !(pvs->type & MOF_PVS_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param pvs Pointer to a mof_Pvs object.
+ */
+void mof_Pvs__destroy(mof_Pvs *pvs)
+{
+  /* check if we have a valid mof_Pvs object */
+  mof_Pvs__check(pvs);
+
+  /* set type to 0 indicate this is no longer a mof_Pvs object */
+  pvs->type = 0;
+
+  /* free the memory allocated for the object */
+  free(pvs->offsets);
+  free(pvs->data);
+  free(pvs);
+}
+
+/**
+ * Cell of a point.
+ * 
+ * @param pvs Pointer to a mof_Pvs object.
+ * @param x   Coordinate of the point.
+ * @param y   Coordinate of the point.
+ * @return    Index of the cell in the map array, -1 if out of the map.
+ */
+int mof_Pvs__cell(mof_Pvs *pvs, double x, double y)
+{
+  int cellX = (int)floor(x / pvs->unit);
+  int cellY = (int)floor(y / pvs->unit);
+
+  if (cellX < 0 || cellX >= pvs->width || cellY < 0 || cellY >= pvs->height)
+	return -1;
+
+  return cellX + cellY * pvs->width;
+}
+
+/**
+ * Decompress the set of a cell.
+ * 
+ * @param pvs  Pointer to a mof_Pvs object.
+ * @param cell Index of the cell in the map array.
+ * @param bits Bitset of the visible cells (pvs->bytes).
+ */
+void mof_Pvs__decompress(mof_Pvs *pvs, int cell, unsigned char *bits)
+{
+  const unsigned char *compressed = pvs->data + pvs->offsets[cell];
+  const unsigned char *end = pvs->data + pvs->offsets[cell + 1];
+  int i = 0;
+
+  while (compressed < end)
+  {
+	if (*compressed)
+	{
+	  bits[i++] = *compressed++;
+	  continue;
+	}
+
+	memset(bits + i, 0, compressed[1]);
+	i += compressed[1];
+	compressed += 2;
+  }
+}
+
+/**
+ * Check if a cell can be seen from another.
+ * 
+ * @param pvs  Pointer to a mof_Pvs object.
+ * @param from Index of the cell of the viewer.
+ * @param to   Index of the cell to check.
+ * @return     True (1) if the cell is potentially visible, false (0) otherwise.
+ */
+int mof_Pvs__visible(mof_Pvs *pvs, int from, int to)
+{
+  const unsigned char *compressed, *end;
+  int i = 0, byte = to >> 3;
+
+  /* out of the map, nothing to cull */
+  if (from < 0 || to < 0)
+	return 1;
+
+  compressed = pvs->data + pvs->offsets[from];
+  end = pvs->data + pvs->offsets[from + 1];
+
+  while (compressed < end)
+  {
+	if (*compressed)
+	{
+	  if (i == byte)
+		return (*compressed >> (to & 7)) & 1;
+	  i++;
+	  compressed++;
+	  continue;
+	}
+
+	i += compressed[1];
+	if (i > byte)
+	  return 0;
+	compressed += 2;
+  }
+
+  return 0;
+}
+
+/**
+ * Check if a point can be seen from another.
+ * 
+ * @param pvs Pointer to a mof_Pvs object.
+ * @param x1  Coordinate of the viewer.
+ * @param y1  Coordinate of the viewer.
+ * @param x2  Coordinate of the point to check.
+ * @param y2  Coordinate of the point to check.
+ * @return    True (1) if the point is potentially visible, false (0) otherwise.
+ */
+int mof_Pvs__visiblepoint(mof_Pvs *pvs, double x1, double y1, double x2, double y2)
+{
+  /* check if we have a valid mof_Pvs object */
+  mof_Pvs__check(pvs);
+
+  return mof_Pvs__visible(pvs, mof_Pvs__cell(pvs, x1, y1), mof_Pvs__cell(pvs, x2, y2));
+}
+
+#endif
@@ -1,21 +1,126 @@
 /**
  * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
- * @version 1.40
+ * @version 2.64
  * @since 2012-01-24
  * 
  * Raycasting using the method describe at that website:
  * {@link http://www.permadi.com/tutorial/raycast/} 
+ * 
+ * The scene itself is casted with a single pass grid traversal (DDA), the
+ * horizontal and vertical intersections are found in the same loop.  The
+ * mof_Raycaster object keep the hit of every column of the scene, columns
+ * can be casted in strips by a mof_Threadpool since they are independent.
+ * Adjacent columns are casted together (AVX2) when the processor support
+ * it.  The hits of the previous frame are kept: nothing is casted
+ * if the player did not move, and only the columns that can not be deduced
+ * from the previous hits are casted if the player only turned.  With a
+ * mof_Raycaster per frame in flight, the hits of the frame before are
+ * handed forward (see mof_Raycaster__follow).
+ * 
+ * The result of a cast is published in a mof_Raycasterbuffer, one entry
+ * per column stored as a struct of arrays: the depth (viewing distortion
+ * removed), the point hit, the side, the cell and the material.  The walls,
+ * the sprites (clipping) and the minimap all read from it.
+ * 
+ * When the unit of the map is a power of two, the rays can also be casted
+ * in fixed point (16.16, in cells): finding the cell of a point is then a
+ * shift and the loop do no floating point at all.  It is the default when
+ * compiled with MOF_RAYCASTER_FIXED=1 (processors without a fast FPU).
+ * 
+ * Any number of rays can be casted through a map with mof_Raycaster__query,
+ * the hits are written to the arrays of the caller (nothing is allocated
+ * and nothing is shared, it can be called from any thread).
  */
 
 #include <math.h>
+#include <string.h>
 
-#include "mof_graphicelement.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MOF_RAYCASTER_SIMD
+#include <immintrin.h>
+#endif
+
+#include "mof_camera.h"
+#include "mof_framebuffer.h"
 #include "mof_player.h"
 #include "mof_map.h"
+#include "mof_threadpool.h"
 
 #ifndef MOF_RAYCASTER_H_
 #define MOF_RAYCASTER_H_
 
+#define MOF_RAYCASTER_TYPE (1<<10)		/* dynamic type checking */
+#define MOF_RAYCASTER_STRIPS 4			/* strips per thread (load balancing) */
+#ifndef MOF_RAYCASTER_SKIP
+#define MOF_RAYCASTER_SKIP 2			/* smallest distance field value worth a jump, minus one */
+#endif
+#define MOF_RAYCASTER_COHERENCE 0.05	/* largest gap between the directions of a packet (unit vector) */
+#define MOF_RAYCASTER_CHUNK 64			/* rays of mof_Raycaster__queryangles per query (multiple of 8) */
+#ifndef MOF_RAYCASTER_FIXED
+#define MOF_RAYCASTER_FIXED 0			/* cast in fixed point by default */
+#endif
+
+#if (MOF_MAP_UNIT & (MOF_MAP_UNIT - 1)) == 0 && MOF_MAP_UNIT <= 65536
+#define MOF_RAYCASTER_FIXEDPOINT
+#define MOF_RAYCASTER_ONE 65536						/* 1.0 in 16.16 fixed point */
+#define MOF_RAYCASTER_UNIT (1 << 30)				/* 1.0 in 2.30 fixed point (directions) */
+#define MOF_RAYCASTER_SCALE (MOF_RAYCASTER_ONE / MOF_MAP_UNIT)	/* pixel to cell (16.16) */
+#define MOF_RAYCASTER_FAR 0x3FFFFFFF				/* grid line never reached */
+#elif MOF_RAYCASTER_FIXED
+#error "MOF_RAYCASTER_FIXED need a power of two MOF_MAP_UNIT"
+#endif
+
+/**
+ * Result of a ray casted through the map.
+ */
+typedef struct {
+  double distance;			/* -1 if the ray left the map */
+  double x;					/* point of intersection */
+  double y;
+  int side;					/* 0 for an horizontal wall, 1 for a vertical wall */
+  int cell;					/* index of the wall in the map array */
+} mof_Raycasterhit;
+
+/**
+ * Depth buffer of the scene, one entry per column.
+ */
+typedef struct {
+  double *depth;			/* distance along the view direction, HUGE_VAL if the ray left the map */
+  double *x;				/* point of intersection */
+  double *y;
+  unsigned char *side;		/* 0 for an horizontal wall, 1 for a vertical wall */
+  unsigned char *material;	/* index in the materials of the map */
+  int *cell;				/* index of the wall in the map array, -1 if the ray left the map */
+} mof_Raycasterbuffer;
+
+/**
+ * mof_Raycaster class.
+ */ 
+typedef struct {
+  unsigned int type;
+  int width;				/* number of columns */
+  mof_Raycasterhit *hits;	/* hit of every column */
+  mof_Raycasterhit *previous;	/* hits of the previous frame */
+  unsigned char *stale;		/* columns to cast again */
+  mof_Raycasterbuffer buffer;	/* depth of every column (published hits) */
+  int valid;				/* true (1) if the hits match the state below */
+  mof_Threadpool *pool;		/* NULL to cast on the calling thread only */
+  int packet;				/* number of rays casted together (1, 4 or 8) */
+  int fixed;				/* cast in fixed point (1) or double precision (0) */
+  int flats;				/* textured floor and ceiling (1) or flat colors (0) */
+  int *tops;				/* wall slice drawn in every column */
+  int *bottoms;
+  mof_Camera *camera;		/* what is being casted */
+  double projection;
+  mof_Map *map;
+  int *cells;
+  double x;
+  double y;
+  int angle;
+  int castfixed;			/* fixed when the hits were casted */
+  int followed;				/* hits handed forward, not published yet */
+} mof_Raycaster;
+
 /**
  * Checking the limit of the map.
  * 
@@ -43,6 +148,9 @@ int mof_Raycaster__limit(mof_Map *map, double x, double y)
 /**
  * Horizontal intersection for the ray.
  * 
+ * The result is kept in a static array, overwritten by the next call (see
+ * mof_Raycaster__query instead).
+ * 
  * @param player Pointer to a mof_Player object.
  * @param map    Pointer to a mof_Map object.
  * @param angle  Angle of the ray casted.
@@ -117,7 +225,7 @@ double *mof_Raycaster__horizontal(mof_Player *player, mof_Map *map, double angle
 	Xa = (map->unit / tan(angle * M_PI / 180));
 
   /* check the grid at the intersection point for wall */
-  while (map->map[(int)(floor(Xnew / map->unit) + ((flag) ? floor((Ynew - 1) / map->unit) : floor(Ynew / map->unit)) * map->width)] != 1)
+  while (map->map[(int)(floor(Xnew / map->unit) + ((flag) ? floor((Ynew - 1) / map->unit) : floor(Ynew / map->unit)) * map->width)] == 0)
   {   
 	Ynew += Ya;
 	Xnew += Xa;
@@ -140,6 +248,9 @@ double *mof_Raycaster__horizontal(mof_Player *player, mof_Map *map, double angle
 /**
  * Vertical intersection for the ray.
  * 
+ * The result is kept in a static array, overwritten by the next call (see
+ * mof_Raycaster__query instead).
+ * 
  * @param player Pointer to a mof_Player object.
  * @param map    Pointer to a mof_Map object.
  * @param angle  Angle of the ray casted.
@@ -209,7 +320,7 @@ double *mof_Raycaster__vertical(mof_Player *player, mof_Map *map, double angle)
 	Ya = -((map->unit * tan(angle * M_PI / 180)));
 
   /* check the grid at the intersection point for wall */
-  while (map->map[(int)(((flag) ? floor((Xnew - 1) / map->unit) : floor(Xnew / map->unit)) + floor(Ynew / map->unit) * map->width)] != 1)
+  while (map->map[(int)(((flag) ? floor((Xnew - 1) / map->unit) : floor(Xnew / map->unit)) + floor(Ynew / map->unit) * map->width)] == 0)
   {   
 	Ynew += Ya;
 	Xnew += Xa;
@@ -230,99 +341,1541 @@ double *mof_Raycaster__vertical(mof_Player *player, mof_Map *map, double angle)
 }
 
 /**
- * Drawing the rays casted.
+ * Intersection with the last grid line crossed by the ray.
+ * 
+ * Computed from the wall cell (not accumulated along the ray), so every
+ * caster give exactly the same result for the same cell.
+ * 
+ * @param map   Pointer to a mof_Map object.
+ * @param Px    Origin of the ray.
+ * @param Py    Origin of the ray.
+ * @param dirX  Direction of the ray (unit vector).
+ * @param dirY  Direction of the ray (unit vector, Y axis pointing down).
+ * @param cellX Wall cell.
+ * @param cellY Wall cell.
+ * @param side  0 for an horizontal wall, 1 for a vertical wall.
+ * @param hit   Pointer to a mof_Raycasterhit to fill.
+ * @return      Distance to the wall.
+ */
+double mof_Raycaster__intersect(mof_Map *map, double Px, double Py, double dirX, double dirY, int cellX, int cellY, int side, mof_Raycasterhit *hit)
+{
+  if (side)
+  {
+	hit->x = (dirX > 0) ? cellX * map->unit : (cellX + 1) * map->unit;
+	hit->distance = (hit->x - Px) / dirX;
+	hit->y = Py + hit->distance * dirY;
+  }
+  else
+  {
+	hit->y = (dirY > 0) ? cellY * map->unit : (cellY + 1) * map->unit;
+	hit->distance = (hit->y - Py) / dirY;
+	hit->x = Px + hit->distance * dirX;
+  }
+  hit->side = side;
+  hit->cell = cellX + cellY * map->width;
+  
+  return hit->distance;
+}
+
+/**
+ * Skip the empty space around a cell.
+ * 
+ * All the cells closer than the distance field value are empty, so the ray
+ * can go straight to the last cell it cross in that square.  The number of
+ * grid lines crossed on the other axis is found with a single division.
  * 
- * @param player  Pointer to a mof_Player object.
- * @param map     Pointer to a mof_Map object.
- * @param offsetX Offset for the X coordinate.
- * @param offsetY Offset for the Y coordinate.
+ * @param map    Pointer to a mof_Map object.
+ * @param stepX  Direction of the ray on the grid (-1 or 1).
+ * @param stepY  Direction of the ray on the grid (-1 or 1).
+ * @param deltaX Distance along the ray between two vertical grid lines.
+ * @param deltaY Distance along the ray between two horizontal grid lines.
+ * @param cellX  Current cell (updated).
+ * @param cellY  Current cell (updated).
+ * @param sideX  Distance along the ray to the next vertical grid line (updated).
+ * @param sideY  Distance along the ray to the next horizontal grid line (updated).
  */
-mof_Raycaster__draw(mof_Player *player, mof_Map *map, int offsetX, int offsetY)
+void mof_Raycaster__skip(mof_Map *map, int stepX, int stepY, double deltaX, double deltaY, int *cellX, int *cellY, double *sideX, double *sideY)
 {
-  double *resultH, *resultV, *result;
-  double i = 0;
-  for (i = 30; i >= -30; i -= 0.9375)
+  int reach = map->distances[*cellX + *cellY * map->width] - 1;
+  int count;
+  
+  /* distance along the ray to the border of the square */
+  double exitX = *sideX + reach * deltaX;
+  double exitY = *sideY + reach * deltaY;
+  
+  if (exitX <= exitY)
   {
-    resultH = mof_Raycaster__horizontal(player, map, (double)((mof_Avatar *)player)->angle + i);
-	resultV = mof_Raycaster__vertical(player, map, (double)((mof_Avatar *)player)->angle + i);
+	/* leaving by a vertical side, count the horizontal grid lines crossed */
+	count = (*sideY < exitX) ? (int)((exitX - *sideY) / deltaY) + 1 : 0;
+	if (count > reach)
+	  count = reach;
 	
-	if (resultH[0] < 0)
-	  result = resultV;
-	else if (resultV[0] < 0)
-	  result = resultH;
-	else if (resultH[0] < resultV[0])
-	  result = resultH;
+	*cellX += reach * stepX;
+	*sideX = exitX;
+	*cellY += count * stepY;
+	*sideY += count * deltaY;
+  }
+  else
+  {
+	/* leaving by an horizontal side, count the vertical grid lines crossed */
+	count = (*sideX < exitY) ? (int)((exitY - *sideX) / deltaX) + 1 : 0;
+	if (count > reach)
+	  count = reach;
+	
+	*cellX += count * stepX;
+	*sideX += count * deltaX;
+	*cellY += reach * stepY;
+	*sideY = exitY;
+  }
+}
+
+/**
+ * Walk the grid from a given cell until a wall is found.
+ * 
+ * Empty space is skipped with the distance field of the map.
+ * 
+ * @param map   Pointer to a mof_Map object.
+ * @param Px    Origin of the ray.
+ * @param Py    Origin of the ray.
+ * @param dirX  Direction of the ray (unit vector).
+ * @param dirY  Direction of the ray (unit vector, Y axis pointing down).
+ * @param cellX Current cell (already checked).
+ * @param cellY Current cell (already checked).
+ * @param sideX Distance along the ray to the next vertical grid line.
+ * @param sideY Distance along the ray to the next horizontal grid line.
+ * @param hit   Pointer to a mof_Raycasterhit to fill.
+ * @return      Distance to the wall, -1 if the ray left the map.
+ */
+double mof_Raycaster__walk(mof_Map *map, double Px, double Py, double dirX, double dirY, int cellX, int cellY, double sideX, double sideY, mof_Raycasterhit *hit)
+{
+  int stepX = (dirX < 0) ? -1 : 1;
+  int stepY = (dirY < 0) ? -1 : 1;
+  int side = 0, space;
+  
+  /* distance along the ray between two grid lines */
+  double deltaX = (dirX == 0) ? HUGE_VAL : fabs(map->unit / dirX);
+  double deltaY = (dirY == 0) ? HUGE_VAL : fabs(map->unit / dirY);
+  
+  if (cellX >= 0 && cellX < map->width && cellY >= 0 && cellY < map->height &&
+	  map->distances[cellX + cellY * map->width] > MOF_RAYCASTER_SKIP)
+	mof_Raycaster__skip(map, stepX, stepY, deltaX, deltaY, &cellX, &cellY, &sideX, &sideY);
+  
+  /* check the grid at each cell crossed for wall */
+  while (1)
+  {
+	if (sideY < sideX)
+	{
+	  sideY += deltaY;
+	  cellY += stepY;
+	  side = 0;
+	}
 	else
-	  result = resultV;
-    
-	lineRGBA(player->screen, (int)((mof_Avatar *)player)->x - offsetX, (int)((mof_Avatar *)player)->y - offsetY, (int)result[1] - offsetX, (int)result[2] - offsetY, 255, 255, 0, 50);
+	{
+	  sideX += deltaX;
+	  cellX += stepX;
+	  side = 1;
+	}
+	
+	/* checking to see if we are not out of bound */
+	if (cellX < 0 || cellX >= map->width || cellY < 0 || cellY >= map->height)
+	{
+	  hit->distance = -1;
+	  hit->cell = -1;
+	  return -1;
+	}
+	
+	/* the distance field is 0 on the walls */
+	space = map->distances[cellX + cellY * map->width];
+	if (space == 0)
+	  break;
+	
+	if (space > MOF_RAYCASTER_SKIP)
+	  mof_Raycaster__skip(map, stepX, stepY, deltaX, deltaY, &cellX, &cellY, &sideX, &sideY);
   }
+  
+  return mof_Raycaster__intersect(map, Px, Py, dirX, dirY, cellX, cellY, side, hit);
 }
 
 /**
- * Drawing the rays casted (3D).
+ * Grid traversal (DDA) for the ray.
+ * 
+ * Walk the map one cell at a time, always stepping over the nearest of the
+ * next vertical or horizontal grid line.  The distances between two grid
+ * lines along the ray are computed once, so there is no trigonometry and no
+ * division in the loop (and no degenerate angle to escape).
+ * 
+ * @param map  Pointer to a mof_Map object.
+ * @param Px   Origin of the ray.
+ * @param Py   Origin of the ray.
+ * @param dirX Direction of the ray (unit vector).
+ * @param dirY Direction of the ray (unit vector, Y axis pointing down).
+ * @param hit  Pointer to a mof_Raycasterhit to fill.
+ * @return     Distance to the wall, -1 if the ray left the map.
+ */
+double mof_Raycaster__dda(mof_Map *map, double Px, double Py, double dirX, double dirY, mof_Raycasterhit *hit)
+{
+  int cellX = (int)floor(Px / map->unit);
+  int cellY = (int)floor(Py / map->unit);
+  
+  /* distance along the ray to the first grid lines */
+  double sideX = HUGE_VAL;
+  double sideY = HUGE_VAL;
+  
+  if (dirX < 0)
+	sideX = (Px - cellX * map->unit) / -dirX;
+  else if (dirX > 0)
+	sideX = ((cellX + 1) * map->unit - Px) / dirX;
+	
+  if (dirY < 0)
+	sideY = (Py - cellY * map->unit) / -dirY;
+  else if (dirY > 0)
+	sideY = ((cellY + 1) * map->unit - Py) / dirY;
+  
+  return mof_Raycaster__walk(map, Px, Py, dirX, dirY, cellX, cellY, sideX, sideY, hit);
+}
+
+#ifdef MOF_RAYCASTER_FIXEDPOINT
+
+/**
+ * Distance along a ray between two grid lines (fixed point).
+ * 
+ * @param dir Component of the direction of the ray (2.30).
+ * @return    Distance (16.16, in cells).
+ */
+Uint32 mof_Raycaster__fixeddelta(int dir)
+{
+  unsigned long long delta;
+  
+  if (dir == 0)
+	return MOF_RAYCASTER_FAR;
+  
+  delta = (1ULL << 46) / (unsigned int)abs(dir);
+  return (delta > MOF_RAYCASTER_FAR) ? MOF_RAYCASTER_FAR : (Uint32)delta;
+}
+
+/**
+ * Distance along a ray to the first grid line (fixed point).
+ * 
+ * @param position Component of the origin of the ray (16.16, in cells).
+ * @param dir      Component of the direction of the ray (2.30).
+ * @param delta    Distance between two grid lines (see mof_Raycaster__fixeddelta).
+ * @return         Distance (16.16, in cells).
+ */
+Uint32 mof_Raycaster__fixedside(int position, int dir, Uint32 delta)
+{
+  unsigned long long side;
+  Uint32 fraction = position & (MOF_RAYCASTER_ONE - 1);
+  
+  if (dir == 0)
+	return MOF_RAYCASTER_FAR;
+  
+  if (dir > 0)
+	fraction = MOF_RAYCASTER_ONE - fraction;
+  
+  side = ((unsigned long long)fraction * delta) >> 16;
+  return (side > MOF_RAYCASTER_FAR) ? MOF_RAYCASTER_FAR : (Uint32)side;
+}
+
+/**
+ * Skip the empty space around a cell (fixed point).
+ * 
+ * Same as mof_Raycaster__skip.
  * 
- * @param scene  Pointer to a mof_Graphicelement object.
- * @param player Pointer to a mof_Player object.
  * @param map    Pointer to a mof_Map object.
+ * @param stepX  Direction of the ray on the grid (-1 or 1).
+ * @param stepY  Direction of the ray on the grid (-1 or 1).
+ * @param deltaX Distance along the ray between two vertical grid lines.
+ * @param deltaY Distance along the ray between two horizontal grid lines.
+ * @param cellX  Current cell (updated).
+ * @param cellY  Current cell (updated).
+ * @param sideX  Distance along the ray to the next vertical grid line (updated).
+ * @param sideY  Distance along the ray to the next horizontal grid line (updated).
  */
-mof_Raycaster__draw3Dscene(mof_Graphicelement *scene, mof_Player *player, mof_Map *map)
+void mof_Raycaster__fixedskip(mof_Map *map, int stepX, int stepY, Uint32 deltaX, Uint32 deltaY, int *cellX, int *cellY, Uint32 *sideX, Uint32 *sideY)
 {
-  double *resultH, *resultV, *result;
-  double i = 0;
-  double step = (60.0 / player->screen->w);
-  double distanceFromProjectionPlane = (player->screen->w / 2) / tan((60 / 2) * M_PI / 180);
-  int bottom, top, position = 0;
-  double orientation = 0;
-  double zIndex = 0;
+  int reach = map->distances[*cellX + *cellY * map->width] - 1;
+  int count;
   
-  mof_Graphicelement__add(scene, 10000.0, 0, 0, player->screen->w, (player->screen->h / 2), 106, 106, 106, 255);
-  mof_Graphicelement__add(scene, 10000.0, 0, (player->screen->h / 2), player->screen->w, player->screen->h, 40, 40, 40 ,255);
+  /* distance along the ray to the border of the square */
+  unsigned long long exitX = *sideX + (unsigned long long)reach * deltaX;
+  unsigned long long exitY = *sideY + (unsigned long long)reach * deltaY;
   
-  for (i = 30; i >= -30; i -= step)
+  if (exitX <= exitY)
   {
-    resultH = mof_Raycaster__horizontal(player, map, (double)((mof_Avatar *)player)->angle + i);
-	resultV = mof_Raycaster__vertical(player, map, (double)((mof_Avatar *)player)->angle + i);
+	/* leaving by a vertical side, count the horizontal grid lines crossed */
+	count = (*sideY < exitX) ? (int)((exitX - *sideY) / deltaY) + 1 : 0;
+	if (count > reach)
+	  count = reach;
 	
-	if (resultH[0] < 0)
+	*cellX += reach * stepX;
+	*sideX = (Uint32)exitX;
+	*cellY += count * stepY;
+	*sideY += count * deltaY;
+  }
+  else
+  {
+	/* leaving by an horizontal side, count the vertical grid lines crossed */
+	count = (*sideX < exitY) ? (int)((exitY - *sideX) / deltaX) + 1 : 0;
+	if (count > reach)
+	  count = reach;
+	
+	*cellX += count * stepX;
+	*sideX += count * deltaX;
+	*cellY += reach * stepY;
+	*sideY = (Uint32)exitY;
+  }
+}
+
+/**
+ * Grid traversal (DDA) for the ray, in fixed point.
+ * 
+ * Same walk as mof_Raycaster__dda with the position in cells (16.16) and
+ * the direction in 2.30 (a small component need the extra bits, the
+ * distance between grid lines is its inverse): the cell of the origin is a
+ * shift and the point of intersection a multiply, the doubles are only
+ * converted at both ends.
+ * 
+ * @param map  Pointer to a mof_Map object (unit of MOF_MAP_UNIT).
+ * @param Px   Origin of the ray.
+ * @param Py   Origin of the ray.
+ * @param dirX Direction of the ray (unit vector).
+ * @param dirY Direction of the ray (unit vector, Y axis pointing down).
+ * @param hit  Pointer to a mof_Raycasterhit to fill.
+ * @return     Distance to the wall, -1 if the ray left the map.
+ */
+double mof_Raycaster__fixeddda(mof_Map *map, double Px, double Py, double dirX, double dirY, mof_Raycasterhit *hit)
+{
+  int x = (int)(Px * MOF_RAYCASTER_SCALE);
+  int y = (int)(Py * MOF_RAYCASTER_SCALE);
+  int fx = (int)(dirX * MOF_RAYCASTER_UNIT);
+  int fy = (int)(dirY * MOF_RAYCASTER_UNIT);
+  int cellX = x >> 16;
+  int cellY = y >> 16;
+  int stepX = (fx < 0) ? -1 : 1;
+  int stepY = (fy < 0) ? -1 : 1;
+  int side = 0, space;
+  
+  /* distance along the ray between two grid lines and to the first ones */
+  Uint32 deltaX = mof_Raycaster__fixeddelta(fx);
+  Uint32 deltaY = mof_Raycaster__fixeddelta(fy);
+  Uint32 sideX = mof_Raycaster__fixedside(x, fx, deltaX);
+  Uint32 sideY = mof_Raycaster__fixedside(y, fy, deltaY);
+  Uint32 distance = 0;
+  
+  if (cellX >= 0 && cellX < map->width && cellY >= 0 && cellY < map->height &&
+	  map->distances[cellX + cellY * map->width] > MOF_RAYCASTER_SKIP)
+	mof_Raycaster__fixedskip(map, stepX, stepY, deltaX, deltaY, &cellX, &cellY, &sideX, &sideY);
+  
+  /* check the grid at each cell crossed for wall */
+  while (1)
+  {
+	if (sideY < sideX)
 	{
-	  result = resultV;
-	  orientation = 1;
+	  distance = sideY;
+	  sideY += deltaY;
+	  cellY += stepY;
+	  side = 0;
 	}
-	else if (resultV[0] < 0)
+	else
 	{
-	  result = resultH;
-	  orientation = 0;
+	  distance = sideX;
+	  sideX += deltaX;
+	  cellX += stepX;
+	  side = 1;
 	}
-	else if (resultH[0] < resultV[0])
+	
+	/* checking to see if we are not out of bound */
+	if (cellX < 0 || cellX >= map->width || cellY < 0 || cellY >= map->height)
 	{
-	  result = resultH;
-	  orientation = 0;
+	  hit->distance = -1;
+	  hit->cell = -1;
+	  return -1;
 	}
-	else
+	
+	/* the distance field is 0 on the walls */
+	space = map->distances[cellX + cellY * map->width];
+	if (space == 0)
+	  break;
+	
+	if (space > MOF_RAYCASTER_SKIP)
+	  mof_Raycaster__fixedskip(map, stepX, stepY, deltaX, deltaY, &cellX, &cellY, &sideX, &sideY);
+  }
+  
+  /* intersection with the grid line crossed last */
+  if (side)
+  {
+	x = (cellX + (stepX < 0)) << 16;
+	y += (int)(((long long)distance * fy) >> 30);
+  }
+  else
+  {
+	x += (int)(((long long)distance * fx) >> 30);
+	y = (cellY + (stepY < 0)) << 16;
+  }
+  
+  hit->distance = (double)distance / MOF_RAYCASTER_SCALE;
+  hit->x = (double)x / MOF_RAYCASTER_SCALE;
+  hit->y = (double)y / MOF_RAYCASTER_SCALE;
+  hit->side = side;
+  hit->cell = cellX + cellY * map->width;
+  
+  return hit->distance;
+}
+
+/**
+ * Checking the limit of the map (fixed point).
+ * 
+ * Same as mof_Raycaster__intersect, the distance is the one found by
+ * mof_Raycaster__fixeddda (the grid lines crossed are counted, not added).
+ * 
+ * @param map   Pointer to a mof_Map object (unit of MOF_MAP_UNIT).
+ * @param Px    Origin of the ray.
+ * @param Py    Origin of the ray.
+ * @param dirX  Direction of the ray (unit vector).
+ * @param dirY  Direction of the ray (unit vector, Y axis pointing down).
+ * @param cellX Wall cell.
+ * @param cellY Wall cell.
+ * @param side  0 for an horizontal wall, 1 for a vertical wall.
+ * @param hit   Pointer to a mof_Raycasterhit to fill.
+ * @return      Distance to the wall.
+ */
+double mof_Raycaster__fixedintersect(mof_Map *map, double Px, double Py, double dirX, double dirY, int cellX, int cellY, int side, mof_Raycasterhit *hit)
+{
+  int x = (int)(Px * MOF_RAYCASTER_SCALE);
+  int y = (int)(Py * MOF_RAYCASTER_SCALE);
+  int fx = (int)(dirX * MOF_RAYCASTER_UNIT);
+  int fy = (int)(dirY * MOF_RAYCASTER_UNIT);
+  Uint32 delta, distance;
+  
+  if (side)
+  {
+	delta = mof_Raycaster__fixeddelta(fx);
+	distance = mof_Raycaster__fixedside(x, fx, delta) + (Uint32)(abs(cellX - (x >> 16)) - 1) * delta;
+	x = (cellX + (fx < 0)) << 16;
+	y += (int)(((long long)distance * fy) >> 30);
+  }
+  else
+  {
+	delta = mof_Raycaster__fixeddelta(fy);
+	distance = mof_Raycaster__fixedside(y, fy, delta) + (Uint32)(abs(cellY - (y >> 16)) - 1) * delta;
+	x += (int)(((long long)distance * fx) >> 30);
+	y = (cellY + (fy < 0)) << 16;
+  }
+  
+  hit->distance = (double)distance / MOF_RAYCASTER_SCALE;
+  hit->x = (double)x / MOF_RAYCASTER_SCALE;
+  hit->y = (double)y / MOF_RAYCASTER_SCALE;
+  hit->side = side;
+  hit->cell = cellX + cellY * map->width;
+  
+  return hit->distance;
+}
+
+#endif
+
+#ifdef MOF_RAYCASTER_SIMD
+
+/**
+ * Starting point of rays casted together.
+ * 
+ * Same computation as mof_Raycaster__dda, one ray at a time.
+ * 
+ * @param map    Pointer to a mof_Map object.
+ * @param Px     Origin of the rays.
+ * @param Py     Origin of the rays.
+ * @param dirX   Direction of the rays.
+ * @param dirY   Direction of the rays.
+ * @param count  Number of rays.
+ * @param state  Cells, steps, distances to the next grid lines and between
+ *               grid lines (count values each).
+ */
+void mof_Raycaster__packetstart(mof_Map *map, double Px, double Py, const double *dirX, const double *dirY, int count, double *state)
+{
+  double *cellX = state, *cellY = state + count;
+  double *stepX = state + 2 * count, *stepY = state + 3 * count;
+  double *sideX = state + 4 * count, *sideY = state + 5 * count;
+  double *deltaX = state + 6 * count, *deltaY = state + 7 * count;
+  int startX = (int)floor(Px / map->unit);
+  int startY = (int)floor(Py / map->unit);
+  int i;
+  for (i = 0; i < count; i++)
+  {
+	cellX[i] = startX;
+	cellY[i] = startY;
+	stepX[i] = (dirX[i] < 0) ? -1 : 1;
+	stepY[i] = (dirY[i] < 0) ? -1 : 1;
+	sideX[i] = (dirX[i] < 0) ? (Px - startX * map->unit) / -dirX[i] : (dirX[i] > 0) ? ((startX + 1) * map->unit - Px) / dirX[i] : HUGE_VAL;
+	sideY[i] = (dirY[i] < 0) ? (Py - startY * map->unit) / -dirY[i] : (dirY[i] > 0) ? ((startY + 1) * map->unit - Py) / dirY[i] : HUGE_VAL;
+	deltaX[i] = (dirX[i] == 0) ? HUGE_VAL : fabs(map->unit / dirX[i]);
+	deltaY[i] = (dirY[i] == 0) ? HUGE_VAL : fabs(map->unit / dirY[i]);
+  }
+}
+
+/**
+ * End of rays casted together.
+ * 
+ * Fill the hit of the rays that are done, the rays to finish go on with the
+ * scalar caster from where they are.
+ * 
+ * @param map    Pointer to a mof_Map object.
+ * @param Px     Origin of the rays.
+ * @param Py     Origin of the rays.
+ * @param dirX   Direction of the rays.
+ * @param dirY   Direction of the rays.
+ * @param count  Number of rays.
+ * @param state  Current state of the rays (see mof_Raycaster__packetstart).
+ * @param side   Last grid line crossed by each ray (non zero if vertical).
+ * @param done   Bit mask of the rays that are done.
+ * @param finish Bit mask of the rays to finish.
+ * @param hits   Pointer to count mof_Raycasterhit to fill.
+ */
+void mof_Raycaster__packetend(mof_Map *map, double Px, double Py, const double *dirX, const double *dirY, int count, double *state, double *side, int done, int finish, mof_Raycasterhit *hits)
+{
+  double *cellX = state, *cellY = state + count;
+  double *sideX = state + 4 * count, *sideY = state + 5 * count;
+  int i;
+  for (i = 0; i < count; i++)
+  {
+	if (done & (1 << i))
 	{
-	  result = resultV;
-	  orientation = 1;
+	  if (cellX[i] < 0 || cellX[i] >= map->width || cellY[i] < 0 || cellY[i] >= map->height)
+	  {
+		hits[i].distance = -1;
+		hits[i].cell = -1;
+	  }
+	  else
+		mof_Raycaster__intersect(map, Px, Py, dirX[i], dirY[i], (int)cellX[i], (int)cellY[i], (side[i] != 0), &hits[i]);
 	}
+	else if (finish & (1 << i))
+	  mof_Raycaster__walk(map, Px, Py, dirX[i], dirY[i], (int)cellX[i], (int)cellY[i], sideX[i], sideY[i], &hits[i]);
+  }
+}
+
+/* one step of half a packet (SSE2), see mof_Raycaster__walk */
+#define MOF_RAYCASTER_STEP4(h)																				\
+  m = _mm_cmplt_pd(sY##h, sX##h);																			\
+  n = _mm_andnot_pd(m, live##h);																			\
+  m = _mm_and_pd(m, live##h);																				\
+  sY##h = _mm_add_pd(sY##h, _mm_and_pd(m, dY##h));															\
+  cY##h = _mm_add_pd(cY##h, _mm_and_pd(m, tY##h));															\
+  sX##h = _mm_add_pd(sX##h, _mm_and_pd(n, dX##h));															\
+  cX##h = _mm_add_pd(cX##h, _mm_and_pd(n, tX##h));															\
+  side##h = n;																								\
+  out##h = _mm_or_pd(_mm_cmpneq_pd(cX##h, _mm_min_pd(_mm_max_pd(cX##h, zero), lastX)),						\
+					 _mm_cmpneq_pd(cY##h, _mm_min_pd(_mm_max_pd(cY##h, zero), lastY)));						\
+  cell = _mm_cvttpd_epi32(_mm_andnot_pd(out##h, _mm_add_pd(cX##h, _mm_mul_pd(cY##h, width))));				\
+  space = map->distances[_mm_cvtsi128_si32(cell)];															\
+  done |= ((space == 0) | (_mm_movemask_pd(out##h) & 1)) << (h * 2);										\
+  leave |= (space > MOF_RAYCASTER_SKIP) << (h * 2);																			\
+  space = map->distances[_mm_cvtsi128_si32(_mm_shuffle_epi32(cell, 1))];										\
+  done |= ((space == 0) | (_mm_movemask_pd(out##h) >> 1)) << (h * 2 + 1);									\
+  leave |= (space > MOF_RAYCASTER_SKIP) << (h * 2 + 1);
+
+/**
+ * Rays casted together (SSE2).
+ * 
+ * Advance 4 rays with the same origin in lock step, two per register.  The
+ * operations are the same as mof_Raycaster__walk (in double precision) so
+ * the hits are exactly the same as the scalar caster.  When most of the
+ * rays are done, the remaining ones are finished with the scalar caster
+ * from where they are.  A ray entering open space (see mof_Raycaster__skip)
+ * leave the packet the same way.
+ * 
+ * @param map  Pointer to a mof_Map object.
+ * @param Px   Origin of the rays.
+ * @param Py   Origin of the rays.
+ * @param dirX Direction of the 4 rays.
+ * @param dirY Direction of the 4 rays.
+ * @param hits Pointer to 4 mof_Raycasterhit to fill.
+ */
+__attribute__((target("sse2")))
+void mof_Raycaster__packet4(mof_Map *map, double Px, double Py, const double *dirX, const double *dirY, mof_Raycasterhit *hits)
+{
+  double state[8 * 4], side[4];
+  int alive = 0xF, done, leave, space;
+  
+  mof_Raycaster__packetstart(map, Px, Py, dirX, dirY, 4, state);
+  
+  __m128d cX0 = _mm_loadu_pd(&state[0]), cX1 = _mm_loadu_pd(&state[2]);
+  __m128d cY0 = _mm_loadu_pd(&state[4]), cY1 = _mm_loadu_pd(&state[6]);
+  __m128d tX0 = _mm_loadu_pd(&state[8]), tX1 = _mm_loadu_pd(&state[10]);
+  __m128d tY0 = _mm_loadu_pd(&state[12]), tY1 = _mm_loadu_pd(&state[14]);
+  __m128d sX0 = _mm_loadu_pd(&state[16]), sX1 = _mm_loadu_pd(&state[18]);
+  __m128d sY0 = _mm_loadu_pd(&state[20]), sY1 = _mm_loadu_pd(&state[22]);
+  __m128d dX0 = _mm_loadu_pd(&state[24]), dX1 = _mm_loadu_pd(&state[26]);
+  __m128d dY0 = _mm_loadu_pd(&state[28]), dY1 = _mm_loadu_pd(&state[30]);
+  __m128d width = _mm_set1_pd(map->width);
+  __m128d lastX = _mm_set1_pd(map->width - 1);
+  __m128d lastY = _mm_set1_pd(map->height - 1);
+  __m128d zero = _mm_setzero_pd();
+  __m128d live0 = _mm_cmpeq_pd(zero, zero), live1 = live0;
+  __m128d side0, side1, out0, out1, m, n;
+  __m128i cell;
+  
+  /* until only one ray is left */
+  while (alive & (alive - 1))
+  {
+	done = 0;
+	leave = 0;
+	MOF_RAYCASTER_STEP4(0)
+	MOF_RAYCASTER_STEP4(1)
 	
-	/* Z-buffering */
-	zIndex = result[0];
+	done &= alive;
+	leave &= alive & ~done;
+	if (!(done | leave))
+	  continue;
+	
+	/* rays in open space leave the packet to skip it alone */
+	_mm_storeu_pd(&state[0], cX0); _mm_storeu_pd(&state[2], cX1);
+	_mm_storeu_pd(&state[4], cY0); _mm_storeu_pd(&state[6], cY1);
+	_mm_storeu_pd(&state[16], sX0); _mm_storeu_pd(&state[18], sX1);
+	_mm_storeu_pd(&state[20], sY0); _mm_storeu_pd(&state[22], sY1);
+	_mm_storeu_pd(&side[0], side0); _mm_storeu_pd(&side[2], side1);
+	mof_Raycaster__packetend(map, Px, Py, dirX, dirY, 4, state, side, done, leave, hits);
+	
+	alive &= ~(done | leave);
+	live0 = _mm_castsi128_pd(_mm_set_epi64x(-((alive >> 1) & 1), -(alive & 1)));
+	live1 = _mm_castsi128_pd(_mm_set_epi64x(-((alive >> 3) & 1), -((alive >> 2) & 1)));
+  }
+  
+  /* rays are diverging, finish the last one alone */
+  _mm_storeu_pd(&state[0], cX0); _mm_storeu_pd(&state[2], cX1);
+  _mm_storeu_pd(&state[4], cY0); _mm_storeu_pd(&state[6], cY1);
+  _mm_storeu_pd(&state[16], sX0); _mm_storeu_pd(&state[18], sX1);
+  _mm_storeu_pd(&state[20], sY0); _mm_storeu_pd(&state[22], sY1);
+  mof_Raycaster__packetend(map, Px, Py, dirX, dirY, 4, state, side, 0, alive, hits);
+}
+
+/* one step of half a packet (AVX2), see mof_Raycaster__walk */
+#define MOF_RAYCASTER_STEP8(h)																				\
+  m = _mm256_cmp_pd(sY##h, sX##h, _CMP_LT_OQ);																\
+  n = _mm256_andnot_pd(m, live##h);																			\
+  m = _mm256_and_pd(m, live##h);																			\
+  sY##h = _mm256_add_pd(sY##h, _mm256_and_pd(m, dY##h));													\
+  cY##h = _mm256_add_pd(cY##h, _mm256_and_pd(m, tY##h));													\
+  sX##h = _mm256_add_pd(sX##h, _mm256_and_pd(n, dX##h));													\
+  cX##h = _mm256_add_pd(cX##h, _mm256_and_pd(n, tX##h));													\
+  side##h = n;																								\
+  out##h = _mm256_or_pd(_mm256_cmp_pd(cX##h, _mm256_min_pd(_mm256_max_pd(cX##h, zero), lastX), _CMP_NEQ_OQ),	\
+						_mm256_cmp_pd(cY##h, _mm256_min_pd(_mm256_max_pd(cY##h, zero), lastY), _CMP_NEQ_OQ));	\
+  cell##h = _mm256_cvttpd_epi32(_mm256_andnot_pd(out##h, _mm256_add_pd(cX##h, _mm256_mul_pd(cY##h, width))));
+
+/**
+ * Rays casted together (AVX2).
+ * 
+ * Same as mof_Raycaster__packet4 for 8 rays, four per register, with the
+ * cells of the map fetched by a single gather.
+ * 
+ * @param map  Pointer to a mof_Map object.
+ * @param Px   Origin of the rays.
+ * @param Py   Origin of the rays.
+ * @param dirX Direction of the 8 rays.
+ * @param dirY Direction of the 8 rays.
+ * @param hits Pointer to 8 mof_Raycasterhit to fill.
+ */
+__attribute__((target("avx2")))
+void mof_Raycaster__packet8(mof_Map *map, double Px, double Py, const double *dirX, const double *dirY, mof_Raycasterhit *hits)
+{
+  double state[8 * 8], side[8];
+  int alive = 0xFF, done, leave;
+  
+  mof_Raycaster__packetstart(map, Px, Py, dirX, dirY, 8, state);
+  
+  __m256d cX0 = _mm256_loadu_pd(&state[0]), cX1 = _mm256_loadu_pd(&state[4]);
+  __m256d cY0 = _mm256_loadu_pd(&state[8]), cY1 = _mm256_loadu_pd(&state[12]);
+  __m256d tX0 = _mm256_loadu_pd(&state[16]), tX1 = _mm256_loadu_pd(&state[20]);
+  __m256d tY0 = _mm256_loadu_pd(&state[24]), tY1 = _mm256_loadu_pd(&state[28]);
+  __m256d sX0 = _mm256_loadu_pd(&state[32]), sX1 = _mm256_loadu_pd(&state[36]);
+  __m256d sY0 = _mm256_loadu_pd(&state[40]), sY1 = _mm256_loadu_pd(&state[44]);
+  __m256d dX0 = _mm256_loadu_pd(&state[48]), dX1 = _mm256_loadu_pd(&state[52]);
+  __m256d dY0 = _mm256_loadu_pd(&state[56]), dY1 = _mm256_loadu_pd(&state[60]);
+  __m256d width = _mm256_set1_pd(map->width);
+  __m256d lastX = _mm256_set1_pd(map->width - 1);
+  __m256d lastY = _mm256_set1_pd(map->height - 1);
+  __m256d zero = _mm256_setzero_pd();
+  __m256d live0 = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ), live1 = live0;
+  __m256d side0, side1, out0, out1, m, n;
+  __m128i cell0, cell1;
+  __m256i cell;
+  
+  /* until only two rays are left */
+  while (__builtin_popcount(alive) > 2)
+  {
+	MOF_RAYCASTER_STEP8(0)
+	MOF_RAYCASTER_STEP8(1)
+	
+	/* gather the distance field of the 8 cells (the first cell when out of bound) */
+	cell = _mm256_and_si256(_mm256_i32gather_epi32((const int *)map->distances, _mm256_inserti128_si256(_mm256_castsi128_si256(cell0), cell1, 1), 1),
+						   _mm256_set1_epi32(0xFF));
+	done = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(cell, _mm256_setzero_si256()))) | 
+		   _mm256_movemask_pd(out0) | (_mm256_movemask_pd(out1) << 4);
+	leave = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(cell, _mm256_set1_epi32(MOF_RAYCASTER_SKIP))));
+	done &= alive;
+	leave &= alive & ~done;
+	if (!(done | leave))
+	  continue;
+	
+	/* rays in open space leave the packet to skip it alone */
+	_mm256_storeu_pd(&state[0], cX0); _mm256_storeu_pd(&state[4], cX1);
+	_mm256_storeu_pd(&state[8], cY0); _mm256_storeu_pd(&state[12], cY1);
+	_mm256_storeu_pd(&state[32], sX0); _mm256_storeu_pd(&state[36], sX1);
+	_mm256_storeu_pd(&state[40], sY0); _mm256_storeu_pd(&state[44], sY1);
+	_mm256_storeu_pd(&side[0], side0); _mm256_storeu_pd(&side[4], side1);
+	_mm256_zeroupper();
+	mof_Raycaster__packetend(map, Px, Py, dirX, dirY, 8, state, side, done, leave, hits);
+	
+	alive &= ~(done | leave);
+	live0 = _mm256_castsi256_pd(_mm256_set_epi64x(-((alive >> 3) & 1), -((alive >> 2) & 1), -((alive >> 1) & 1), -(alive & 1)));
+	live1 = _mm256_castsi256_pd(_mm256_set_epi64x(-((alive >> 7) & 1), -((alive >> 6) & 1), -((alive >> 5) & 1), -((alive >> 4) & 1)));
+  }
+  
+  /* rays are diverging, finish the last ones alone */
+  _mm256_storeu_pd(&state[0], cX0); _mm256_storeu_pd(&state[4], cX1);
+  _mm256_storeu_pd(&state[8], cY0); _mm256_storeu_pd(&state[12], cY1);
+  _mm256_storeu_pd(&state[32], sX0); _mm256_storeu_pd(&state[36], sX1);
+  _mm256_storeu_pd(&state[40], sY0); _mm256_storeu_pd(&state[44], sY1);
+  _mm256_zeroupper();
+  mof_Raycaster__packetend(map, Px, Py, dirX, dirY, 8, state, side, 0, alive, hits);
+}
+
+#endif
+
+/**
+ * Number of rays the processor can cast together.
+ * 
+ * The processor is only checked on the first call.  The size is loaded and
+ * stored atomically, threads calling it the first time at once all find
+ * the same size.
+ * 
+ * @return 8 with AVX2, 4 with SSE2, 1 otherwise.
+ */
+int mof_Raycaster__packetmax(void)
+{
+  static int packet = 0;
+  int size = __atomic_load_n(&packet, __ATOMIC_RELAXED);
+  
+  if (size)
+	return size;
+  
+  size = 1;
+#ifdef MOF_RAYCASTER_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+	size = 8;
+  else if (__builtin_cpu_supports("sse2"))
+	size = 4;
+#endif
+  
+  __atomic_store_n(&packet, size, __ATOMIC_RELAXED);
+  return size;
+}
+
+/**
+ * Number of rays casted together by default.
+ * 
+ * The SSE2 packets only hold two rays per register, they are slower than
+ * the scalar DDA, so without AVX2 the rays are casted one at a time (the
+ * SSE2 packets can still be forced through mof_Raycaster.packet).
+ * 
+ * @return 8 with AVX2, 1 otherwise.
+ */
+int mof_Raycaster__packetsize(void)
+{
+  return (mof_Raycaster__packetmax() == 8) ? 8 : 1;
+}
+
+/**
+ * Cast a batch of rays.
+ * 
+ * Every ray only write to its own hit, so the same map can be queried from
+ * several threads at the same time.  Adjacent rays from the same origin
+ * going the same way (a few degrees apart) are casted together (AVX2) when
+ * the processor support it, rays spreading apart would leave the packet
+ * one by one.
+ * 
+ * @param map   Pointer to a mof_Map object.
+ * @param count Number of rays.
+ * @param x     Origin of every ray.
+ * @param y     Origin of every ray.
+ * @param dirX  Direction of every ray (unit vector).
+ * @param dirY  Direction of every ray (unit vector, Y axis pointing down).
+ * @param hits  Hit of every ray (filled).
+ */
+void mof_Raycaster__query(mof_Map *map, int count, const double *x, const double *y, const double *dirX, const double *dirY, mof_Raycasterhit *hits)
+{
+  int i = 0, run, packet = mof_Raycaster__packetsize();
+  
+#ifdef MOF_RAYCASTER_FIXEDPOINT
+  if (MOF_RAYCASTER_FIXED && map->unit == MOF_MAP_UNIT)
+  {
+	for (; i < count; i++)
+	{
+	  mof_Raycaster__fixeddda(map, x[i], y[i], dirX[i], dirY[i], &hits[i]);
+	}
+	return;
+  }
+#endif
+  
+  while (i < count)
+  {
+	/* rays from the same origin as the first one, going the same way */
+	for (run = 1; i + run < count && run < packet && x[i + run] == x[i] && y[i + run] == y[i] &&
+		 fabs(dirX[i + run] - dirX[i]) + fabs(dirY[i + run] - dirY[i]) < MOF_RAYCASTER_COHERENCE; run++);
+	
+#ifdef MOF_RAYCASTER_SIMD
+	if (run == 8)
+	{
+	  mof_Raycaster__packet8(map, x[i], y[i], dirX + i, dirY + i, hits + i);
+	  i += 8;
+	  continue;
+	}
+	if (run >= 4)
+	{
+	  mof_Raycaster__packet4(map, x[i], y[i], dirX + i, dirY + i, hits + i);
+	  i += 4;
+	  continue;
+	}
+#endif
+	
+	mof_Raycaster__dda(map, x[i], y[i], dirX[i], dirY[i], &hits[i]);
+	i++;
+  }
+}
+
+/**
+ * Cast a batch of rays given by their angle.
+ * 
+ * Same as mof_Raycaster__query, the directions are computed on the stack
+ * in chunks of MOF_RAYCASTER_CHUNK rays (nothing is allocated), every
+ * chunk is queried at once.
+ * 
+ * @param map    Pointer to a mof_Map object.
+ * @param count  Number of rays.
+ * @param x      Origin of every ray.
+ * @param y      Origin of every ray.
+ * @param angles Angle of every ray (degree).
+ * @param hits   Hit of every ray (filled).
+ */
+void mof_Raycaster__queryangles(mof_Map *map, int count, const double *x, const double *y, const double *angles, mof_Raycasterhit *hits)
+{
+  double dirX[MOF_RAYCASTER_CHUNK], dirY[MOF_RAYCASTER_CHUNK];
+  int i, first, size;
+  
+  for (first = 0; first < count; first += size)
+  {
+	size = (count - first < MOF_RAYCASTER_CHUNK) ? count - first : MOF_RAYCASTER_CHUNK;
+	for (i = 0; i < size; i++)
+	{
+	  dirX[i] = cos(angles[first + i] * M_PI / 180);
+	  dirY[i] = -sin(angles[first + i] * M_PI / 180);
+	}
+	
+	mof_Raycaster__query(map, size, x + first, y + first, dirX, dirY, hits + first);
+  }
+}
+
+/**
+ * Constructor.
+ *  
+ * @param raycaster Pointer to a mof_Raycaster object.
+ * @param width     Number of columns.
+ * @param pool      Pointer to a mof_Threadpool object (or NULL).
+ */
+void mof_Raycaster__construct(mof_Raycaster *raycaster, int width, mof_Threadpool *pool)
+{
+  /* here OR the MOF_RAYCASTER_TYPE constant into the type */
+  raycaster->type |= MOF_RAYCASTER_TYPE;
+  
+  raycaster->width = width;
+  raycaster->hits = malloc(width * sizeof(mof_Raycasterhit));
+  raycaster->previous = malloc(width * sizeof(mof_Raycasterhit));
+  raycaster->stale = malloc(width);
+  raycaster->buffer.depth = malloc(width * sizeof(double));
+  raycaster->buffer.x = malloc(width * sizeof(double));
+  raycaster->buffer.y = malloc(width * sizeof(double));
+  raycaster->buffer.side = malloc(width);
+  raycaster->buffer.material = malloc(width);
+  raycaster->buffer.cell = malloc(width * sizeof(int));
+  raycaster->valid = 0;
+  raycaster->pool = pool;
+  raycaster->packet = mof_Raycaster__packetsize();
+  raycaster->fixed = MOF_RAYCASTER_FIXED;
+  raycaster->flats = 1;
+  raycaster->tops = malloc(width * sizeof(int));
+  raycaster->bottoms = malloc(width * sizeof(int));
+  raycaster->camera = NULL;
+  raycaster->projection = 0;
+  raycaster->map = NULL;
+  raycaster->cells = NULL;
+  raycaster->x = 0;
+  raycaster->y = 0;
+  raycaster->angle = 0;
+  raycaster->castfixed = 0;
+  raycaster->followed = 0;
+}
+
+/**
+ * New.
+ * 
+ * @param width Number of columns.
+ * @param pool  Pointer to a mof_Threadpool object (or NULL).
+ * @return      An object mof_Raycaster.
+ */
+mof_Raycaster *mof_Raycaster__new(int width, mof_Threadpool *pool) 
+{	
+  mof_Raycaster *raycaster = malloc(sizeof(mof_Raycaster));
+  raycaster->type = MOF_RAYCASTER_TYPE;
+  
+  /* call the constructor */
+  mof_Raycaster__construct(raycaster, width, pool);
+  
+  return raycaster;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object.
+ */
+void mof_Raycaster__check(mof_Raycaster *raycaster)
+{
+  /* check if we have a valid mof_Raycaster object */
+  if (raycaster == NULL || 
+	  !(raycaster->type & MOF_RAYCASTER_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object.
+ */ 
+void mof_Raycaster__destroy(mof_Raycaster *raycaster)
+{
+  /* check if we have a valid mof_Raycaster object */
+  mof_Raycaster__check(raycaster);
+
+  /* set type to 0 indicate this is no longer a mof_Raycaster object */
+  raycaster->type = 0;
+
+  /* free the memory allocated for the object */
+  free(raycaster->hits);
+  free(raycaster->previous);
+  free(raycaster->stale);
+  free(raycaster->buffer.depth);
+  free(raycaster->buffer.x);
+  free(raycaster->buffer.y);
+  free(raycaster->buffer.side);
+  free(raycaster->buffer.material);
+  free(raycaster->buffer.cell);
+  free(raycaster->tops);
+  free(raycaster->bottoms);
+  free(raycaster);
+}
+
+/**
+ * Resize the hit buffer.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object.
+ * @param width     Number of columns.
+ */
+void mof_Raycaster__resize(mof_Raycaster *raycaster, int width)
+{
+  /* check if we have a valid mof_Raycaster object */
+  mof_Raycaster__check(raycaster);
+  
+  if (raycaster->width == width)
+	return;
+	
+  raycaster->width = width;
+  raycaster->hits = realloc(raycaster->hits, width * sizeof(mof_Raycasterhit));
+  raycaster->previous = realloc(raycaster->previous, width * sizeof(mof_Raycasterhit));
+  raycaster->stale = realloc(raycaster->stale, width);
+  raycaster->buffer.depth = realloc(raycaster->buffer.depth, width * sizeof(double));
+  raycaster->buffer.x = realloc(raycaster->buffer.x, width * sizeof(double));
+  raycaster->buffer.y = realloc(raycaster->buffer.y, width * sizeof(double));
+  raycaster->buffer.side = realloc(raycaster->buffer.side, width);
+  raycaster->buffer.material = realloc(raycaster->buffer.material, width);
+  raycaster->buffer.cell = realloc(raycaster->buffer.cell, width * sizeof(int));
+  raycaster->valid = 0;
+  raycaster->tops = realloc(raycaster->tops, width * sizeof(int));
+  raycaster->bottoms = realloc(raycaster->bottoms, width * sizeof(int));
+}
+
+/**
+ * Cast a strip of columns.
+ * 
+ * Only write to the hits of its own columns, so strips can be casted by
+ * different threads at the same time.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object.
+ * @param first     First column of the strip.
+ * @param last      Last column of the strip (excluded).
+ */
+void mof_Raycaster__caststrip(mof_Raycaster *raycaster, int first, int last)
+{
+  double dirX[8], dirY[8];
+  int i = first, j;
+  
+#ifdef MOF_RAYCASTER_FIXEDPOINT
+  if (raycaster->fixed && raycaster->map->unit == MOF_MAP_UNIT)
+  {
+	for (; i < last; i++)
+	{
+	  mof_Camera__ray(raycaster->camera, raycaster->angle, i, &dirX[0], &dirY[0]);
+	  mof_Raycaster__fixeddda(raycaster->map, raycaster->x, raycaster->y, dirX[0], dirY[0], &raycaster->hits[i]);
+	}
+	return;
+  }
+#endif
+  
+#ifdef MOF_RAYCASTER_SIMD
+  /* packets of adjacent columns */
+  for (; raycaster->packet > 1 && i + raycaster->packet <= last; i += raycaster->packet)
+  {
+	for (j = 0; j < raycaster->packet; j++)
+	{
+	  mof_Camera__ray(raycaster->camera, raycaster->angle, i + j, &dirX[j], &dirY[j]);
+	}
+	
+	if (raycaster->packet == 8)
+	  mof_Raycaster__packet8(raycaster->map, raycaster->x, raycaster->y, dirX, dirY, &raycaster->hits[i]);
+	else
+	  mof_Raycaster__packet4(raycaster->map, raycaster->x, raycaster->y, dirX, dirY, &raycaster->hits[i]);
+  }
+#endif
+  
+  /* what is left of the strip */
+  for (; i < last; i++)
+  {
+	mof_Camera__ray(raycaster->camera, raycaster->angle, i, &dirX[0], &dirY[0]);
+	mof_Raycaster__dda(raycaster->map, raycaster->x, raycaster->y, dirX[0], dirY[0], &raycaster->hits[i]);
+  }
+}
+
+/**
+ * Publish the hits of a strip of columns in the depth buffer.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object.
+ * @param first     First column of the strip.
+ * @param last      Last column of the strip (excluded).
+ */
+void mof_Raycaster__publish(mof_Raycaster *raycaster, int first, int last)
+{
+  mof_Raycasterbuffer *buffer = &raycaster->buffer;
+  mof_Raycasterhit *hit;
+  int column;
+  
+  for (column = first; column < last; column++)
+  {
+	hit = &raycaster->hits[column];
+	if (hit->distance < 0)
+	{
+	  buffer->depth[column] = HUGE_VAL;
+	  buffer->x[column] = raycaster->x;
+	  buffer->y[column] = raycaster->y;
+	  buffer->side[column] = 0;
+	  buffer->material[column] = 0;
+	  buffer->cell[column] = -1;
+	  continue;
+	}
 	
 	/* remove the viewing distortion */
-    result[0] = result[0] * fabs(cos(i * M_PI / 180));
+	buffer->depth[column] = hit->distance * raycaster->camera->columnCos[column];
+	buffer->x[column] = hit->x;
+	buffer->y[column] = hit->y;
+	buffer->side[column] = hit->side;
+	buffer->material[column] = mof_Map__materialindex(raycaster->map, hit->cell);
+	buffer->cell[column] = hit->cell;
+  }
+}
+
+/**
+ * Cast one strip (job of the mof_Threadpool).
+ * 
+ * @param data  Pointer to a mof_Raycaster object.
+ * @param task  Index of the strip.
+ * @param tasks Number of strips.
+ */
+void mof_Raycaster__job(void *data, int task, int tasks)
+{
+  mof_Raycaster *raycaster = data;
+  int first = (int)((long long)raycaster->width * task / tasks);
+  int last = (int)((long long)raycaster->width * (task + 1) / tasks);
+  int column, start = -1;
+  
+  /* only the runs of stale columns */
+  for (column = first; column <= last; column++)
+  {
+	if (column < last && raycaster->stale[column])
+	{
+	  if (start < 0)
+		start = column;
+	}
+	else if (start >= 0)
+	{
+	  mof_Raycaster__caststrip(raycaster, start, column);
+	  start = -1;
+	}
+  }
+  
+  mof_Raycaster__publish(raycaster, first, last);
+}
+
+/**
+ * Deduce the hits of a rotated view from the previous hits.
+ * 
+ * A new ray falling between two adjacent rays of the previous frame that
+ * hit the same side of the same wall hit it too: nothing in between can
+ * block it, a wall cell would have to fit between the two rays in front of
+ * a single side of a cell.  The hit is computed again for the new
+ * direction (in fixed point if the columns are casted so), the other
+ * columns are marked stale.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object (new state already set).
+ * @param turn      Rotation since the previous frame (degree).
+ */
+void mof_Raycaster__reuse(mof_Raycaster *raycaster, int turn)
+{
+  mof_Camera *camera = raycaster->camera;
+  mof_Raycasterhit *left, *right;
+  double target, dirX, dirY;
+  double delta = turn * M_PI / 180;
+  int column, k = 0;
+  
+  for (column = 0; column < raycaster->width; column++)
+  {
+	raycaster->stale[column] = 1;
 	
-	/* get top and bottom of wall */
-	bottom = (int)floor(32 * distanceFromProjectionPlane / result[0] + (player->screen->h / 2));
-    top = (int)floor((32 - 64) * distanceFromProjectionPlane / result[0] + (player->screen->h / 2));
+	/* angle of the new ray relative to the previous view (decreasing) */
+	target = camera->columnAngle[column] + delta;
+	while (k < raycaster->width - 1 && camera->columnAngle[k + 1] >= target)
+	{
+	  k++;
+	}
+	if (k >= raycaster->width - 1 || camera->columnAngle[k] < target)
+	  continue;
+	
+	left = &raycaster->previous[k];
+	right = &raycaster->previous[k + 1];
+	if (left->distance < 0 || left->cell != right->cell || left->side != right->side)
+	  continue;
+	
+	mof_Camera__ray(camera, raycaster->angle, column, &dirX, &dirY);
+#ifdef MOF_RAYCASTER_FIXEDPOINT
+	if (raycaster->fixed && raycaster->map->unit == MOF_MAP_UNIT)
+	  mof_Raycaster__fixedintersect(raycaster->map, raycaster->x, raycaster->y, dirX, dirY, 
+									left->cell % raycaster->map->width, left->cell / raycaster->map->width, left->side, &raycaster->hits[column]);
+	else
+#endif
+	mof_Raycaster__intersect(raycaster->map, raycaster->x, raycaster->y, dirX, dirY, 
+							 left->cell % raycaster->map->width, left->cell / raycaster->map->width, left->side, &raycaster->hits[column]);
+	raycaster->stale[column] = 0;
+  }
+}
 
-	/* draw wall slice */
-	if (orientation)
-	  mof_Graphicelement__add(scene, zIndex, position, top, 1, (bottom - top), 185 - (result[0] * 0.2), 0, 0, 255);
+/**
+ * Forget the hits of the previous frame.
+ * 
+ * Must be called when the cells of the map are modified.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object.
+ */
+void mof_Raycaster__invalidate(mof_Raycaster *raycaster)
+{
+  /* check if we have a valid mof_Raycaster object */
+  mof_Raycaster__check(raycaster);
+  
+  raycaster->valid = 0;
+}
+
+/**
+ * Take the hits of another raycaster as the hits of the previous frame.
+ * 
+ * For a mof_Raycaster per frame in flight: the hits of the frame casted
+ * just before are handed forward (the arrays are swapped, only a cast read
+ * them), so the next cast reuse them instead of the hits of its own older
+ * frame.  The other raycaster must be done casting, its published buffer
+ * is left as is (it can still be drawn) but its hits are no longer valid:
+ * it must not be casted again before it follow another one.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object.
+ * @param before    Pointer to the mof_Raycaster object of the frame before.
+ */
+void mof_Raycaster__follow(mof_Raycaster *raycaster, mof_Raycaster *before)
+{
+  mof_Raycasterhit *swap;
+  
+  /* check if we have a valid mof_Raycaster object */
+  mof_Raycaster__check(raycaster);
+  mof_Raycaster__check(before);
+  
+  if (raycaster == before)
+	return;
+  
+  mof_Raycaster__resize(raycaster, before->width);
+  swap = raycaster->hits;
+  raycaster->hits = before->hits;
+  before->hits = swap;
+  
+  raycaster->valid = before->valid;
+  raycaster->followed = 1;
+  raycaster->projection = before->projection;
+  raycaster->map = before->map;
+  raycaster->cells = before->cells;
+  raycaster->x = before->x;
+  raycaster->y = before->y;
+  raycaster->angle = before->angle;
+  raycaster->castfixed = before->castfixed;
+  before->valid = 0;
+}
+
+/**
+ * Cast every column of the scene.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object.
+ * @param camera    Pointer to a mof_Camera object.
+ * @param player    Pointer to a mof_Player object.
+ * @param map       Pointer to a mof_Map object.
+ */
+void mof_Raycaster__cast(mof_Raycaster *raycaster, mof_Camera *camera, mof_Player *player, mof_Map *map)
+{
+  mof_Raycasterhit *swap;
+  int turn;
+  
+  /* check if we have a valid mof_Raycaster object */
+  mof_Raycaster__check(raycaster);
+  
+  mof_Raycaster__resize(raycaster, camera->width);
+  
+  /* the previous hits are only good for the same view of the same map (any camera of the same width and projection) */
+  if (raycaster->projection != camera->projection ||
+	  raycaster->map != map || raycaster->cells != map->map ||
+	  raycaster->x != ((mof_Avatar *)player)->x || raycaster->y != ((mof_Avatar *)player)->y ||
+	  raycaster->castfixed != raycaster->fixed)
+	raycaster->valid = 0;
+  
+  /* turn since the previous frame, in (-180, 180] */
+  turn = mof_Camera__angle(((mof_Avatar *)player)->angle - raycaster->angle);
+  if (turn > 180)
+	turn -= 360;
+  
+  /* the hits may come from another camera casting the same columns */
+  raycaster->camera = camera;
+  
+  /* nothing moved, the hits are still good (only published if they were handed forward) */
+  if (raycaster->valid && turn == 0)
+  {
+	if (raycaster->followed)
+	  mof_Raycaster__publish(raycaster, 0, raycaster->width);
+	raycaster->followed = 0;
+	return;
+  }
+  raycaster->followed = 0;
+  
+  swap = raycaster->previous;
+  raycaster->previous = raycaster->hits;
+  raycaster->hits = swap;
+  
+  raycaster->projection = camera->projection;
+  raycaster->map = map;
+  raycaster->cells = map->map;
+  raycaster->x = ((mof_Avatar *)player)->x;
+  raycaster->y = ((mof_Avatar *)player)->y;
+  raycaster->angle = ((mof_Avatar *)player)->angle;
+  raycaster->castfixed = raycaster->fixed;
+  
+  if (raycaster->valid)
+	mof_Raycaster__reuse(raycaster, turn);
+  else
+	memset(raycaster->stale, 1, raycaster->width);
+  raycaster->valid = 1;
+  
+  if (raycaster->pool == NULL || raycaster->pool->count == 1)
+	mof_Raycaster__job(raycaster, 0, 1);
+  else
+	mof_Threadpool__run(raycaster->pool, mof_Raycaster__job, raycaster, raycaster->pool->count * MOF_RAYCASTER_STRIPS);
+}
+
+/**
+ * Wall slice of a column.
+ * 
+ * The wall is as high as a square of the map and centered on the horizon.
+ * In fixed point, the depth is converted once and the height is found with
+ * an integer division.
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object.
+ * @param camera    Pointer to a mof_Camera object.
+ * @param depth     Distance of the wall along the view direction.
+ * @param top       First line of the slice.
+ * @param bottom    Last line of the slice.
+ */
+void mof_Raycaster__slice(mof_Raycaster *raycaster, mof_Camera *camera, double depth, int *top, int *bottom)
+{
+#ifdef MOF_RAYCASTER_FIXEDPOINT
+  if (raycaster->fixed)
+  {
+	/* half the height (16.16 pixel) of 32 pixels seen at depth (16.16 cell) */
+	long long cells = (long long)(depth * MOF_RAYCASTER_SCALE);
+	long long half;
+	
+	if (cells < 1)
+	  cells = 1;
+	half = (long long)(camera->projection * MOF_RAYCASTER_ONE) * (32 * MOF_RAYCASTER_SCALE) / cells;
+	
+	*bottom = (camera->height / 2) + (int)(half >> 16);
+	*top = (camera->height / 2) - (int)((half + MOF_RAYCASTER_ONE - 1) >> 16);
+	return;
+  }
+#endif
+  
+  *bottom = (int)floor(32 * camera->projection / depth + (camera->height / 2));
+  *top = (int)floor((32 - 64) * camera->projection / depth + (camera->height / 2));
+}
+
+/**
+ * Drawing the rays casted.
+ * 
+ * One ray out of every few columns is drawn from the depth buffer, the
+ * scene must already be casted (see mof_Raycaster__cast).
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object (casted).
+ * @param camera    Pointer to a mof_Camera object.
+ * @param player    Pointer to a mof_Player object.
+ * @param map       Pointer to a mof_Map object.
+ * @param offsetX   Offset for the X coordinate.
+ * @param offsetY   Offset for the Y coordinate.
+ */
+void mof_Raycaster__draw(mof_Raycaster *raycaster, mof_Camera *camera, mof_Player *player, mof_Map *map, int offsetX, int offsetY)
+{
+  int column, step;
+  
+  /* about 64 rays whatever the resolution */
+  step = (raycaster->width + 63) / 64;
+  for (column = step / 2; column < raycaster->width; column += step)
+  {
+	if (raycaster->buffer.cell[column] < 0)
+	  continue;
+	
+	lineRGBA(player->screen, (int)raycaster->x - offsetX, (int)raycaster->y - offsetY, 
+			 (int)raycaster->buffer.x[column] - offsetX, (int)raycaster->buffer.y[column] - offsetY, 255, 255, 0, 50);
+  }
+}
+
+/**
+ * Pixels the rays are drawn on (see mof_Raycaster__draw).
+ * 
+ * @param raycaster Pointer to a mof_Raycaster object (casted).
+ * @param offsetX   Offset for the X coordinate.
+ * @param offsetY   Offset for the Y coordinate.
+ * @param box       Left, top, right and bottom pixels (included).
+ */
+void mof_Raycaster__box(mof_Raycaster *raycaster, int offsetX, int offsetY, int *box)
+{
+  int column, step, x, y;
+  
+  box[0] = box[2] = (int)raycaster->x - offsetX;
+  box[1] = box[3] = (int)raycaster->y - offsetY;
+  
+  step = (raycaster->width + 63) / 64;
+  for (column = step / 2; column < raycaster->width; column += step)
+  {
+	if (raycaster->buffer.cell[column] < 0)
+	  continue;
+	
+	x = (int)raycaster->buffer.x[column] - offsetX;
+	y = (int)raycaster->buffer.y[column] - offsetY;
+	box[0] = (x < box[0]) ? x : box[0];
+	box[1] = (y < box[1]) ? y : box[1];
+	box[2] = (x > box[2]) ? x : box[2];
+	box[3] = (y > box[3]) ? y : box[3];
+  }
+}
+
+/**
+ * Drawing the floor and the ceiling (3D).
+ * 
+ * Every line of the screen below (or above) the horizon see the floor (or
+ * the ceiling) at the same distance, so the texture coordinates are linear
+ * along the line.  Only the pixels not covered by a wall are written.
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object (locked).
+ * @param raycaster   Pointer to a mof_Raycaster object (walls drawn).
+ * @param camera      Pointer to a mof_Camera object.
+ * @param map         Pointer to a mof_Map object.
+ */
+void mof_Raycaster__drawflats(mof_Framebuffer *framebuffer, mof_Raycaster *raycaster, mof_Camera *camera, mof_Map *map)
+{
+  mof_Texture *texture;
+  double depth, scale, u, v, stepU, stepV, startU, startV;
+  int y, column, first, covered, level, size;
+  int angle = mof_Camera__angle(raycaster->angle);
+  double forwardX = camera->angleCos[angle];
+  double forwardY = -camera->angleSin[angle];
+  double rightX = camera->angleSin[angle];
+  double rightY = camera->angleCos[angle];
+  
+  for (y = 0; y < camera->height; y++)
+  {
+	/* distance of the floor (or ceiling) seen by this line */
+	if (y >= camera->height / 2)
+	{
+	  texture = map->ground;
+	  depth = 32 * camera->projection / (y + 0.5 - (camera->height / 2));
+	}
 	else
-	  mof_Graphicelement__add(scene, zIndex, position, top, 1, (bottom - top), 255 - (result[0] * 0.2), 0, 0, 255);
+	{
+	  texture = map->ceiling;
+	  depth = 32 * camera->projection / ((camera->height / 2) - (y + 0.5));
+	}
+	
+	/* mip level from the number of texels per pixel */
+	level = 0;
+	while (level < texture->levels - 1 && depth / camera->projection * texture->size / map->unit >= (2 << level))
+	{
+	  level++;
+	}
+	size = texture->size >> level;
+	scale = (double)size / map->unit;
 	
-	position += 1;
+	/* texture coordinates of the first column and step per column */
+	u = (raycaster->x + depth * (forwardX + rightX * (0.5 - camera->width / 2.0) / camera->projection)) * scale;
+	v = (raycaster->y + depth * (forwardY + rightY * (0.5 - camera->width / 2.0) / camera->projection)) * scale;
+	stepU = depth * rightX / camera->projection * scale;
+	stepV = depth * rightY / camera->projection * scale;
+	
+	/* the texture wrap, only the fraction of the coordinates matter */
+	u -= floor(u / size) * size;
+	v -= floor(v / size) * size;
+	stepU -= floor(stepU / size) * size;
+	stepV -= floor(stepV / size) * size;
+	
+	/* one span per run of columns not covered by a wall */
+	first = -1;
+	for (column = 0; column <= camera->width; column++)
+	{
+	  covered = (column == camera->width) ||
+				((y >= camera->height / 2) ? (y <= raycaster->bottoms[column]) : (y >= raycaster->tops[column]));
+	  if (!covered)
+	  {
+		if (first < 0)
+		  first = column;
+	  }
+	  else if (first >= 0)
+	  {
+		startU = u + stepU * first;
+		startV = v + stepV * first;
+		startU -= floor(startU / size) * size;
+		startV -= floor(startV / size) * size;
+		mof_Framebuffer__htexture(framebuffer, y, first, column - 1, mof_Texture__column(texture, 0, level, 0), size,
+								  (Uint32)(startU * 65536), (Uint32)(startV * 65536), (Uint32)(stepU * 65536), (Uint32)(stepV * 65536));
+		first = -1;
+	  }
+	}
   }
 }
 
+/**
+ * Drawing the rays casted (3D).
+ * 
+ * The walls, the ceiling and the floor are opaque, every column is written
+ * straight into the locked surface (no sorting needed).  The wall is
+ * sampled from the material of the cell hit, using the mip level closest
+ * to the height of the slice.  The floor and the ceiling are then casted
+ * line by line (see mof_Raycaster__drawflats), or filled with flat colors.
+ * Only the published buffer is read, the scene must already be casted (see
+ * mof_Raycaster__cast): the hits may be handed to another raycaster while
+ * the columns are drawn (see mof_Raycaster__follow).
+ * 
+ * @param framebuffer Pointer to a mof_Framebuffer object (locked).
+ * @param raycaster   Pointer to a mof_Raycaster object (casted).
+ * @param camera      Pointer to a mof_Camera object.
+ * @param player      Pointer to a mof_Player object.
+ * @param map         Pointer to a mof_Map object.
+ */
+void mof_Raycaster__draw3Dscene(mof_Framebuffer *framebuffer, mof_Raycaster *raycaster, mof_Camera *camera, mof_Player *player, mof_Map *map)
+{
+  mof_Raycasterbuffer *buffer = &raycaster->buffer;
+  mof_Texture *texture;
+  double offset;
+  int cell;
+  int bottom, top, position = 0;
+  int level, size, u;
+  Uint32 ceiling, ground;
+  
+  /* check if we have a valid mof_Framebuffer object */
+  mof_Framebuffer__check(framebuffer);
+  
+  ceiling = mof_Framebuffer__color(framebuffer, 106, 106, 106);
+  ground = mof_Framebuffer__color(framebuffer, 40, 40, 40);
+  
+  for (position = 0; position < MOF_MAP_MATERIALS; position++)
+  {
+	mof_Texture__format(map->materials[position], framebuffer->surface->format);
+  }
+  mof_Texture__format(map->ground, framebuffer->surface->format);
+  mof_Texture__format(map->ceiling, framebuffer->surface->format);
+  
+  for (position = 0; position < camera->width; position++)
+  {
+	cell = buffer->cell[position];
+	if (cell < 0)
+	{
+	  raycaster->tops[position] = camera->height / 2;
+	  raycaster->bottoms[position] = (camera->height / 2) - 1;
+	  if (!raycaster->flats)
+	  {
+		mof_Framebuffer__vspan(framebuffer, position, 0, (camera->height / 2) - 1, ceiling);
+		mof_Framebuffer__vspan(framebuffer, position, (camera->height / 2), camera->height - 1, ground);
+	  }
+	  continue;
+	}
+	
+	/* get top and bottom of wall */
+	mof_Raycaster__slice(raycaster, camera, buffer->depth[position], &top, &bottom);
+	raycaster->tops[position] = top;
+	raycaster->bottoms[position] = bottom;
+	
+	/* texture column, from left to right as seen from the front of the wall */
+	if (buffer->side[position])
+	{
+	  offset = buffer->y[position] - (cell / map->width) * map->unit;
+	  if (buffer->x[position] > (cell % map->width) * map->unit + (map->unit / 2))
+		offset = map->unit - offset;
+	}
+	else
+	{
+	  offset = buffer->x[position] - (cell % map->width) * map->unit;
+	  if (buffer->y[position] < (cell / map->width) * map->unit + (map->unit / 2))
+		offset = map->unit - offset;
+	}
+	
+	texture = map->materials[buffer->material[position]];
+	level = mof_Texture__level(texture, bottom - top + 1);
+	size = texture->size >> level;
+	u = (int)(offset * size / map->unit);
+	if (u < 0)
+	  u = 0;
+	if (u >= size)
+	  u = size - 1;
+	
+	/* draw wall slice (vertical walls are shaded) */
+	mof_Framebuffer__vtexture(framebuffer, position, top, bottom, mof_Texture__column(texture, buffer->side[position], level, u), size,
+							  0, ((Uint32)size << 16) / (bottom - top + 1));
+	if (!raycaster->flats)
+	{
+	  mof_Framebuffer__vspan(framebuffer, position, 0, top - 1, ceiling);
+	  mof_Framebuffer__vspan(framebuffer, position, bottom + 1, camera->height - 1, ground);
+	}
+  }
+  
+  if (raycaster->flats)
+	mof_Raycaster__drawflats(framebuffer, raycaster, camera, map);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,529 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.10
+ * @since 2012-02-21
+ * 
+ * This class keep the frame time in a budget by changing the resolution the
+ * 3D view is drawn at.  The view is drawn in an internal surface (in the
+ * format of the screen) and upscaled to the screen, either nearest (any
+ * surface) or bilinear (32 bits surfaces, SSE2 when the processor support
+ * it).  The governor is given the time the last frame took and change the
+ * scale in small steps, the number of columns casted then follow the budget
+ * instead of the width of the window.  When the screen is being presented
+ * while the next view is drawn (pipelined frames), the view is always drawn
+ * in the internal surface, even at full scale.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MOF_RESOLUTION_SIMD
+#include <emmintrin.h>
+#endif
+
+#include "SDL.h"
+
+#ifndef MOF_RESOLUTION_H_
+#define MOF_RESOLUTION_H_
+
+#define MOF_RESOLUTION_TYPE (1<<14)		/* dynamic type checking */
+#define MOF_RESOLUTION_NEAREST 0			/* upscaling filters */
+#define MOF_RESOLUTION_BILINEAR 1
+#define MOF_RESOLUTION_ALIGN 8				/* the width is a multiple of it (packets of rays) */
+
+/**
+ * mof_Resolution class.
+ */
+typedef struct {
+  unsigned int type;
+  long long budget;					/* frame time to hold (microsecond) */
+  double scale;						/* internal width over screen width */
+  double minimum;					/* smallest scale allowed */
+  int filter;						/* MOF_RESOLUTION_NEAREST or MOF_RESOLUTION_BILINEAR */
+  SDL_Surface *surface;				/* internal surface (NULL until needed) */
+  SDL_Surface *target;				/* surface the view is drawn to this frame */
+  int offscreen;					/* never draw the view on the screen itself */
+  int *columns;						/* source column (and weight) of every screen column */
+  Uint16 *weights;					/* weights of both source pixels, for every channel (bilinear) */
+  Uint32 *row;						/* two source lines blended (bilinear) */
+  int capacity;
+} mof_Resolution;
+
+/**
+ * Constructor.
+ * 
+ * @param resolution Pointer to a mof_Resolution object.
+ * @param budget     Frame time to hold (microsecond).
+ * @param minimum    Smallest scale allowed (0 to 1).
+ */
+void mof_Resolution__construct(mof_Resolution *resolution, long long budget, double minimum)
+{
+  /* here OR the MOF_RESOLUTION_TYPE constant into the type */
+  resolution->type |= MOF_RESOLUTION_TYPE;
+
+  resolution->budget = budget;
+  resolution->scale = 1;
+  resolution->minimum = minimum;
+  resolution->filter = MOF_RESOLUTION_BILINEAR;
+  resolution->surface = NULL;
+  resolution->target = NULL;
+  resolution->offscreen = 0;
+  resolution->columns = NULL;
+  resolution->weights = NULL;
+  resolution->row = NULL;
+  resolution->capacity = 0;
+}
+
+/**
+ * New.
+ * 
+ * @param budget  Frame time to hold (microsecond).
+ * @param minimum Smallest scale allowed (0 to 1).
+ * @return        An object mof_Resolution.
+ */
+mof_Resolution *mof_Resolution__new(long long budget, double minimum)
+{
+  mof_Resolution *resolution = malloc(sizeof(mof_Resolution));
+  resolution->type = MOF_RESOLUTION_TYPE;
+
+  /* call the constructor */
+  mof_Resolution__construct(resolution, budget, minimum);
+
+  return resolution;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param resolution Pointer to a mof_Resolution object.
+ */
+void mof_Resolution__check(mof_Resolution *resolution)
+{
+  /* check if we have a valid mof_Resolution object */
+  if (resolution == NULL ||
+	  !(resolution->type & MOF_RESOLUTION_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param resolution Pointer to a mof_Resolution object.
+ */
+void mof_Resolution__destroy(mof_Resolution *resolution)
+{
+  /* check if we have a valid mof_Resolution object */
+  mof_Resolution__check(resolution);
+
+  /* set type to 0 indicate this is no longer a mof_Resolution object */
+  resolution->type = 0;
+
+  /* free the memory allocated for the object */
+  if (resolution->surface != NULL)
+	SDL_FreeSurface(resolution->surface);
+  free(resolution->columns);
+  free(resolution->weights);
+  free(resolution->row);
+  free(resolution);
+}
+
+/**
+ * Pick the scale of the next frame.
+ * 
+ * The time of a frame is about proportional to the number of pixels, so
+ * the scale move by the square root of the budget over the time measured.
+ * Nothing change while the time is a little under the budget, and the steps
+ * are small, so the resolution does not oscillate.
+ * 
+ * @param resolution Pointer to a mof_Resolution object.
+ * @param usec       Time taken by the last frame (see mof_Time).
+ */
+void mof_Resolution__govern(mof_Resolution *resolution, long long usec)
+{
+  double factor;
+
+  /* check if we have a valid mof_Resolution object */
+  mof_Resolution__check(resolution);
+
+  if (usec <= 0 || (usec <= resolution->budget && usec * 5 >= resolution->budget * 4))
+	return;
+
+  factor = sqrt((double)resolution->budget * 0.9 / usec);
+  if (factor > 1.1)
+	factor = 1.1;
+  if (factor < 0.8)
+	factor = 0.8;
+
+  resolution->scale *= factor;
+  if (resolution->scale > 1)
+	resolution->scale = 1;
+  if (resolution->scale < resolution->minimum)
+	resolution->scale = resolution->minimum;
+}
+
+/**
+ * Surface to draw the view to.
+ * 
+ * The screen itself at full scale (unless offscreen), otherwise the internal
+ * surface (created again when its dimension or the format of the screen
+ * change).
+ * 
+ * @param resolution Pointer to a mof_Resolution object.
+ * @param screen     Surface of the screen.
+ * @return           Surface to draw to, must be given to mof_Resolution__present.
+ */
+SDL_Surface *mof_Resolution__target(mof_Resolution *resolution, SDL_Surface *screen)
+{
+  SDL_PixelFormat *format = screen->format;
+  int width, height;
+
+  /* check if we have a valid mof_Resolution object */
+  mof_Resolution__check(resolution);
+
+  width = (int)(screen->w * resolution->scale) / MOF_RESOLUTION_ALIGN * MOF_RESOLUTION_ALIGN;
+  if (width < MOF_RESOLUTION_ALIGN)
+	width = MOF_RESOLUTION_ALIGN;
+
+  if (width >= screen->w)
+  {
+	if (!resolution->offscreen)
+	{
+	  resolution->target = screen;
+	  return screen;
+	}
+	width = screen->w;
+  }
+
+  height = (int)((long long)screen->h * width / screen->w);
+  if (height < 1)
+	height = 1;
+
+  if (resolution->surface == NULL || resolution->surface->w != width || resolution->surface->h != height ||
+	  resolution->surface->format->BitsPerPixel != format->BitsPerPixel || resolution->surface->format->Rmask != format->Rmask ||
+	  resolution->surface->format->Gmask != format->Gmask || resolution->surface->format->Bmask != format->Bmask)
+  {
+	if (resolution->surface != NULL)
+	  SDL_FreeSurface(resolution->surface);
+	resolution->surface = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, format->BitsPerPixel,
+											   format->Rmask, format->Gmask, format->Bmask, format->Amask);
+  }
+
+  resolution->target = resolution->surface;
+  return resolution->surface;
+}
+
+/**
+ * Upscale with the nearest pixel.
+ * 
+ * Lines of the screen showing the same source line are copied from the
+ * previous one.
+ * 
+ * @param source      Surface to upscale (locked).
+ * @param destination Surface to write to (locked, same format).
+ * @param columns     Source column of every destination column.
+ */
+void mof_Resolution__nearest(SDL_Surface *source, SDL_Surface *destination, int *columns)
+{
+  int bpp = destination->format->BytesPerPixel;
+  int x, y, line, previous = -1;
+  Uint8 *from, *to;
+
+  for (y = 0; y < destination->h; y++)
+  {
+	to = (Uint8 *)destination->pixels + y * destination->pitch;
+	line = (int)((long long)y * source->h / destination->h);
+	if (line == previous)
+	{
+	  memcpy(to, to - destination->pitch, destination->w * bpp);
+	  continue;
+	}
+	previous = line;
+
+	from = (Uint8 *)source->pixels + line * source->pitch;
+	switch (bpp)
+	{
+	  case 1:
+		for (x = 0; x < destination->w; x++)
+		  to[x] = from[columns[x]];
+		break;
+
+	  case 2:
+		for (x = 0; x < destination->w; x++)
+		  ((Uint16 *)to)[x] = ((Uint16 *)from)[columns[x]];
+		break;
+
+	  case 3:
+		for (x = 0; x < destination->w; x++)
+		  memcpy(to + x * 3, from + columns[x] * 3, 3);
+		break;
+
+	  default:
+		for (x = 0; x < destination->w; x++)
+		  ((Uint32 *)to)[x] = ((Uint32 *)from)[columns[x]];
+		break;
+	}
+  }
+}
+
+/**
+ * Blend two lines of pixels (32 bits).
+ * 
+ * @param row    Blended pixels.
+ * @param top    First line.
+ * @param bottom Second line.
+ * @param count  Number of pixels.
+ * @param weight Weight of the second line (0 to 255).
+ */
+void mof_Resolution__blend(Uint32 *row, const Uint32 *top, const Uint32 *bottom, int count, int weight)
+{
+  int x, channel;
+
+  for (x = 0; x < count; x++)
+  {
+	row[x] = 0;
+	for (channel = 0; channel < 32; channel += 8)
+	{
+	  row[x] |= ((((top[x] >> channel) & 0xff) * (256 - weight) + ((bottom[x] >> channel) & 0xff) * weight) >> 8) << channel;
+	}
+  }
+}
+
+/**
+ * Blend the pixels of a line two by two (32 bits).
+ * 
+ * @param to      Destination line.
+ * @param row     Source line (one more pixel than the last column).
+ * @param columns Source column and weight (0 to 255) of every destination column.
+ * @param count   Number of destination pixels.
+ */
+void mof_Resolution__stretch(Uint32 *to, const Uint32 *row, const int *columns, int count)
+{
+  int x, channel, weight;
+  const Uint32 *pixel;
+
+  for (x = 0; x < count; x++)
+  {
+	pixel = row + (columns[x] >> 8);
+	weight = columns[x] & 0xff;
+	to[x] = 0;
+	for (channel = 0; channel < 32; channel += 8)
+	{
+	  to[x] |= ((((pixel[0] >> channel) & 0xff) * (256 - weight) + ((pixel[1] >> channel) & 0xff) * weight) >> 8) << channel;
+	}
+  }
+}
+
+#ifdef MOF_RESOLUTION_SIMD
+
+/**
+ * Blend two lines of pixels (32 bits, SSE2).
+ * 
+ * Same as mof_Resolution__blend, four pixels at a time.
+ * 
+ * @param row    Blended pixels.
+ * @param top    First line.
+ * @param bottom Second line.
+ * @param count  Number of pixels.
+ * @param weight Weight of the second line (0 to 255).
+ */
+__attribute__((target("sse2")))
+void mof_Resolution__blend4(Uint32 *row, const Uint32 *top, const Uint32 *bottom, int count, int weight)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i first = _mm_set1_epi16(256 - weight);
+  __m128i second = _mm_set1_epi16(weight);
+  __m128i a, b, low, high;
+  int x;
+
+  for (x = 0; x + 4 <= count; x += 4)
+  {
+	a = _mm_loadu_si128((const __m128i *)(top + x));
+	b = _mm_loadu_si128((const __m128i *)(bottom + x));
+
+	/* channels on 16 bits, a * (256 - w) + b * w fit in 16 bits (unsigned) */
+	low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), first), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), second));
+	high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), first), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), second));
+	_mm_storeu_si128((__m128i *)(row + x), _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8)));
+  }
+
+  mof_Resolution__blend(row + x, top + x, bottom + x, count - x, weight);
+}
+
+/**
+ * Blend the pixels of a line two by two (32 bits, SSE2).
+ * 
+ * Same as mof_Resolution__stretch, two destination pixels at a time.
+ * 
+ * @param to      Destination line.
+ * @param row     Source line (one more pixel than the last column).
+ * @param columns Source column and weight (0 to 255) of every destination column.
+ * @param weights Weights of both source pixels for every channel (8 per column).
+ * @param count   Number of destination pixels.
+ */
+__attribute__((target("sse2")))
+void mof_Resolution__stretch4(Uint32 *to, const Uint32 *row, const int *columns, const Uint16 *weights, int count)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i a, b;
+  int x;
+
+  for (x = 0; x + 2 <= count; x += 2)
+  {
+	/* both pixels to blend, channels on 16 bits */
+	a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row + (columns[x] >> 8))), zero);
+	b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row + (columns[x + 1] >> 8))), zero);
+	a = _mm_mullo_epi16(a, _mm_loadu_si128((const __m128i *)(weights + x * 8)));
+	b = _mm_mullo_epi16(b, _mm_loadu_si128((const __m128i *)(weights + x * 8 + 8)));
+
+	/* sum of the two halves of each */
+	a = _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+	_mm_storel_epi64((__m128i *)(to + x), _mm_packus_epi16(_mm_srli_epi16(a, 8), zero));
+  }
+
+  mof_Resolution__stretch(to + x, row, columns + x, count - x);
+}
+
+#endif
+
+/**
+ * Upscale with a bilinear filter (32 bits).
+ * 
+ * The two source lines are blended once per destination line (and kept
+ * for the next one if it use the same), then the pixels of that line.
+ * 
+ * @param source      Surface to upscale (locked).
+ * @param destination Surface to write to (locked, same format).
+ * @param columns     Source column and weight of every destination column.
+ * @param weights     Weights of both source pixels for every channel.
+ * @param row         Line of source->w + 1 pixels.
+ */
+void mof_Resolution__bilinear(SDL_Surface *source, SDL_Surface *destination, int *columns, Uint16 *weights, Uint32 *row)
+{
+  int y, line, weight, position, previous = -1;
+  Uint32 *top, *bottom, *to;
+  int simd = 0;
+
+#ifdef MOF_RESOLUTION_SIMD
+  simd = __builtin_cpu_supports("sse2");
+#endif
+
+  for (y = 0; y < destination->h; y++)
+  {
+	/* center of the destination pixel in the source (24.8) */
+	position = (int)(((2LL * y + 1) * source->h * 256) / (2LL * destination->h)) - 128;
+	if (position < 0)
+	  position = 0;
+	line = position >> 8;
+	weight = (line + 1 < source->h) ? position & 0xff : 0;
+
+	if (position != previous)
+	{
+	  top = (Uint32 *)((Uint8 *)source->pixels + line * source->pitch);
+	  bottom = (weight) ? (Uint32 *)((Uint8 *)top + source->pitch) : top;
+#ifdef MOF_RESOLUTION_SIMD
+	  if (simd)
+		mof_Resolution__blend4(row, top, bottom, source->w, weight);
+	  else
+#endif
+		mof_Resolution__blend(row, top, bottom, source->w, weight);
+	  row[source->w] = row[source->w - 1];
+	  previous = position;
+	}
+
+	to = (Uint32 *)((Uint8 *)destination->pixels + y * destination->pitch);
+#ifdef MOF_RESOLUTION_SIMD
+	if (simd)
+	  mof_Resolution__stretch4(to, row, columns, weights, destination->w);
+	else
+#endif
+	  mof_Resolution__stretch(to, row, columns, destination->w);
+  }
+}
+
+/**
+ * Upscale a surface to another one.
+ * 
+ * Both surfaces must have the same format, the bilinear filter is only
+ * available on 32 bits surfaces (nearest otherwise).
+ * 
+ * @param resolution  Pointer to a mof_Resolution object.
+ * @param source      Surface to upscale.
+ * @param destination Surface to write to.
+ */
+void mof_Resolution__upscale(mof_Resolution *resolution, SDL_Surface *source, SDL_Surface *destination)
+{
+  int bilinear = (resolution->filter == MOF_RESOLUTION_BILINEAR && destination->format->BytesPerPixel == 4);
+  int x, i, position;
+
+  /* check if we have a valid mof_Resolution object */
+  mof_Resolution__check(resolution);
+
+  if (resolution->capacity < destination->w || resolution->capacity < source->w + 1)
+  {
+	resolution->capacity = (destination->w > source->w + 1) ? destination->w : source->w + 1;
+	resolution->columns = realloc(resolution->columns, resolution->capacity * sizeof(int));
+	resolution->weights = realloc(resolution->weights, resolution->capacity * 8 * sizeof(Uint16));
+	resolution->row = realloc(resolution->row, resolution->capacity * sizeof(Uint32));
+  }
+
+  /* source column of every destination column (with the weight in the low byte if bilinear) */
+  for (x = 0; x < destination->w; x++)
+  {
+	if (bilinear)
+	{
+	  position = (int)(((2LL * x + 1) * source->w * 256) / (2LL * destination->w)) - 128;
+	  resolution->columns[x] = (position < 0) ? 0 : position;
+	  for (i = 0; i < 4; i++)
+	  {
+		resolution->weights[x * 8 + i] = 256 - (resolution->columns[x] & 0xff);
+		resolution->weights[x * 8 + 4 + i] = resolution->columns[x] & 0xff;
+	  }
+	}
+	else
+	  resolution->columns[x] = (int)((long long)x * source->w / destination->w);
+  }
+
+  if (SDL_MUSTLOCK(source))
+	SDL_LockSurface(source);
+  if (SDL_MUSTLOCK(destination))
+	SDL_LockSurface(destination);
+
+  if (bilinear)
+	mof_Resolution__bilinear(source, destination, resolution->columns, resolution->weights, resolution->row);
+  else
+	mof_Resolution__nearest(source, destination, resolution->columns);
+
+  if (SDL_MUSTLOCK(destination))
+	SDL_UnlockSurface(destination);
+  if (SDL_MUSTLOCK(source))
+	SDL_UnlockSurface(source);
+}
+
+/**
+ * Show the view on the screen.
+ * 
+ * Nothing to do if it was drawn straight on the screen.
+ * 
+ * @param resolution Pointer to a mof_Resolution object.
+ * @param screen     Surface of the screen.
+ */
+void mof_Resolution__present(mof_Resolution *resolution, SDL_Surface *screen)
+{
+  /* check if we have a valid mof_Resolution object */
+  mof_Resolution__check(resolution);
+
+  if (resolution->target == NULL || resolution->target == screen)
+	return;
+
+  mof_Resolution__upscale(resolution, resolution->target, screen);
+}
+
+#endif
@@ -1,21 +1,25 @@
 /**
  * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
- * @version 1.10
+ * @version 1.71
  * @since 2012-01-31
  */
  
 #include <assert.h>
 #include <math.h>
 #include "SDL.h"
-#include "SDL_gfxPrimitives.h"
 
 #include "mof_avatar.h"
+#include "mof_camera.h"
+#include "mof_framebuffer.h"
 #include "mof_graphicelement.h"
+#include "mof_pvs.h"
+#include "mof_raycaster.h"
 
 #ifndef MOF_SPRITE_H_
 #define MOF_SPRITE_H_
 
 #define MOF_SPRITE_TYPE (1<<6)		/* dynamic type checking */
+#define MOF_SPRITE_NEAR 1.0			/* nearest depth a sprite is projected at */
 
 /**
  * mof_Sprite class.
@@ -105,64 +109,92 @@ void mof_Sprite__destroy(mof_Sprite *sprite)
  */
 void mof_Sprite__draw(mof_Sprite *sprite, int offsetX, int offsetY)
 {
-  boxRGBA(sprite->screen, ((mof_Avatar *)sprite)->x - 5 - offsetX, ((mof_Avatar *)sprite)->y - 5 - offsetY, 
-						  ((mof_Avatar *)sprite)->x + 5 - offsetX, ((mof_Avatar *)sprite)->y + 5 - offsetY, 0, 255, 0, 255);
+  mof_Framebuffer__box(sprite->screen, ((mof_Avatar *)sprite)->x - 5 - offsetX, ((mof_Avatar *)sprite)->y - 5 - offsetY, 
+					   ((mof_Avatar *)sprite)->x + 5 - offsetX, ((mof_Avatar *)sprite)->y + 5 - offsetY, 0, 255, 0, 255);
+}
+
+/**
+ * Pixels the sprite is drawn on (see mof_Sprite__draw).
+ * 
+ * @param sprite  Pointer to a mof_Sprite object.
+ * @param offsetX Offset for the X coordinate.
+ * @param offsetY Offset for the Y coordinate.
+ * @param box     Left, top, right and bottom pixels (included).
+ */
+void mof_Sprite__box(mof_Sprite *sprite, int offsetX, int offsetY, int *box)
+{
+  /* one more pixel around for the rounding */
+  box[0] = (int)floor(((mof_Avatar *)sprite)->x) - 6 - offsetX;
+  box[1] = (int)floor(((mof_Avatar *)sprite)->y) - 6 - offsetY;
+  box[2] = (int)floor(((mof_Avatar *)sprite)->x) + 6 - offsetX;
+  box[3] = (int)floor(((mof_Avatar *)sprite)->y) + 6 - offsetY;
 }
 
 /**
  * Drawing sprite (3D).
  * 
- * @param scene  Pointer to a mof_Graphicelement object.
- * @param sprite Pointer to a mof_Sprite object.
- * @param player Pointer to a mof_Player object.
+ * The walls are already on the screen (see mof_Raycaster__draw3Dscene), so
+ * the sprite is clipped against the depth buffer of every column it cover
+ * and only the runs of columns in front of the walls are added to the
+ * scene.  A sprite in a cell that can't be seen from the cell of the player
+ * is skipped without projecting it.
+ * 
+ * @param scene     Pointer to a mof_Graphicelement object.
+ * @param raycaster Pointer to a mof_Raycaster object (already casted).
+ * @param camera    Pointer to a mof_Camera object.
+ * @param pvs       Pointer to a mof_Pvs object (or NULL).
+ * @param sprite    Pointer to a mof_Sprite object.
+ * @param player    Pointer to a mof_Player object.
  */
-void mof_Sprite__draw3Dscene(mof_Graphicelement *scene, mof_Sprite *sprite, mof_Player *player)
+void mof_Sprite__draw3Dscene(mof_Graphicelement *scene, mof_Raycaster *raycaster, mof_Camera *camera, mof_Pvs *pvs, mof_Sprite *sprite, mof_Player *player)
 {
   /* check if we have a valid mof_Sprite object */
   mof_Sprite__check(sprite);
   
-  double distanceFromProjectionPlane = (player->screen->w / 2) / tan((60 / 2) * M_PI / 180);
+  if (pvs != NULL && !mof_Pvs__visiblepoint(pvs, ((mof_Avatar *)player)->x, ((mof_Avatar *)player)->y, 
+											((mof_Avatar *)sprite)->x, ((mof_Avatar *)sprite)->y))
+	return;
   
-  /* angle relative to player */
-  double angle;
-  double opp = ((mof_Avatar *)sprite)->y - ((mof_Avatar *)player)->y;
-  double adj = ((mof_Avatar *)sprite)->x - ((mof_Avatar *)player)->x;
-  
-  if (adj == 0 && opp < 0)
-	angle = 90;
-  else if (adj == 0)
-	angle = 270;	
-  else if (adj > 0 && opp <= 0)
-	angle = fabs(atan(opp / adj)) * 180 / M_PI;
-  else if (adj < 0 && opp <= 0)
-	angle = 180 - fabs(atan(opp / adj)) * 180 / M_PI;
-  else if (adj < 0 && opp > 0)
-	angle = 180 + fabs(atan(opp / adj)) * 180 / M_PI;
-  else
-	angle = 360 - fabs(atan(opp / adj)) * 180 / M_PI;
-
-  /* fuck this (working finally) */
-  angle = (fabs(angle - (double)((mof_Avatar *)player)->angle) > 90) ? 
-		  ((angle > (double)((mof_Avatar *)player)->angle) ? -(360 - fabs(angle - (double)((mof_Avatar *)player)->angle)) : (360 - fabs(angle - (double)((mof_Avatar *)player)->angle))) : 
-		  (angle - (double)((mof_Avatar *)player)->angle);
+  /* position on the screen (nothing to draw if behind the player) */
+  double screenX, depth;
+  if (!mof_Camera__project(camera, ((mof_Avatar *)player)->angle, ((mof_Avatar *)player)->x, ((mof_Avatar *)player)->y, 
+						   ((mof_Avatar *)sprite)->x, ((mof_Avatar *)sprite)->y, &screenX, &depth))
+	return;
   
-  /* distance from player */
-  double Sx = ((mof_Avatar *)sprite)->x;
-  double Sy = ((mof_Avatar *)sprite)->y;
-  double Px = ((mof_Avatar *)player)->x;
-  double Py = ((mof_Avatar *)player)->y;
-  double distance = sqrt(pow((Sx - Px), 2) + pow((Sy - Py), 2));
+  /* too near, the sprite would be larger than anything the screen can show */
+  if (depth < MOF_SPRITE_NEAR)
+	return;
   
   /* get top and bottom of sprite */
-  int bottom = (int)floor(10 * distanceFromProjectionPlane / distance + (player->screen->h / 2));
-  int top = (int)floor((-10) * distanceFromProjectionPlane / distance + (player->screen->h / 2));
+  int bottom = (int)floor(10 * camera->projection / depth + (camera->height / 2));
+  int top = (int)floor((-10) * camera->projection / depth + (camera->height / 2));
   double ratio = (double)(bottom - top) / 20;
   
-  int Ps = 0;
-  Ps = -floor((player->screen->w / 2) * angle / 30);
-  mof_Graphicelement__add(scene, distance, ((player->screen->w / 2) - (int)(10 * ratio) + Ps), top, 
-						  (((player->screen->w / 2) + (int)(10 * ratio) + Ps) - ((player->screen->w / 2) - (int)(10 * ratio) + Ps)), (bottom - top), 
-						  0, 255, 0, 255);
+  int left = (int)floor(screenX) - (int)(10 * ratio);
+  int right = (int)floor(screenX) + (int)(10 * ratio);
+  
+  /* only the lines of the screen (the rectangle is solid) */
+  if (top < 0)
+	top = 0;
+  if (bottom > camera->height - 1)
+	bottom = camera->height - 1;
+  
+  /* clip against the walls, one element per visible run of columns */
+  int column, first = -1;
+  int last = (right < raycaster->width - 1) ? right : raycaster->width - 1;
+  for (column = (left > 0) ? left : 0; column <= last + 1; column++)
+  {
+	if (column <= last && depth < raycaster->buffer.depth[column])
+	{
+	  if (first < 0)
+		first = column;
+	}
+	else if (first >= 0)
+	{
+	  mof_Graphicelement__rect(scene, depth, first, top, (column - 1 - first), (bottom - top), MOF_GRAPHICELEMENT_RGBA(0, 255, 0, 255));
+	  first = -1;
+	}
+  }
 }
 
 #endif
\ No newline at end of file
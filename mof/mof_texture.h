@@ -0,0 +1,312 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.10
+ * @since 2012-02-18
+ * 
+ * This class hold a wall texture and its mip levels.  Texels are stored
+ * column-major (all the texels of a column are contiguous) since a wall
+ * slice is sampled from top to bottom, one column at a time.  The texels
+ * are kept in RGB and converted once in the pixel format of the surface,
+ * the converted copy is only rebuilt if the format change.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include "SDL.h"
+
+#ifndef MOF_TEXTURE_H_
+#define MOF_TEXTURE_H_
+
+#define MOF_TEXTURE_TYPE (1<<12)		/* dynamic type checking */
+#define MOF_TEXTURE_LEVELS 7			/* 64x64 down to 1x1 */
+
+#define MOF_TEXTURE_BRICK 0				/* generated patterns */
+#define MOF_TEXTURE_STONE 1
+#define MOF_TEXTURE_WOOD 2
+#define MOF_TEXTURE_TILE 3
+#define MOF_TEXTURE_PLASTER 4
+
+/**
+ * mof_Texture class.
+ */
+typedef struct {
+  unsigned int type;
+  int size;							/* dimension of level 0 (power of two) */
+  int levels;
+  int offset[MOF_TEXTURE_LEVELS];	/* first texel of every level */
+  int count;						/* number of texels (all levels) */
+  Uint32 *texels;					/* 0xRRGGBB */
+  Uint32 *pixels;					/* texels in the surface format, lit then shaded */
+  Uint32 Rmask;						/* format of the converted pixels */
+  Uint32 Gmask;
+  Uint32 Bmask;
+  int bits;
+} mof_Texture;
+
+/**
+ * Noise used by the generated patterns.
+ * 
+ * @param u Coordinate of the texel.
+ * @param v Coordinate of the texel.
+ * @return  Value in [0, 32).
+ */
+int mof_Texture__noise(int u, int v)
+{
+  unsigned int hash = (u * 73856093u) ^ (v * 19349663u);
+  hash ^= hash >> 13;
+  hash *= 0x5bd1e995u;
+  return (hash >> 15) & 31;
+}
+
+/**
+ * Generate the level 0 of the texture.
+ * 
+ * @param texture Pointer to a mof_Texture object.
+ * @param pattern One of the MOF_TEXTURE_* pattern.
+ */
+void mof_Texture__generate(mof_Texture *texture, int pattern)
+{
+  int u, v, red, green, blue, noise;
+
+  for (u = 0; u < texture->size; u++)
+  {
+	for (v = 0; v < texture->size; v++)
+	{
+	  noise = mof_Texture__noise(u, v);
+	  switch (pattern)
+	  {
+		case MOF_TEXTURE_BRICK:
+		  /* bricks of 32x16, every other row shifted by half a brick */
+		  if ((v % 16) == 15 || ((u + ((v / 16) % 2) * 16) % 32) == 31)
+		  {
+			red = green = blue = 150 + noise;
+		  }
+		  else
+		  {
+			red = 150 + noise * 2;
+			green = 50 + noise;
+			blue = 40;
+		  }
+		  break;
+
+		case MOF_TEXTURE_STONE:
+		  /* blocks of 32x32 with darker edges */
+		  red = green = blue = 110 + noise * 2;
+		  if ((u % 32) == 0 || (v % 32) == 0)
+			red = green = blue = 60;
+		  break;
+
+		case MOF_TEXTURE_TILE:
+		  /* checkerboard of 32x32 */
+		  red = green = blue = ((((u / 32) + (v / 32)) % 2) ? 90 : 60) + noise;
+		  break;
+
+		case MOF_TEXTURE_PLASTER:
+		  red = green = blue = 100 + noise / 2;
+		  break;
+
+		default:
+		  /* vertical planks of 16 */
+		  red = 120 + noise + ((u * 7) % 16);
+		  green = 80 + noise / 2;
+		  blue = 40;
+		  if ((u % 16) == 0)
+			red = green = blue = 50;
+		  break;
+	  }
+
+	  texture->texels[u * texture->size + v] = (red << 16) | (green << 8) | blue;
+	}
+  }
+}
+
+/**
+ * Build the mip levels from the level 0.
+ * 
+ * Every texel is the average of the four texels of the previous level.
+ * 
+ * @param texture Pointer to a mof_Texture object.
+ */
+void mof_Texture__mipmap(mof_Texture *texture)
+{
+  int level, u, v, i, channel, sum;
+  int size = texture->size;
+  Uint32 *source, *destination, texel[4];
+
+  for (level = 1; level < texture->levels; level++)
+  {
+	source = texture->texels + texture->offset[level - 1];
+	destination = texture->texels + texture->offset[level];
+	size /= 2;
+
+	for (u = 0; u < size; u++)
+	{
+	  for (v = 0; v < size; v++)
+	  {
+		texel[0] = source[(u * 2) * (size * 2) + (v * 2)];
+		texel[1] = source[(u * 2) * (size * 2) + (v * 2) + 1];
+		texel[2] = source[(u * 2 + 1) * (size * 2) + (v * 2)];
+		texel[3] = source[(u * 2 + 1) * (size * 2) + (v * 2) + 1];
+
+		destination[u * size + v] = 0;
+		for (channel = 0; channel < 24; channel += 8)
+		{
+		  for (sum = 0, i = 0; i < 4; i++)
+			sum += (texel[i] >> channel) & 0xff;
+		  destination[u * size + v] |= (Uint32)(sum / 4) << channel;
+		}
+	  }
+	}
+  }
+}
+
+/**
+ * Constructor.
+ * 
+ * @param texture Pointer to a mof_Texture object.
+ * @param pattern One of the MOF_TEXTURE_* pattern.
+ */
+void mof_Texture__construct(mof_Texture *texture, int pattern)
+{
+  /* here OR the MOF_TEXTURE_TYPE constant into the type */
+  texture->type |= MOF_TEXTURE_TYPE;
+
+  texture->size = 1 << (MOF_TEXTURE_LEVELS - 1);
+  texture->levels = MOF_TEXTURE_LEVELS;
+  texture->count = 0;
+
+  int level;
+  for (level = 0; level < texture->levels; level++)
+  {
+	texture->offset[level] = texture->count;
+	texture->count += (texture->size >> level) * (texture->size >> level);
+  }
+
+  texture->texels = malloc(texture->count * sizeof(Uint32));
+  texture->pixels = malloc(2 * texture->count * sizeof(Uint32));
+  texture->bits = 0;
+
+  mof_Texture__generate(texture, pattern);
+  mof_Texture__mipmap(texture);
+}
+
+/**
+ * New.
+ * 
+ * @param pattern One of the MOF_TEXTURE_* pattern.
+ * @return        An object mof_Texture.
+ */
+mof_Texture *mof_Texture__new(int pattern)
+{
+  mof_Texture *texture = malloc(sizeof(mof_Texture));
+  texture->type = MOF_TEXTURE_TYPE;
+
+  /* call the constructor */
+  mof_Texture__construct(texture, pattern);
+
+  return texture;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param texture Pointer to a mof_Texture object.
+ */
+void mof_Texture__check(mof_Texture *texture)
+{
+  /* check if we have a valid mof_Texture object */
+  if (texture == NULL ||
+	  !(texture->type & MOF_TEXTURE_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param texture Pointer to a mof_Texture object.
+ */
+void mof_Texture__destroy(mof_Texture *texture)
+{
+  /* check if we have a valid mof_Texture object */
+  mof_Texture__check(texture);
+
+  /* set type to 0 indicate this is no longer a mof_Texture object */
+  texture->type = 0;
+
+  /* free the memory allocated for the object */
+  free(texture->texels);
+  free(texture->pixels);
+  free(texture);
+}
+
+/**
+ * Convert the texels in the pixel format of a surface.
+ * 
+ * Nothing is done if the texels are already in that format.  The shaded
+ * copy (used for the vertical walls) follow the lit one.
+ * 
+ * @param texture Pointer to a mof_Texture object.
+ * @param format  Pixel format of the surface.
+ */
+void mof_Texture__format(mof_Texture *texture, SDL_PixelFormat *format)
+{
+  if (texture->bits == format->BitsPerPixel && texture->Rmask == format->Rmask &&
+	  texture->Gmask == format->Gmask && texture->Bmask == format->Bmask)
+	return;
+
+  int i;
+  Uint32 texel;
+  for (i = 0; i < texture->count; i++)
+  {
+	texel = texture->texels[i];
+	texture->pixels[i] = SDL_MapRGB(format, (texel >> 16) & 0xff, (texel >> 8) & 0xff, texel & 0xff);
+	texture->pixels[texture->count + i] = SDL_MapRGB(format, ((texel >> 16) & 0xff) * 185 / 255,
+													 ((texel >> 8) & 0xff) * 185 / 255, (texel & 0xff) * 185 / 255);
+  }
+
+  texture->bits = format->BitsPerPixel;
+  texture->Rmask = format->Rmask;
+  texture->Gmask = format->Gmask;
+  texture->Bmask = format->Bmask;
+}
+
+/**
+ * Mip level for a slice.
+ * 
+ * The level is the largest one still having at least one texel per pixel.
+ * 
+ * @param texture Pointer to a mof_Texture object.
+ * @param height  Height of the slice on the screen (pixel).
+ * @return        Level of the texture.
+ */
+int mof_Texture__level(mof_Texture *texture, int height)
+{
+  int level = 0;
+  while (level < texture->levels - 1 && (texture->size >> (level + 1)) >= height)
+  {
+	level++;
+  }
+
+  return level;
+}
+
+/**
+ * Column of texels (converted).
+ * 
+ * @param texture Pointer to a mof_Texture object.
+ * @param shaded  True (1) for the shaded copy.
+ * @param level   Mip level.
+ * @param u       Column in the level.
+ * @return        Pointer to the first texel of the column.
+ */
+Uint32 *mof_Texture__column(mof_Texture *texture, int shaded, int level, int u)
+{
+  return texture->pixels + (shaded ? texture->count : 0) + texture->offset[level] + u * (texture->size >> level);
+}
+
+#endif
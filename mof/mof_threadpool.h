@@ -0,0 +1,227 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.00
+ * @since 2012-02-14
+ * 
+ * This class keep a set of worker threads alive for the whole application.
+ * A job is split in a number of tasks, each worker (and the calling thread)
+ * take the next task available until there is none left, then the call
+ * return.  Tasks must write to distinct memory so the result never depend
+ * on which thread did what.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "SDL.h"
+#include "SDL_thread.h"
+
+#ifndef MOF_THREADPOOL_H_
+#define MOF_THREADPOOL_H_
+
+#define MOF_THREADPOOL_TYPE (1<<9)		/* dynamic type checking */
+
+struct mof_ThreadpoolStruct;
+
+/**
+ * Worker of the pool.
+ */
+typedef struct {
+  struct mof_ThreadpoolStruct *pool;
+  SDL_Thread *thread;
+  SDL_sem *start;					/* posted when a job is ready */
+} mof_Threadpoolworker;
+
+/**
+ * mof_Threadpool class.
+ */
+typedef struct mof_ThreadpoolStruct {
+  unsigned int type;
+  int count;						/* number of threads (including the caller) */
+  mof_Threadpoolworker *workers;	/* count - 1 workers */
+  SDL_sem *done;					/* posted when a worker is out of task */
+  void (*job)(void *data, int task, int tasks);
+  void *data;
+  int tasks;						/* number of tasks of the current job */
+  int next;							/* next task to take */
+  int running;
+} mof_Threadpool;
+
+/**
+ * Take and execute tasks until there is none left.
+ * 
+ * @param pool Pointer to a mof_Threadpool object.
+ */
+void mof_Threadpool__work(mof_Threadpool *pool)
+{
+  int task;
+  while ((task = __sync_fetch_and_add(&pool->next, 1)) < pool->tasks)
+  {
+	pool->job(pool->data, task, pool->tasks);
+  }
+}
+
+/**
+ * Main loop of a worker thread.
+ * 
+ * @param data Pointer to a mof_Threadpoolworker.
+ * @return     0 (meaning we're done)
+ */
+int mof_Threadpool__thread(void *data)
+{
+  mof_Threadpoolworker *worker = data;
+
+  while (1)
+  {
+	SDL_SemWait(worker->start);
+	if (!worker->pool->running)
+	  break;
+
+	mof_Threadpool__work(worker->pool);
+	SDL_SemPost(worker->pool->done);
+  }
+
+  return 0;
+}
+
+/**
+ * Constructor.
+ * 
+ * @param pool  Pointer to a mof_Threadpool object.
+ * @param count Number of threads, 0 for one per processor.
+ */
+void mof_Threadpool__construct(mof_Threadpool *pool, int count)
+{
+  /* here OR the MOF_THREADPOOL_TYPE constant into the type */
+  pool->type |= MOF_THREADPOOL_TYPE;
+
+  if (count <= 0)
+	count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (count <= 0)
+	count = 1;
+
+  pool->count = count;
+  pool->done = SDL_CreateSemaphore(0);
+  pool->job = NULL;
+  pool->data = NULL;
+  pool->tasks = 0;
+  pool->next = 0;
+  pool->running = 1;
+
+  /* the calling thread is the first worker */
+  pool->workers = malloc((count - 1) * sizeof(mof_Threadpoolworker) + 1);
+
+  int i;
+  for (i = 0; i < count - 1; i++)
+  {
+	pool->workers[i].pool = pool;
+	pool->workers[i].start = SDL_CreateSemaphore(0);
+	pool->workers[i].thread = SDL_CreateThread(mof_Threadpool__thread, &pool->workers[i]);
+  }
+}
+
+/**
+ * New.
+ * 
+ * @param count Number of threads, 0 for one per processor.
+ * @return      An object mof_Threadpool.
+ */
+mof_Threadpool *mof_Threadpool__new(int count)
+{
+  mof_Threadpool *pool = malloc(sizeof(mof_Threadpool));
+  pool->type = MOF_THREADPOOL_TYPE;
+
+  /* call the constructor */
+  mof_Threadpool__construct(pool, count);
+
+  return pool;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param pool Pointer to a mof_Threadpool object.
+ */
+void mof_Threadpool__check(mof_Threadpool *pool)
+{
+  /* check if we have a valid mof_Threadpool object */
+  if (pool == NULL ||
+	  !(pool->type & MOF_THREADPOOL_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param pool Pointer to a mof_Threadpool object.
+ */
+void mof_Threadpool__destroy(mof_Threadpool *pool)
+{
+  /* check if we have a valid mof_Threadpool object */
+  mof_Threadpool__check(pool);
+
+  /* set type to 0 indicate this is no longer a mof_Threadpool object */
+  pool->type = 0;
+
+  /* wake up the workers so they can quit */
+  pool->running = 0;
+
+  int i;
+  for (i = 0; i < pool->count - 1; i++)
+  {
+	SDL_SemPost(pool->workers[i].start);
+  }
+  for (i = 0; i < pool->count - 1; i++)
+  {
+	SDL_WaitThread(pool->workers[i].thread, NULL);
+	SDL_DestroySemaphore(pool->workers[i].start);
+  }
+
+  /* free the memory allocated for the object */
+  SDL_DestroySemaphore(pool->done);
+  free(pool->workers);
+  free(pool);
+}
+
+/**
+ * Run a job.
+ * 
+ * The job is called once for every task, from any thread of the pool.  The
+ * call return when all tasks are done.
+ * 
+ * @param pool  Pointer to a mof_Threadpool object.
+ * @param job   Function doing one task.
+ * @param data  Data given to the job.
+ * @param tasks Number of tasks.
+ */
+void mof_Threadpool__run(mof_Threadpool *pool, void (*job)(void *data, int task, int tasks), void *data, int tasks)
+{
+  /* check if we have a valid mof_Threadpool object */
+  mof_Threadpool__check(pool);
+
+  pool->job = job;
+  pool->data = data;
+  pool->tasks = tasks;
+  pool->next = 0;
+
+  /* SDL_SemPost act as a barrier, the workers see the job set above */
+  int i;
+  for (i = 0; i < pool->count - 1; i++)
+  {
+	SDL_SemPost(pool->workers[i].start);
+  }
+
+  mof_Threadpool__work(pool);
+
+  for (i = 0; i < pool->count - 1; i++)
+  {
+	SDL_SemWait(pool->done);
+  }
+}
+
+#endif
@@ -99,7 +99,7 @@ long long mof_Time__gettime_usec(mof_Time *time)
 
   struct timeval result;
   timersub(&time->stop, &time->start, &result);
-  return result.tv_usec;
+  return result.tv_sec * 1000000LL + result.tv_usec;
 }
 
 /**
@@ -114,7 +114,7 @@ long long mof_Time__gettime_msec(mof_Time *time)
 
   struct timeval result;
   timersub(&time->stop, &time->start, &result);
-  return result.tv_usec / 1000;
+  return (result.tv_sec * 1000000LL + result.tv_usec) / 1000;
 }
 
 /**
@@ -131,7 +131,7 @@ long long mof_Time__gettime_elapsed_usec(mof_Time *time)
   struct timeval result;
   gettimeofday(&now, NULL);
   timersub(&now, &time->start, &result);
-  return result.tv_usec;
+  return result.tv_sec * 1000000LL + result.tv_usec;
 }
 
 /**
@@ -148,7 +148,7 @@ long long mof_Time__gettime_elapsed_msec(mof_Time *time)
   struct timeval result;
   gettimeofday(&now, NULL);
   timersub(&now, &time->start, &result);
-  return result.tv_usec / 1000;
+  return (result.tv_sec * 1000000LL + result.tv_usec) / 1000;
 }
 
 /**
@@ -0,0 +1,451 @@
+/**
+ * @author Sebastien Bolduc <sebastien.bolduc@gmail.com>
+ * @version 1.01
+ * @since 2012-02-22
+ * 
+ * This class tell which agents can see which others, for all the pairs at
+ * once (a bit matrix).  Like the potentially visible set, the line of sight
+ * is checked between the centers of the cells of the agents, so a pair only
+ * need to be checked again when one of its agents change of cell: the pairs
+ * of the agents that stayed in their cell are kept from the previous update.
+ * A line is only walked (integer grid traversal, stopping at the first wall)
+ * when the distance field or the mof_Pvs can not answer right away.  Only
+ * half of the pairs are checked (the matrix is symmetric), rows are spread
+ * on a mof_Threadpool.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mof_map.h"
+#include "mof_pvs.h"
+#include "mof_threadpool.h"
+
+#ifndef MOF_VISIBILITY_H_
+#define MOF_VISIBILITY_H_
+
+#define MOF_VISIBILITY_TYPE (1<<15)		/* dynamic type checking */
+#define MOF_VISIBILITY_ROWS 4				/* tasks per thread (load balancing) */
+
+/**
+ * mof_Visibility class.
+ */
+typedef struct {
+  unsigned int type;
+  int count;						/* number of agents */
+  int capacity;						/* agents the matrices have room for */
+  int words;						/* words per row of a matrix */
+  Uint32 *matrix;					/* bit j of row i set if agent i see agent j */
+  Uint32 *upper;					/* same, only for j > i */
+  int *cells;						/* cell of every agent (-1 out of the map) */
+  unsigned char *moved;				/* agent changed of cell since the previous update */
+  mof_Threadpool *pool;				/* NULL to check on the calling thread only */
+  mof_Pvs *pvs;						/* NULL if there is none */
+  mof_Map *map;						/* map of the previous update */
+  int *mapcells;
+  int valid;						/* true (1) if the previous update can be reused */
+  int checked;						/* pairs checked by the last update */
+} mof_Visibility;
+
+/**
+ * Constructor.
+ * 
+ * @param visibility Pointer to a mof_Visibility object.
+ * @param pool       Pointer to a mof_Threadpool object (or NULL).
+ * @param pvs        Pointer to a mof_Pvs object of the map (or NULL).
+ */
+void mof_Visibility__construct(mof_Visibility *visibility, mof_Threadpool *pool, mof_Pvs *pvs)
+{
+  /* here OR the MOF_VISIBILITY_TYPE constant into the type */
+  visibility->type |= MOF_VISIBILITY_TYPE;
+
+  visibility->count = 0;
+  visibility->capacity = 0;
+  visibility->words = 0;
+  visibility->matrix = NULL;
+  visibility->upper = NULL;
+  visibility->cells = NULL;
+  visibility->moved = NULL;
+  visibility->pool = pool;
+  visibility->pvs = pvs;
+  visibility->map = NULL;
+  visibility->mapcells = NULL;
+  visibility->valid = 0;
+  visibility->checked = 0;
+}
+
+/**
+ * New.
+ * 
+ * @param pool Pointer to a mof_Threadpool object (or NULL).
+ * @param pvs  Pointer to a mof_Pvs object of the map (or NULL).
+ * @return     An object mof_Visibility.
+ */
+mof_Visibility *mof_Visibility__new(mof_Threadpool *pool, mof_Pvs *pvs)
+{
+  mof_Visibility *visibility = malloc(sizeof(mof_Visibility));
+  visibility->type = MOF_VISIBILITY_TYPE;
+
+  /* call the constructor */
+  mof_Visibility__construct(visibility, pool, pvs);
+
+  return visibility;
+}
+
+/**
+ * Check object for validity.
+ * 
+ * Check to see if the object we are trying to interact with is of
+ * the good type.
+ * 
+ * @param visibility Pointer to a mof_Visibility object.
+ */
+void mof_Visibility__check(mof_Visibility *visibility)
+{
+  /* check if we have a valid mof_Visibility object */
+  if (visibility == NULL ||
+	  !(visibility->type & MOF_VISIBILITY_TYPE))
+  {
+	assert(0);
+  }
+}
+
+/**
+ * Destructor.
+ * 
+ * @param visibility Pointer to a mof_Visibility object.
+ */
+void mof_Visibility__destroy(mof_Visibility *visibility)
+{
+  /* check if we have a valid mof_Visibility object */
+  mof_Visibility__check(visibility);
+
+  /* set type to 0 indicate this is no longer a mof_Visibility object */
+  visibility->type = 0;
+
+  /* free the memory allocated for the object */
+  free(visibility->matrix);
+  free(visibility->upper);
+  free(visibility->cells);
+  free(visibility->moved);
+  free(visibility);
+}
+
+/**
+ * Line of sight between two cells.
+ * 
+ * The line joins the centers of the cells.  Every cell it cross is
+ * checked in order, with integer arithmetic only; a line going exactly
+ * through the corner of a cell is only blocked if both cells touching the
+ * corner are walls.
+ * 
+ * @param map  Pointer to a mof_Map object.
+ * @param from Index of the first cell in the map array.
+ * @param to   Index of the second cell in the map array.
+ * @return     True (1) if no wall is in between, false (0) otherwise.
+ */
+int mof_Visibility__trace(mof_Map *map, int from, int to)
+{
+  int dx = to % map->width - from % map->width, dy = to / map->width - from / map->width;
+  int stepX = (dx < 0) ? -1 : 1, stepY = (dy < 0) ? -map->width : map->width;
+  int ax = abs(dx), ay = abs(dy);
+  int reach = (ax > ay) ? ax : ay;
+  int cell = from;
+  long long crossX, crossY;
+
+  /* the square around either cell is empty up to its distance field */
+  if (reach < map->distances[from] || reach < map->distances[to])
+	return 1;
+
+  /* distances to the next grid lines, scaled by 2 * ax * ay */
+  crossX = ay;
+  crossY = ax;
+
+  while (1)
+  {
+	if (ay == 0 || (ax != 0 && crossX < crossY))
+	{
+	  cell += stepX;
+	  crossX += 2 * ay;
+	}
+	else if (ax == 0 || crossY < crossX)
+	{
+	  cell += stepY;
+	  crossY += 2 * ax;
+	}
+	else
+	{
+	  /* through a corner */
+	  if (map->map[cell + stepX] && map->map[cell + stepY])
+		return 0;
+	  cell += stepX + stepY;
+	  crossX += 2 * ay;
+	  crossY += 2 * ax;
+	}
+
+	if (cell == to)
+	  return 1;
+	if (map->map[cell])
+	  return 0;
+  }
+}
+
+/**
+ * Check the pairs of some rows (job of the mof_Threadpool).
+ * 
+ * Only the upper half of the rows is written, every task own its rows.
+ * 
+ * @param data  Pointer to a mof_Visibility object.
+ * @param task  Index of the task (rows task, task + tasks, ...).
+ * @param tasks Number of tasks.
+ */
+void mof_Visibility__job(void *data, int task, int tasks)
+{
+  mof_Visibility *visibility = data;
+  mof_Map *map = visibility->map;
+  Uint32 *row;
+  int i, j, from, to, seen, checked = 0;
+
+  for (i = task; i < visibility->count; i += tasks)
+  {
+	row = visibility->upper + i * visibility->words;
+	from = visibility->cells[i];
+
+	for (j = i + 1; j < visibility->count; j++)
+	{
+	  /* neither agent changed of cell */
+	  if (!visibility->moved[i] && !visibility->moved[j])
+		continue;
+
+	  to = visibility->cells[j];
+	  if (from < 0 || to < 0)
+		seen = 0;
+	  else if (from == to)
+		seen = 1;
+	  else if (visibility->pvs != NULL && !mof_Pvs__visible(visibility->pvs, from, to))
+		seen = 0;
+	  else
+		seen = mof_Visibility__trace(map, from, to);
+	  checked++;
+
+	  if (seen)
+		row[j >> 5] |= (Uint32)1 << (j & 31);
+	  else
+		row[j >> 5] &= ~((Uint32)1 << (j & 31));
+	}
+  }
+
+  __sync_fetch_and_add(&visibility->checked, checked);
+}
+
+/**
+ * Transpose a block of 32 x 32 bits in place.
+ * 
+ * Bit c of word r is swapped with bit r of word c, halves then quarters
+ * (and so on) of the block are swapped at once with masks.
+ * 
+ * @param block Array of 32 words.
+ */
+void mof_Visibility__transpose(Uint32 *block)
+{
+  Uint32 mask = 0x0000FFFF, swap;
+  int j, k;
+
+  for (j = 16; j != 0; j >>= 1, mask ^= mask << j)
+  {
+	for (k = 0; k < 32; k = (k + j + 1) & ~j)
+	{
+	  swap = ((block[k] >> j) ^ block[k + j]) & mask;
+	  block[k + j] ^= swap;
+	  block[k] ^= swap << j;
+	}
+  }
+}
+
+/**
+ * Check if an agent of a group of 32 changed of cell.
+ * 
+ * @param visibility Pointer to a mof_Visibility object.
+ * @param group      Index of the group (agents 32 * group to 32 * group + 31).
+ * @return           True (1) if one of them moved, false (0) otherwise.
+ */
+int mof_Visibility__movedgroup(mof_Visibility *visibility, int group)
+{
+  int i, end = (group + 1) * 32;
+
+  if (end > visibility->count)
+	end = visibility->count;
+  for (i = group * 32; i < end; i++)
+  {
+	if (visibility->moved[i])
+	  return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Fill the whole rows from the upper half (job of the mof_Threadpool).
+ * 
+ * The matrix is filled by blocks of 32 x 32 bits: a block right of the
+ * diagonal is copied from the upper half, a block left of it is the
+ * transposed block of the upper half, word by word.  A block is kept from
+ * the previous update when none of its 32 rows and 32 columns moved.
+ * 
+ * @param data  Pointer to a mof_Visibility object.
+ * @param task  Index of the task (groups of rows task, task + tasks, ...).
+ * @param tasks Number of tasks.
+ */
+void mof_Visibility__mirror(void *data, int task, int tasks)
+{
+  mof_Visibility *visibility = data;
+  int words = visibility->words, groups = (visibility->count + 31) / 32;
+  Uint32 block[32];
+  int i, j, r, rowsmoved;
+
+  for (i = task; i < groups; i += tasks)
+  {
+	rowsmoved = mof_Visibility__movedgroup(visibility, i);
+
+	for (j = 0; j < groups; j++)
+	{
+	  /* none of the pairs of the block changed */
+	  if (!rowsmoved && !mof_Visibility__movedgroup(visibility, j))
+		continue;
+
+	  if (j > i)
+	  {
+		for (r = 0; r < 32; r++)
+		  visibility->matrix[(i * 32 + r) * words + j] = visibility->upper[(i * 32 + r) * words + j];
+		continue;
+	  }
+
+	  for (r = 0; r < 32; r++)
+		block[r] = visibility->upper[(j * 32 + r) * words + i];
+	  mof_Visibility__transpose(block);
+
+	  if (j == i)
+	  {
+		/* only the bits above the diagonal are set in the upper half, an agent always see itself */
+		for (r = 0; r < 32; r++)
+		  block[r] |= visibility->upper[(i * 32 + r) * words + i] | (Uint32)1 << r;
+	  }
+
+	  for (r = 0; r < 32; r++)
+		visibility->matrix[(i * 32 + r) * words + j] = block[r];
+	}
+  }
+}
+
+/**
+ * Forget the previous update.
+ * 
+ * Must be called when the cells of the map are modified.
+ * 
+ * @param visibility Pointer to a mof_Visibility object.
+ */
+void mof_Visibility__invalidate(mof_Visibility *visibility)
+{
+  /* check if we have a valid mof_Visibility object */
+  mof_Visibility__check(visibility);
+
+  visibility->valid = 0;
+}
+
+/**
+ * Update the matrix.
+ * 
+ * The agents must keep their index from one update to the next, the new
+ * ones (past the previous count) are checked against everyone.
+ * 
+ * @param visibility Pointer to a mof_Visibility object.
+ * @param map        Pointer to a mof_Map object.
+ * @param count      Number of agents.
+ * @param x          Coordinate of every agent.
+ * @param y          Coordinate of every agent.
+ */
+void mof_Visibility__update(mof_Visibility *visibility, mof_Map *map, int count, const double *x, const double *y)
+{
+  int i, cell, cellX, cellY, tasks;
+
+  /* check if we have a valid mof_Visibility object */
+  mof_Visibility__check(visibility);
+
+  if (visibility->map != map || visibility->mapcells != map->map)
+	visibility->valid = 0;
+
+  if (count > visibility->capacity)
+  {
+	visibility->capacity = (count + 31) & ~31;
+	visibility->words = visibility->capacity / 32;
+	free(visibility->matrix);
+	free(visibility->upper);
+	visibility->matrix = malloc(visibility->capacity * visibility->words * sizeof(Uint32));
+	visibility->upper = malloc(visibility->capacity * visibility->words * sizeof(Uint32));
+	visibility->cells = realloc(visibility->cells, visibility->capacity * sizeof(int));
+	visibility->moved = realloc(visibility->moved, visibility->capacity);
+	visibility->valid = 0;
+  }
+
+  if (!visibility->valid)
+  {
+	memset(visibility->upper, 0, visibility->capacity * visibility->words * sizeof(Uint32));
+	visibility->count = 0;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+	cellX = (int)floor(x[i] / map->unit);
+	cellY = (int)floor(y[i] / map->unit);
+	cell = (cellX < 0 || cellX >= map->width || cellY < 0 || cellY >= map->height) ? -1 : cellX + cellY * map->width;
+
+	visibility->moved[i] = (i >= visibility->count || visibility->cells[i] != cell);
+	visibility->cells[i] = cell;
+  }
+
+  visibility->count = count;
+  visibility->map = map;
+  visibility->mapcells = map->map;
+  visibility->valid = 1;
+  visibility->checked = 0;
+
+  if (visibility->pool == NULL || visibility->pool->count == 1)
+  {
+	mof_Visibility__job(visibility, 0, 1);
+	mof_Visibility__mirror(visibility, 0, 1);
+	return;
+  }
+
+  tasks = visibility->pool->count * MOF_VISIBILITY_ROWS;
+  mof_Threadpool__run(visibility->pool, mof_Visibility__job, visibility, tasks);
+  mof_Threadpool__run(visibility->pool, mof_Visibility__mirror, visibility, tasks);
+}
+
+/**
+ * Check if an agent can see another one.
+ * 
+ * @param visibility Pointer to a mof_Visibility object (updated).
+ * @param i          Index of the agent looking.
+ * @param j          Index of the agent looked at.
+ * @return           True (1) if in line of sight, false (0) otherwise.
+ */
+int mof_Visibility__visible(mof_Visibility *visibility, int i, int j)
+{
+  return (visibility->matrix[i * visibility->words + (j >> 5)] >> (j & 31)) & 1;
+}
+
+/**
+ * Agents seen by an agent.
+ * 
+ * @param visibility Pointer to a mof_Visibility object (updated).
+ * @param i          Index of the agent looking.
+ * @return           Bitset of the agents seen (bit j of word j / 32).
+ */
+const Uint32 *mof_Visibility__row(mof_Visibility *visibility, int i)
+{
+  return visibility->matrix + i * visibility->words;
+}
+
+#endif
@@ -4,22 +4,36 @@
  * @since 2012-01-15
  * 
  * gcc myownframework.c `sdl-config --cflags --libs` -lSDL_gfx -lSDL_ttf -o myownframework
+ * 
+ * ./myownframework --benchmark (report the speed of the renderer and quit)
+ * ./myownframework --depth 1 (frames in flight, 1 to draw every frame in sequence)
+ * ./myownframework --occlusion (draw the scenes front to back, skipping the pixels covered)
  */
 
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include "SDL.h"
 #include "SDL_gfxPrimitives.h"
 #include "SDL_ttf.h"
 
+#include "mof/mof_camera.h"
 #include "mof/mof_collisionbox.h"
 #include "mof/mof_font.h"
+#include "mof/mof_framebuffer.h"
 #include "mof/mof_graphicelement.h"
 #include "mof/mof_keyboard.h"
 #include "mof/mof_map.h"
+#include "mof/mof_mapview.h"
+#include "mof/mof_pipeline.h"
 #include "mof/mof_player.h"
+#include "mof/mof_pvs.h"
 #include "mof/mof_raycaster.h"
+#include "mof/mof_resolution.h"
 #include "mof/mof_sprite.h"
+#include "mof/mof_threadpool.h"
 #include "mof/mof_time.h"
+#include "mof/mof_visibility.h"
 
 SDL_Surface *screen;
 SDL_Event event;
@@ -28,20 +42,52 @@ const int WINDOW_WIDTH = 640;
 const int WINDOW_HEIGHT = 480;
 const char *WINDOW_TITLE = "My Own Framework";
 const char *WINDOW_FONT = "/home/user/Downloads/arial.ttf";
+const char *LEVEL_PVS = "level.pvs";
+const long long FRAME_BUDGET = 16667;		/* microsecond (60 frames per second) */
+const int FRAME_SPRITES = 4;
+
+/**
+ * Frame in flight (one per slot of the pipeline).
+ * 
+ * The world is copied in it when updated, the stages after only read the
+ * copy and draw with their own objects.
+ */
+typedef struct {
+  mof_Player *viewer;				/* copy of the player */
+  mof_Sprite *sprites[4];			/* copy of the sprites */
+  int mapflag;
+  int width;						/* dimension of the screen */
+  int height;
+  SDL_Surface *target;				/* surface the 3D view is drawn to */
+  mof_Camera *camera;
+  mof_Framebuffer *framebuffer;
+  mof_Graphicelement *scene;
+  mof_Raycaster *raycaster;
+  mof_Resolution *resolution;
+  mof_Time *build;					/* time taken by the stages */
+  mof_Time *rasterize;
+} mof__Frame;
 
+mof__Frame frames[MOF_PIPELINE_DEPTH];
 mof_Font *text = NULL;
-mof_Graphicelement *scene = NULL;
 mof_Map *level = NULL;
+mof_Mapview *mapview = NULL;
+mof_Pipeline *pipeline = NULL;
 mof_Player *player = NULL;
+mof_Pvs *visibility = NULL;
+mof_Resolution *resolution = NULL;
 mof_Sprite *sprite1 = NULL;
 mof_Sprite *sprite2 = NULL;
 mof_Sprite *sprite3 = NULL;
 mof_Sprite *sprite4 = NULL;
+mof_Threadpool *pool = NULL;
+mof_Threadpool *tiles = NULL;			/* rasterizer stage (a pool run one job at a time) */
 mof_Time *timer = NULL;
 
 char test[100] = {"/0"};
 int mapflag = 0;
 int release_m = 1;
+int running_loop = 1;
 
 /**
  * Initialization.
@@ -59,14 +105,36 @@ void mof__init()
   //SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL);
   
   level = mof_Map__new(screen);
+  mapview = mof_Mapview__new();
   player = mof_Player__new(screen, 320, 320, 90);
-  scene = mof_Graphicelement__new(-1.0, 0, 0, 0 , 0, 0, 0, 0, 0);
+  pool = mof_Threadpool__new(0);
+  tiles = mof_Threadpool__new(0);
+  visibility = mof_Pvs__new(level, pool, LEVEL_PVS);
+  resolution = mof_Resolution__new(FRAME_BUDGET, 0.25);
   sprite1 = mof_Sprite__new(screen, 320, 320);
   sprite2 = mof_Sprite__new(screen, 320, 96);
   sprite3 = mof_Sprite__new(screen, 672, 320);
   sprite4 = mof_Sprite__new(screen, 96, 534);
   text = mof_Font__new(screen, WINDOW_FONT);
   timer = mof_Time__new(); 
+  
+  int slot, i;
+  for (slot = 0; slot < MOF_PIPELINE_DEPTH; slot++)
+  {
+	frames[slot].viewer = mof_Player__new(screen, 320, 320, 90);
+	for (i = 0; i < FRAME_SPRITES; i++)
+	{
+	  frames[slot].sprites[i] = mof_Sprite__new(screen, 0, 0);
+	}
+	frames[slot].camera = mof_Camera__new(screen->w, screen->h, 60);
+	frames[slot].framebuffer = mof_Framebuffer__new();
+	frames[slot].scene = mof_Graphicelement__new();
+	frames[slot].scene->pool = tiles;
+	frames[slot].raycaster = mof_Raycaster__new(screen->w, pool);
+	frames[slot].resolution = mof_Resolution__new(FRAME_BUDGET, 0.25);
+	frames[slot].build = mof_Time__new();
+	frames[slot].rasterize = mof_Time__new();
+  }
 }
 
 /**
@@ -155,82 +223,957 @@ void mof__update(int *running_loop)
 }
 
 /**
- * Drawing.
+ * Updating a frame (first stage, calling thread).
+ * 
+ * The world is updated then copied in the frame, along with what the next
+ * stages need to know about the screen (they must not touch it).
+ * 
+ * @param data Array of mof__Frame.
+ * @param slot Frame to update.
  */
-void mof__draw()
-{	
-  /* clear the screen */
-  SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
+void mof__updateframe(void *data, int slot)
+{
+  mof__Frame *frame = (mof__Frame *)data + slot;
+  mof_Sprite *sprites[4] = {sprite1, sprite2, sprite3, sprite4};
+  int i;
   
-  int offsetX = mof_Player__offsetX(player, level, 320);
-  int offsetY = mof_Player__offsetY(player, level, 240);
+  mof__update(&running_loop);
   
-  if (mapflag)
+  *(mof_Avatar *)frame->viewer = *(mof_Avatar *)player;
+  frame->viewer->screen = screen;
+  for (i = 0; i < FRAME_SPRITES; i++)
   {
-	mof_Map__draw(level, offsetX, offsetY);
-	mof_Sprite__draw(sprite1, offsetX, offsetY);
-	mof_Sprite__draw(sprite2, offsetX, offsetY);
-	mof_Sprite__draw(sprite3, offsetX, offsetY);
-	mof_Sprite__draw(sprite4, offsetX, offsetY);
-    mof_Player__draw(player, offsetX, offsetY);
-    mof_Raycaster__draw(player, level, offsetX, offsetY);
+	*(mof_Avatar *)frame->sprites[i] = *(mof_Avatar *)sprites[i];
+	frame->sprites[i]->screen = screen;
   }
-  else 
+  frame->mapflag = mapflag;
+  frame->width = screen->w;
+  frame->height = screen->h;
+  
+  /* drawn at the resolution the frame budget allow, then upscaled */
+  frame->resolution->scale = resolution->scale;
+  frame->resolution->filter = resolution->filter;
+  frame->resolution->offscreen = (pipeline->depth > 1);
+  frame->target = (mapflag) ? NULL : mof_Resolution__target(frame->resolution, screen);
+  if (frame->target != NULL)
   {
-    mof_Raycaster__draw3Dscene(scene, player, level);
-	mof_Sprite__draw3Dscene(scene, sprite1, player);
-	mof_Sprite__draw3Dscene(scene, sprite2, player);
-	mof_Sprite__draw3Dscene(scene, sprite3, player);
-	mof_Sprite__draw3Dscene(scene, sprite4, player);
-	mof_Graphicelement__render(screen, scene);
+	frame->width = frame->target->w;
+	frame->height = frame->target->h;
   }
 }
 
 /**
- * Main function of the application.
+ * Building a frame (second stage).
  * 
- * @param argc Arguments passed on the command line (number).
- * @param argv Arguments passed on the command line (values).
- * @return     0 (meaning we're done)
+ * The rays are casted and the sprites clipped against them, ending up in
+ * the scene of the frame.
+ * 
+ * @param data Array of mof__Frame.
+ * @param slot Frame to build.
  */
-int main(int argc, char **argv)
+void mof__buildframe(void *data, int slot)
 {
-  mof__init();
+  mof__Frame *frame = (mof__Frame *)data + slot;
+  int i;
+  
+  mof_Time__start(frame->build);
+  
+  /* the frame before was built just before this one, its hits are reused */
+  mof_Camera__resize(frame->camera, frame->width, frame->height);
+  mof_Raycaster__follow(frame->raycaster, ((mof__Frame *)data + (slot + pipeline->depth - 1) % pipeline->depth)->raycaster);
+  mof_Raycaster__cast(frame->raycaster, frame->camera, frame->viewer, level);
+  if (!frame->mapflag)
+  {
+	for (i = 0; i < FRAME_SPRITES; i++)
+	{
+	  mof_Sprite__draw3Dscene(frame->scene, frame->raycaster, frame->camera, visibility, frame->sprites[i], frame->viewer);
+	}
+  }
+  
+  mof_Time__stop(frame->build);
+}
+
+/**
+ * Rasterizing a frame (third stage).
+ * 
+ * The 3D view is drawn in the target of the frame (the 2D map is drawn
+ * straight on the screen when presented).
+ * 
+ * @param data Array of mof__Frame.
+ * @param slot Frame to rasterize.
+ */
+void mof__rasterizeframe(void *data, int slot)
+{
+  mof__Frame *frame = (mof__Frame *)data + slot;
+  
+  mof_Time__start(frame->rasterize);
+  
+  if (!frame->mapflag)
+  {
+	/* the walls cover the whole view, no need to clear it (already casted) */
+	mof_Framebuffer__lock(frame->framebuffer, frame->target);
+	mof_Raycaster__draw3Dscene(frame->framebuffer, frame->raycaster, frame->camera, frame->viewer, level);
+	mof_Framebuffer__unlock(frame->framebuffer);
 	
-  int running_loop = 1;
-  while(running_loop)
+	mof_Graphicelement__render(frame->target, frame->scene);
+  }
+  
+  mof_Time__stop(frame->rasterize);
+}
+
+/**
+ * Drawing an item of the 2D map (see mof_Mapview__draw).
+ * 
+ * The sprites, the player then the rays.
+ * 
+ * @param data    Pointer to the mof__Frame presented.
+ * @param item    Index of the item.
+ * @param offsetX Offset for the X coordinate.
+ * @param offsetY Offset for the Y coordinate.
+ */
+void mof__drawmapitem(void *data, int item, int offsetX, int offsetY)
+{
+  mof__Frame *frame = data;
+  
+  if (item < FRAME_SPRITES)
+	mof_Sprite__draw(frame->sprites[item], offsetX, offsetY);
+  else if (item == FRAME_SPRITES)
+	mof_Player__draw(frame->viewer, offsetX, offsetY);
+  else
+	mof_Raycaster__draw(frame->raycaster, frame->camera, frame->viewer, level, offsetX, offsetY);
+}
+
+/**
+ * Presenting a frame (last stage, calling thread).
+ * 
+ * @param data Array of mof__Frame.
+ * @param slot Frame to present.
+ */
+void mof__presentframe(void *data, int slot)
+{
+  mof__Frame *frame = (mof__Frame *)data + slot;
+  long long build = mof_Time__gettime_usec(frame->build);
+  long long rasterize = mof_Time__gettime_usec(frame->rasterize);
+  int i;
+  
+  if (frame->mapflag)
   {
-    mof__update(&running_loop);
-	   
-	mof_Time__start(timer); 
+	int offsetX = mof_Player__offsetX(frame->viewer, level, 320);
+	int offsetY = mof_Player__offsetY(frame->viewer, level, 240);
+	int box[4];
+	mof_Avatar *avatar;
+	
+	/* only what moved is drawn again (over the walls kept in a layer) */
+	mof_Mapview__begin(mapview, screen, level, offsetX, offsetY);
+	for (i = 0; i < FRAME_SPRITES; i++)
+	{
+	  avatar = (mof_Avatar *)frame->sprites[i];
+	  mof_Sprite__box(frame->sprites[i], offsetX, offsetY, box);
+	  mof_Mapview__item(mapview, i, box, mof_Mapview__state(avatar->x, avatar->y, avatar->angle));
+	}
+	avatar = (mof_Avatar *)frame->viewer;
+	mof_Player__box(frame->viewer, offsetX, offsetY, box);
+	mof_Mapview__item(mapview, FRAME_SPRITES, box, mof_Mapview__state(avatar->x, avatar->y, avatar->angle));
+	mof_Raycaster__box(frame->raycaster, offsetX, offsetY, box);
+	mof_Mapview__item(mapview, FRAME_SPRITES + 1, box, mof_Mapview__state(avatar->x, avatar->y, avatar->angle));
+	
+	/* the text below is printed every frame */
+	box[0] = 0;
+	box[1] = screen->h - 40;
+	box[2] = screen->w - 1;
+	box[3] = screen->h - 1;
+	mof_Mapview__touch(mapview, box);
+	
+	mof_Mapview__draw(mapview, mof__drawmapitem, frame);
+  }
+  else
+  {
+	mof_Resolution__present(frame->resolution, screen);
+	mof_Mapview__invalidate(mapview);
+  }
+  
+  /* the stages overlap, the slowest one is the frame time */
+  if (pipeline->depth > 1)
+	mof_Resolution__govern(resolution, (build > rasterize) ? build : rasterize);
+  else
+	mof_Resolution__govern(resolution, build + rasterize);
+  
+  /* print to bottom of screen */
+  sprintf(test, "(building) milli: %3.3lld -- micro: %6.6lld", build / 1000, build);
+  mof_Font__printf(text, test, 20, screen->h - 40);
+  sprintf(test, "(rasterizing) milli: %3.3lld -- micro: %6.6lld", rasterize / 1000, rasterize);
+  mof_Font__printf(text, test, 20, screen->h - 20);
+  
+  if (frame->mapflag)
+	mof_Mapview__present(mapview);
+  else
+	SDL_Flip(screen);
+}
 
-      mof__draw();
+/**
+ * Validation of the fixed point raycaster.
+ * 
+ * The scene is casted in double precision and in fixed point from a few
+ * places of the map in every direction.  The largest difference between
+ * the wall slices of the same wall is reported on the standard output
+ * (must be 1 at most), with the number of columns seeing another wall: a
+ * ray going exactly through the corner of a cell can be rounded on either
+ * side of it.
+ * 
+ * @param name Name of the map.
+ * @param map  Pointer to a mof_Map object.
+ */
+void mof__validatefixed(const char *name, mof_Map *map)
+{
+  int i, k, angle, column, error = 0, corners = 0;
+  int top[2], bottom[2];
+  
+  mof_Camera *bench = mof_Camera__new(1920, 1080, 60);
+  mof_Raycaster *reference = mof_Raycaster__new(bench->width, NULL);
+  mof_Raycaster *caster = mof_Raycaster__new(bench->width, NULL);
+  mof_Player *viewer = mof_Player__new(screen, 0, 0, 0);
+  
+  reference->fixed = 0;
+  caster->fixed = 1;
+  
+  srand(2);
+  for (i = 0; i < 16; i++)
+  {
+	/* anywhere in an empty square */
+	do
+	{
+	  ((mof_Avatar *)viewer)->x = (rand() % (map->width * map->unit * 16)) / 16.0;
+	  ((mof_Avatar *)viewer)->y = (rand() % (map->height * map->unit * 16)) / 16.0;
+	}
+	while (map->map[(int)(((mof_Avatar *)viewer)->x / map->unit) + (int)(((mof_Avatar *)viewer)->y / map->unit) * map->width]);
+	
+	for (angle = 0; angle < 360; angle++)
+	{
+	  ((mof_Avatar *)viewer)->angle = angle;
+	  mof_Raycaster__cast(reference, bench, viewer, map);
+	  mof_Raycaster__cast(caster, bench, viewer, map);
 	  
-	  /* print to bottom of screen */
-	  sprintf(test, "(elapsed) milli: %3.3lld -- micro: %6.6lld", mof_Time__gettime_elapsed_msec(timer), mof_Time__gettime_elapsed_usec(timer));
-	  mof_Font__printf(text, test, 20, screen->h - 40);
+	  for (column = 0; column < bench->width; column++)
+	  {
+		if (reference->buffer.cell[column] != caster->buffer.cell[column])
+		{
+		  corners++;
+		  continue;
+		}
+		if (reference->buffer.cell[column] < 0)
+		  continue;
+		  
+		mof_Raycaster__slice(reference, bench, reference->buffer.depth[column], &top[0], &bottom[0]);
+		mof_Raycaster__slice(caster, bench, caster->buffer.depth[column], &top[1], &bottom[1]);
+		
+		/* only what is on the screen */
+		for (k = 0; k < 2; k++)
+		{
+		  top[k] = (top[k] < 0) ? 0 : top[k];
+		  bottom[k] = (bottom[k] >= bench->height) ? bench->height - 1 : bottom[k];
+		}
+		if (abs(top[0] - top[1]) > error)
+		  error = abs(top[0] - top[1]);
+		if (abs(bottom[0] - bottom[1]) > error)
+		  error = abs(bottom[0] - bottom[1]);
+	  }
+	}
+  }
+  
+  printf("raycaster (%s, fixed): %d pixel(s) from double precision, %d corner(s) out of %d columns\n", name, error, corners, 16 * 360 * bench->width);
+  
+  mof_Player__destroy(viewer);
+  mof_Raycaster__destroy(caster);
+  mof_Raycaster__destroy(reference);
+  mof_Camera__destroy(bench);
+}
+
+/**
+ * Benchmark of the raycaster.
+ * 
+ * Report on the standard output how many columns per second the raycaster
+ * cast with every packet size the processor support and in fixed point,
+ * then while turning: with a single raycaster, then with a raycaster per
+ * frame in flight (3), each one following the raycaster of the frame before
+ * or not.
+ * 
+ * @param name   Name of the map.
+ * @param map    Pointer to a mof_Map object.
+ * @param viewer Pointer to a mof_Player object.
+ */
+void mof__benchmarkraycaster(const char *name, mof_Map *map, mof_Player *viewer)
+{
+  const char *names[4] = {"scalar", "SSE2", "AVX2", "fixed"};
+  int packets[4] = {1, 4, 8, 1};
+  int i, frame, follow, casted;
+  mof_Raycaster *slots[3];
+  
+  mof_Camera *bench = mof_Camera__new(1920, 1080, 60);
+  mof_Raycaster *caster = mof_Raycaster__new(bench->width, NULL);
+  
+  for (i = 0; i < 4; i++)
+  {
+	if (packets[i] > mof_Raycaster__packetmax())
+	  continue;
 	  
-	  SDL_Delay(1);
+	caster->packet = packets[i];
+	caster->fixed = (i == 3);
+	mof_Time__start(timer);
+	for (frame = 0; frame < 360; frame++)
+	{
+	  ((mof_Avatar *)viewer)->angle = frame;
+	  mof_Raycaster__invalidate(caster);
+	  mof_Raycaster__cast(caster, bench, viewer, map);
+	}
+	mof_Time__stop(timer);
+	
+	printf("raycaster (%s, %s): %.0f columns/s\n", name, names[i], 360.0 * bench->width * 1000000 / mof_Time__gettime_usec(timer));
+  }
+  
+  /* turning one degree per frame, the previous hits are reused */
+  caster->packet = mof_Raycaster__packetsize();
+  caster->fixed = MOF_RAYCASTER_FIXED;
+  mof_Time__start(timer);
+  for (frame = 0; frame < 360; frame++)
+  {
+	((mof_Avatar *)viewer)->angle = frame;
+	mof_Raycaster__cast(caster, bench, viewer, map);
+  }
+  mof_Time__stop(timer);
+  
+  printf("raycaster (%s, turning): %.0f columns/s\n", name, 360.0 * bench->width * 1000000 / mof_Time__gettime_usec(timer));
+  
+  /* a raycaster per frame in flight */
+  for (i = 0; i < 3; i++)
+  {
+	slots[i] = mof_Raycaster__new(bench->width, NULL);
+  }
+  for (follow = 0; follow < 2; follow++)
+  {
+	casted = 0;
+	mof_Time__start(timer);
+	for (frame = 0; frame < 360; frame++)
+	{
+	  ((mof_Avatar *)viewer)->angle = frame;
+	  if (follow)
+		mof_Raycaster__follow(slots[frame % 3], slots[(frame + 2) % 3]);
+	  mof_Raycaster__cast(slots[frame % 3], bench, viewer, map);
+	  for (i = 0; i < bench->width; i++)
+	  {
+		casted += slots[frame % 3]->stale[i];
+	  }
+	}
+	mof_Time__stop(timer);
+	
+	printf("raycaster (%s, turning, 3 in flight%s): %.0f columns/s, %.1f%% casted\n", name, follow ? ", following" : "", 
+		   360.0 * bench->width * 1000000 / mof_Time__gettime_usec(timer), 100.0 * casted / (360.0 * bench->width));
+  }
+  for (i = 0; i < 3; i++)
+  {
+	mof_Raycaster__destroy(slots[i]);
+  }
+  
+  mof_Raycaster__destroy(caster);
+  mof_Camera__destroy(bench);
+}
+
+/**
+ * Benchmark of the batch ray queries.
+ * 
+ * Report on the standard output how many rays per second are casted from
+ * scattered origins, from a single origin in every direction and from a
+ * single origin sweeping around (adjacent rays close, casted in packets).
+ * 
+ * @param name Name of the map.
+ * @param map  Pointer to a mof_Map object.
+ */
+void mof__benchmarkquery(const char *name, mof_Map *map)
+{
+  const char *names[3] = {"scattered", "same origin", "sweep"};
+  int i, pass, count = 1 << 16;
+  double *x = malloc(count * sizeof(double));
+  double *y = malloc(count * sizeof(double));
+  double *angles = malloc(count * sizeof(double));
+  mof_Raycasterhit *hits = malloc(count * sizeof(mof_Raycasterhit));
+  
+  for (pass = 0; pass < 3; pass++)
+  {
+	srand(3);
+	for (i = 0; i < count; i++)
+	{
+	  /* origins inside the map, not always in an empty square */
+	  x[i] = (pass == 0 || i == 0) ? (rand() % (map->width * map->unit)) : x[0];
+	  y[i] = (pass == 0 || i == 0) ? (rand() % (map->height * map->unit)) : y[0];
+	  angles[i] = (pass < 2) ? (rand() % 3600) / 10.0 : i * 360.0 / count;
+	}
+	
+	mof_Time__start(timer);
+	mof_Raycaster__queryangles(map, count, x, y, angles, hits);
+	mof_Time__stop(timer);
+	
+	printf("query (%s, %s): %.0f rays/s\n", name, names[pass], (double)count * 1000000 / mof_Time__gettime_usec(timer));
+  }
+  
+  free(x);
+  free(y);
+  free(angles);
+  free(hits);
+}
+
+/**
+ * Benchmark of the wall collisions.
+ * 
+ * Report on the standard output how long a list of collision boxes (one per
+ * wall, as the map used to keep) take to build, then how many boxes of an
+ * avatar per second are checked against the walls, walking that list and
+ * reading the cells of the map (see mof_Map__intersect).
+ * 
+ * @param name Name of the map.
+ * @param map  Pointer to a mof_Map object.
+ */
+void mof__benchmarkcollision(const char *name, mof_Map *map)
+{
+  const char *names[2] = {"list", "tiles"};
+  int i, j, pass, walls = 0, count = 1 << 12, hits[2];
+  mof_Collisionbox *box = mof_Collisionbox__new(0, 0, 20, 20);
+  mof_Collisionbox *list = mof_Collisionbox__new(0, 0, map->unit, map->unit);
+  
+  mof_Time__start(timer);
+  for (i = 0; i < map->height; i++)
+  {
+	for (j = 0; j < map->width; j++)
+	{
+	  if (map->map[(i * map->width) + j])
+	  {
+		mof_Collisionbox__add(list, j * map->unit, i * map->unit, map->unit, map->unit);
+		walls++;
+	  }
+	}
+  }
+  mof_Time__stop(timer);
+  
+  printf("collision (%s, list): %d boxes (%lu bytes) built in %.3f ms\n", name, walls, 
+		 (unsigned long)walls * sizeof(mof_Collisionbox), mof_Time__gettime_usec(timer) / 1000.0);
+  
+  for (pass = 0; pass < 2; pass++)
+  {
+	srand(5);
+	hits[pass] = 0;
+	mof_Time__start(timer);
+	for (i = 0; i < count; i++)
+	{
+	  mof_Collisionbox__move(box, rand() % (map->width * map->unit), rand() % (map->height * map->unit));
+	  if (pass == 1)
+	  {
+		hits[pass] += mof_Map__intersect(map, box);
+		continue;
+	  }
+	  for (list->current = list->first->next; list->current != NULL; list->current = list->current->next)
+	  {
+		if (mof_Collisionbox__intersect(box, list->current))
+		{
+		  hits[pass]++;
+		  break;
+		}
+	  }
+	}
+	mof_Time__stop(timer);
+	
+	printf("collision (%s, %s): %.0f boxes/s\n", name, names[pass], (double)count * 1000000 / mof_Time__gettime_usec(timer));
+  }
+  printf("collision (%s): %s hits\n", name, (hits[0] == hits[1]) ? "same" : "DIFFERENT");
+  
+  mof_Collisionbox__destroy(list);
+  mof_Collisionbox__destroy(box);
+}
+
+/**
+ * Benchmark of the upscaler.
+ * 
+ * Report on the standard output how many pixels per second are written
+ * upscaling a quarter of 1080p to 1080p with every filter.
+ */
+void mof__benchmarkupscale()
+{
+  const char *names[2] = {"nearest", "bilinear"};
+  int i, frame;
+  
+  SDL_Surface *source = SDL_CreateRGBSurface(SDL_SWSURFACE, 480, 270, 32, 0xff0000, 0xff00, 0xff, 0);
+  SDL_Surface *destination = SDL_CreateRGBSurface(SDL_SWSURFACE, 1920, 1080, 32, 0xff0000, 0xff00, 0xff, 0);
+  mof_Resolution *scaler = mof_Resolution__new(FRAME_BUDGET, 0.25);
+  
+  for (i = 0; i < 2; i++)
+  {
+	scaler->filter = (i == 0) ? MOF_RESOLUTION_NEAREST : MOF_RESOLUTION_BILINEAR;
+	mof_Time__start(timer);
+	for (frame = 0; frame < 100; frame++)
+	{
+	  mof_Resolution__upscale(scaler, source, destination);
+	}
+	mof_Time__stop(timer);
 	
+	printf("upscale (%s): %.0f pixels/s\n", names[i], 100.0 * destination->w * destination->h * 1000000 / mof_Time__gettime_usec(timer));
+  }
+  
+  mof_Resolution__destroy(scaler);
+  SDL_FreeSurface(destination);
+  SDL_FreeSurface(source);
+}
+
+/**
+ * Benchmark of the line of sight between agents.
+ * 
+ * Report on the standard output the time taken to fill the whole matrix of
+ * 256 agents, then to update it when 16 of them move to the next square.
+ * 
+ * @param name Name of the map.
+ * @param map  Pointer to a mof_Map object.
+ * @param pvs  Pointer to a mof_Pvs object of the map (or NULL).
+ */
+void mof__benchmarkvisibility(const char *name, mof_Map *map, mof_Pvs *pvs)
+{
+  int i, cell, agent, step, count = 256, steps = 100;
+  double moved;
+  double *x = malloc(count * sizeof(double));
+  double *y = malloc(count * sizeof(double));
+  mof_Visibility *agents = mof_Visibility__new(pool, pvs);
+  
+  srand(5);
+  for (i = 0; i < count; i++)
+  {
+	do
+	{
+	  cell = rand() % (map->width * map->height);
+	}
+	while (map->map[cell]);
+	x[i] = (cell % map->width) * map->unit + rand() % map->unit;
+	y[i] = (cell / map->width) * map->unit + rand() % map->unit;
+  }
+  
+  mof_Time__start(timer);
+  mof_Visibility__update(agents, map, count, x, y);
+  mof_Time__stop(timer);
+  
+  printf("visibility (%s, %d agents): %lld usec\n", name, count, mof_Time__gettime_usec(timer));
+  
+  mof_Time__start(timer);
+  for (step = 0; step < steps; step++)
+  {
+	for (i = 0; i < 16; i++)
+	{
+	  /* next square to the left or to the right, if empty */
+	  agent = rand() % count;
+	  moved = x[agent] + ((rand() % 2) ? map->unit : -map->unit);
+	  if (moved >= 0 && moved < map->width * map->unit &&
+		  !map->map[(int)(moved / map->unit) + (int)(y[agent] / map->unit) * map->width])
+		x[agent] = moved;
+	}
+	mof_Visibility__update(agents, map, count, x, y);
+  }
+  mof_Time__stop(timer);
+  
+  printf("visibility (%s, 16 moving): %lld usec\n", name, mof_Time__gettime_usec(timer) / steps);
+  
+  mof_Visibility__destroy(agents);
+  free(x);
+  free(y);
+}
+
+/**
+ * Benchmark of the sort of the graphic elements.
+ * 
+ * Report on the standard output how many elements per second are sorted
+ * when added in runs (sprites of many columns) and in random order, and how
+ * many heap allocations were done once the arena was grown (first frame).
+ */
+void mof__benchmarkscene()
+{
+  const char *names[2] = {"runs", "random"};
+  int i, pass, frame, count = 1920 * 4;
+  unsigned long allocations = 0;
+  mof_Graphicelement *elements = mof_Graphicelement__new();
+  
+  for (pass = 0; pass < 2; pass++)
+  {
+	mof_Time__start(timer);
+	for (frame = 0; frame < 100; frame++)
+	{
+	  srand(frame);
+	  for (i = 0; i < count; i++)
+	  {
+		/* runs of 480 columns of the same depth */
+		mof_Graphicelement__rect(elements, (pass == 0) ? (double)(rand() % 8 + i / 480 * 8) : (rand() % 100000) / 10.0,
+								 i % 1920, 0, 1, 1, MOF_GRAPHICELEMENT_RGBA(0, 0, 0, 255));
+	  }
+	  mof_Graphicelement__sort(elements);
+	  mof_Graphicelement__clear(elements);
+	  if (frame == 0)
+		allocations = elements->arena->allocations;
+	}
 	mof_Time__stop(timer);
+	
+	printf("scene (%s): %.0f elements/s, %lu allocations after the first frame\n", names[pass],
+		   100.0 * count * 1000000 / mof_Time__gettime_usec(timer), elements->arena->allocations - allocations);
+  }
+  
+  mof_Graphicelement__destroy(elements);
+}
+
+/**
+ * Scene of the render benchmarks.
+ * 
+ * Like the 3D view: ceiling, ground, a column per pixel, sprites and a
+ * translucent overlay.
+ * 
+ * @param elements Pointer to a mof_Graphicelement object.
+ * @param surface  Surface the scene is rendered on.
+ * @param texels   Column of 64 texels.
+ */
+void mof__benchmarkelements(mof_Graphicelement *elements, SDL_Surface *surface, Uint32 *texels)
+{
+  int i, j;
+  
+  mof_Graphicelement__rect(elements, 1000, 0, 0, surface->w - 1, surface->h / 2 - 1, MOF_GRAPHICELEMENT_RGBA(106, 106, 106, 255));
+  mof_Graphicelement__rect(elements, 1000, 0, surface->h / 2, surface->w - 1, surface->h / 2 - 1, MOF_GRAPHICELEMENT_RGBA(40, 40, 40, 255));
+  for (i = 0; i < surface->w; i++)
+  {
+	j = 40 + (i * 7) % 200;
+	mof_Graphicelement__column(elements, 600 - j, i, surface->h / 2 - j, surface->h / 2 + j, texels, 64, 0, (32 << 16) / j);
+  }
+  for (j = 0; j < 3; j++)
+  {
+	for (i = 0; i < 120; i++)
+	{
+	  mof_Graphicelement__sprite(elements, 100 + j * 100, 200 + j * 250 + i, 100 + j * 40, surface->h - 100 - j * 40, texels, 64, 0, 
+								 (64 << 16) / (surface->h - 200), texels[i % 64]);
+	}
+  }
+  mof_Graphicelement__rect(elements, 0, 100, 100, surface->w - 200, surface->h - 200, MOF_GRAPHICELEMENT_RGBA(255, 0, 0, 64));
+}
+
+/**
+ * Scene of the occlusion benchmark.
+ * 
+ * Layers of walls one behind the other, like a view through openings where
+ * every wall along the rays is drawn: a column per pixel and per layer,
+ * each one covering most of the height.
+ * 
+ * @param elements Pointer to a mof_Graphicelement object.
+ * @param surface  Surface the scene is rendered on.
+ * @param texels   Column of 64 texels.
+ */
+void mof__benchmarklayers(mof_Graphicelement *elements, SDL_Surface *surface, Uint32 *texels)
+{
+  int i, j, layer;
+  
+  for (layer = 0; layer < 8; layer++)
+  {
+	for (i = 0; i < surface->w; i++)
+	{
+	  j = 200 + (i * 7 + layer * 31) % 60;
+	  mof_Graphicelement__column(elements, 100 + layer * 50, i, surface->h / 2 - j, surface->h / 2 + j, texels, 64, 0, (32 << 16) / j);
+	}
+  }
+}
+
+/**
+ * Benchmark of the tiled render.
+ * 
+ * A scene like the 3D view (ceiling, ground, a column per pixel, sprites and
+ * a translucent overlay) is rendered on a single thread, then in tiles.
+ * Report on the standard output how many frames per second are rendered
+ * and if both give the same pixels.
+ */
+void mof__benchmarktiles()
+{
+  const char *names[2] = {"single", "tiles"};
+  int i, pass, frame, same;
+  Uint32 texels[64];
+  Uint32 *pixels[2];
+  
+  SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, 960, 540, 32, 0xff0000, 0xff00, 0xff, 0);
+  mof_Graphicelement *elements = mof_Graphicelement__new();
+  
+  for (i = 0; i < 64; i++)
+  {
+	texels[i] = SDL_MapRGB(surface->format, i * 4, 255 - i * 4, (i % 8) * 32);
+  }
+  
+  for (pass = 0; pass < 2; pass++)
+  {
+	elements->pool = (pass == 0) ? NULL : tiles;
+	
+	mof_Time__start(timer);
+	for (frame = 0; frame < 50; frame++)
+	{
+	  mof__benchmarkelements(elements, surface, texels);
+	  mof_Graphicelement__render(surface, elements);
+	}
+	mof_Time__stop(timer);
+	
+	pixels[pass] = malloc(surface->h * surface->pitch);
+	memcpy(pixels[pass], surface->pixels, surface->h * surface->pitch);
+	
+	printf("render (%s, %d threads): %.0f frames/s\n", names[pass], (pass == 0) ? 1 : tiles->count, 
+		   50.0 * 1000000 / mof_Time__gettime_usec(timer));
+  }
+  
+  same = (memcmp(pixels[0], pixels[1], surface->h * surface->pitch) == 0);
+  printf("render (tiles): %s pixels\n", same ? "same" : "different");
+  
+  mof_Graphicelement__destroy(elements);
+  SDL_FreeSurface(surface);
+  free(pixels[0]);
+  free(pixels[1]);
+}
+
+/**
+ * Benchmark of the occlusion.
+ * 
+ * The scenes of mof__benchmarkelements (little overdraw) and of
+ * mof__benchmarklayers (a lot of overdraw) are rendered back to front,
+ * then front to back skipping the pixels covered, on a single thread and in
+ * tiles.  Report on the standard output how many frames per second are
+ * rendered, the overdraw (pixels written per pixel of the surface) and if
+ * every render of a scene give the same pixels.
+ */
+void mof__benchmarkocclusion()
+{
+  const char *names[2] = {"single", "tiles"};
+  const char *scenes[2] = {"view", "layers"};
+  void (*build[2])(mof_Graphicelement *, SDL_Surface *, Uint32 *) = {mof__benchmarkelements, mof__benchmarklayers};
+  int i, scene, pass, frame, same;
+  Uint32 texels[64];
+  Uint32 *pixels[4];
+  
+  SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, 960, 540, 32, 0xff0000, 0xff00, 0xff, 0);
+  mof_Graphicelement *elements = mof_Graphicelement__new();
+  
+  for (i = 0; i < 64; i++)
+  {
+	texels[i] = SDL_MapRGB(surface->format, i * 4, 255 - i * 4, (i % 8) * 32);
+  }
+  
+  for (scene = 0; scene < 2; scene++)
+  {
+	same = 1;
+	for (pass = 0; pass < 4; pass++)
+	{
+	  elements->pool = (pass % 2 == 0) ? NULL : tiles;
+	  elements->occlusion = pass / 2;
 	  
-	/* print to bottom of screen */
-	sprintf(test, "(drawing) milli: %3.3lld -- micro: %6.6lld", mof_Time__gettime_msec(timer), mof_Time__gettime_usec(timer));
-	mof_Font__printf(text, test, 20, screen->h - 20);
+	  mof_Time__start(timer);
+	  for (frame = 0; frame < 50; frame++)
+	  {
+		build[scene](elements, surface, texels);
+		mof_Graphicelement__render(surface, elements);
+	  }
+	  mof_Time__stop(timer);
+	  
+	  pixels[pass] = malloc(surface->h * surface->pitch);
+	  memcpy(pixels[pass], surface->pixels, surface->h * surface->pitch);
+	  if (memcmp(pixels[0], pixels[pass], surface->h * surface->pitch) != 0)
+		same = 0;
+	  
+	  printf("render (%s, %s, occlusion %s): %.0f frames/s, overdraw %.2f\n", scenes[scene], names[pass % 2], (pass / 2) ? "on" : "off", 
+			 50.0 * 1000000 / mof_Time__gettime_usec(timer), (double)elements->written / (surface->w * surface->h));
+	}
+	printf("render (%s, occlusion): %s pixels\n", scenes[scene], same ? "same" : "different");
+	
+	for (pass = 0; pass < 4; pass++)
+	{
+	  free(pixels[pass]);
+	}
+  }
+  
+  mof_Graphicelement__destroy(elements);
+  SDL_FreeSurface(surface);
+}
 
-	SDL_Flip(screen);
+/**
+ * Benchmark of the boxes.
+ * 
+ * Full screen boxes, opaque then translucent, are drawn by SDL_gfx then by
+ * the kernels of mof_Framebuffer on surfaces of 16, 24 and 32 bits per
+ * pixel.  Report on the standard output how many pixels per second are
+ * filled, the kernels used and if both give the same pixels.
+ */
+void mof__benchmarkfill()
+{
+  const char *names[2] = {"SDL_gfx", "mof"};
+  Uint32 masks[3][3] = {{0xf800, 0x7e0, 0x1f}, {0xff0000, 0xff00, 0xff}, {0xff0000, 0xff00, 0xff}};
+  Uint8 alphas[2] = {255, 128};
+  int depth, a, pass, frame, same, frames = 20;
+  Uint8 *pixels[2];
+  mof_Framebuffer framebuffer;
+  
+  for (depth = 0; depth < 3; depth++)
+  {
+	SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, 1920, 1080, 16 + depth * 8, masks[depth][0], masks[depth][1], 
+												masks[depth][2], 0);
+	
+	framebuffer.type = MOF_FRAMEBUFFER_TYPE;
+	mof_Framebuffer__lock(&framebuffer, surface);
+	mof_Framebuffer__unlock(&framebuffer);
+	
+	for (a = 0; a < 2; a++)
+	{
+	  for (pass = 0; pass < 2; pass++)
+	  {
+		SDL_FillRect(surface, NULL, SDL_MapRGB(surface->format, 30, 60, 90));
+		
+		mof_Time__start(timer);
+		for (frame = 0; frame < frames; frame++)
+		{
+		  if (pass == 0)
+			boxRGBA(surface, 0, 0, surface->w - 1, surface->h - 1, frame * 12, 255 - frame * 12, 128, alphas[a]);
+		  else
+			mof_Framebuffer__box(surface, 0, 0, surface->w - 1, surface->h - 1, frame * 12, 255 - frame * 12, 128, alphas[a]);
+		}
+		mof_Time__stop(timer);
+		
+		pixels[pass] = malloc(surface->h * surface->pitch);
+		memcpy(pixels[pass], surface->pixels, surface->h * surface->pitch);
+		
+		printf("fill (%d bpp, alpha %d, %s%s%s): %.0f MPixel/s\n", surface->format->BitsPerPixel, alphas[a], names[pass], 
+			   (pass == 0) ? "" : " ", (pass == 0) ? "" : framebuffer.kernels, 
+			   (double)frames * surface->w * surface->h / mof_Time__gettime_usec(timer));
+	  }
+	  
+	  same = (memcmp(pixels[0], pixels[1], surface->h * surface->pitch) == 0);
+	  printf("fill (%d bpp, alpha %d): %s pixels\n", surface->format->BitsPerPixel, alphas[a], same ? "same" : "different");
+	  free(pixels[0]);
+	  free(pixels[1]);
+	}
+	
+	SDL_FreeSurface(surface);
+  }
+}
+
+/**
+ * Benchmark.
+ * 
+ * Run every benchmark, on the level, on a big open map (long rays) and on
+ * a maze (short lines of sight).
+ */
+void mof__benchmark()
+{
+  int i, size = 1024;
+  int *cells = malloc(size * size * sizeof(int));
+  
+  /* one wall every 2000 cells or so */
+  srand(1);
+  for (i = 0; i < size * size; i++)
+  {
+	cells[i] = (rand() % 2000 == 0);
+  }
+  cells[(size / 2) * size + (size / 2)] = 0;
+  
+  mof_Map *open = mof_Map__new(screen);
+  mof_Map__load(open, cells, size, size);
+  mof_Player *viewer = mof_Player__new(screen, (size / 2) * open->unit + 32, (size / 2) * open->unit + 32, 0);
+  
+  /* one wall every 6 cells, walls all around */
+  int *walls = malloc(128 * 128 * sizeof(int));
+  for (i = 0; i < 128 * 128; i++)
+  {
+	walls[i] = (rand() % 6 == 0 || i % 128 == 0 || i % 128 == 127 || i < 128 || i >= 127 * 128);
   }
+  
+  mof_Map *maze = mof_Map__new(screen);
+  mof_Map__load(maze, walls, 128, 128);
+  
+  mof__benchmarkraycaster("level", level, player);
+  mof__benchmarkraycaster("open", open, viewer);
+  mof__validatefixed("level", level);
+  mof__validatefixed("open", open);
+  mof__benchmarkquery("level", level);
+  mof__benchmarkquery("open", open);
+  mof__benchmarkcollision("level", level);
+  mof__benchmarkcollision("open", open);
+  mof__benchmarkcollision("maze", maze);
+  mof__benchmarkupscale();
+  mof__benchmarkscene();
+  mof__benchmarktiles();
+  mof__benchmarkocclusion();
+  mof__benchmarkfill();
+  mof__benchmarkvisibility("level", level, visibility);
+  mof__benchmarkvisibility("maze", maze, NULL);
+  ((mof_Avatar *)player)->angle = 90;
+  
+  mof_Player__destroy(viewer);
+  mof_Map__destroy(maze);
+  mof_Map__destroy(open);
+  free(walls);
+  free(cells);
+}
 
+/**
+ * Main function of the application.
+ * 
+ * @param argc Arguments passed on the command line (number).
+ * @param argv Arguments passed on the command line (values).
+ * @return     0 (meaning we're done)
+ */
+int main(int argc, char **argv)
+{
+  mof__init();
+	
+  int i, depth = MOF_PIPELINE_DEPTH;
+  if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+  {
+	mof__benchmark();
+	running_loop = 0;
+  }
+  if (argc > 2 && strcmp(argv[1], "--depth") == 0)
+  {
+	depth = atoi(argv[2]);
+  }
+  if (argc > 1 && strcmp(argv[1], "--occlusion") == 0)
+  {
+	for (i = 0; i < MOF_PIPELINE_DEPTH; i++)
+	{
+	  frames[i].scene->occlusion = 1;
+	}
+  }
+  
+  pipeline = mof_Pipeline__new(depth, frames, mof__updateframe, mof__buildframe, mof__rasterizeframe, mof__presentframe);
+  while(running_loop)
+  {
+	mof_Pipeline__frame(pipeline);
+	SDL_Delay(1);
+  }
+  mof_Pipeline__destroy(pipeline);
+
+  for (i = 0; i < MOF_PIPELINE_DEPTH; i++)
+  {
+	mof_Player__destroy(frames[i].viewer);
+	mof_Sprite__destroy(frames[i].sprites[0]);
+	mof_Sprite__destroy(frames[i].sprites[1]);
+	mof_Sprite__destroy(frames[i].sprites[2]);
+	mof_Sprite__destroy(frames[i].sprites[3]);
+	mof_Camera__destroy(frames[i].camera);
+	mof_Framebuffer__destroy(frames[i].framebuffer);
+	mof_Graphicelement__destroy(frames[i].scene);
+	mof_Raycaster__destroy(frames[i].raycaster);
+	mof_Resolution__destroy(frames[i].resolution);
+	mof_Time__destroy(frames[i].build);
+	mof_Time__destroy(frames[i].rasterize);
+  }
   mof_Font__destroy(text);
-  mof_Graphicelement__destroy(scene);
   mof_Map__destroy(level);
+  mof_Mapview__destroy(mapview);
   mof_Player__destroy(player);
+  mof_Pvs__destroy(visibility);
+  mof_Resolution__destroy(resolution);
   mof_Sprite__destroy(sprite1);
   mof_Sprite__destroy(sprite2);
   mof_Sprite__destroy(sprite3);
   mof_Sprite__destroy(sprite4);
+  mof_Threadpool__destroy(pool);
+  mof_Threadpool__destroy(tiles);
   mof_Time__destroy(timer);
   SDL_Quit();
 
   return 0;
-}
\ No newline at end of file
+}